@@ -6,6 +6,10 @@
 #include "audio_codec.h"
 #include "mqtt_protocol.h"
 #include "websocket_protocol.h"
+#include "session_recorder.h"
+#include "tls_session_cache.h"
+#include "timer_service.h"
+#include "trace_recorder.h"
 #include "font_awesome_symbols.h"
 #include "iot/thing_manager.h"
 #include "assets/lang_config.h"
@@ -17,6 +21,7 @@
 #endif
 
 #include <cstring>
+#include <algorithm>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -42,6 +47,10 @@ static const char* const STATE_STRINGS[] = {
 Application::Application() {
     event_group_ = xEventGroupCreate();
     background_task_ = new BackgroundTask(4096 * 8);
+    // 上行编码和下行解码分别串行，优先分在两个核心上，实时模式下可以并行
+    // 编码落后时丢弃最旧的帧，保证上行延迟有上限；解码任务由主循环逐个提交，队列满时等待
+    encode_stream_ = background_task_->CreateStream("encode", 0, 8, kOverloadDropOldest);
+    decode_stream_ = background_task_->CreateStream("decode", 1, 4, kOverloadBlock);
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
@@ -49,24 +58,23 @@ Application::Application() {
     audio_processor_ = std::make_unique<DummyAudioProcessor>();
 #endif
 
-    esp_timer_create_args_t clock_timer_args = {
-        .callback = [](void* arg) {
-            Application* app = (Application*)arg;
-            app->OnClockTimer();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "clock_timer",
-        .skip_unhandled_events = true
-    };
-    esp_timer_create(&clock_timer_args, &clock_timer_handle_);
-    esp_timer_start_periodic(clock_timer_handle_, 1000000);
+    auto& timer_service = TimerService::GetInstance();
+    timer_service.SetMainLoopDispatcher([this](std::function<void()> callback) {
+        Schedule(std::move(callback));
+    });
+    AsyncRuntime::GetInstance().SetMainLoopDispatcher([this](std::function<void()> callback) {
+        Schedule(std::move(callback));
+    });
+    // 最先启动，之后启动的 1 秒定时器都会合并到它的唤醒上；GPIO20 轮询最多延后 200 ms
+    clock_timer_id_ = timer_service.Create("clock_timer", kTimerDispatchTimerTask, [this]() {
+        OnClockTimer();
+    });
+    timer_service.StartPeriodic(clock_timer_id_, 1000, 200);
 }
 
 Application::~Application() {
-    if (clock_timer_handle_ != nullptr) {
-        esp_timer_stop(clock_timer_handle_);
-        esp_timer_delete(clock_timer_handle_);
+    if (clock_timer_id_ >= 0) {
+        TimerService::GetInstance().Delete(clock_timer_id_);
     }
     if (background_task_ != nullptr) {
         delete background_task_;
@@ -74,7 +82,7 @@ Application::~Application() {
     vEventGroupDelete(event_group_);
 }
 
-void Application::CheckNewVersion() {
+Async<bool> Application::CheckNewVersion(bool background) {
     const int MAX_RETRY = 10;
     int retry_count = 0;
     int retry_delay = 10; // 初始重试延迟为10秒
@@ -82,26 +90,33 @@ void Application::CheckNewVersion() {
     ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === CheckNewVersion() 开始");
     while (true) {
         ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === CheckNewVersion() 循环中");
-        SetDeviceState(kDeviceStateActivating);
         auto display = Board::GetInstance().GetDisplay();
-        display->SetStatus(Lang::Strings::CHECKING_NEW_VERSION);
+        if (!background) {
+            SetDeviceState(kDeviceStateActivating);
+            display->SetStatus(Lang::Strings::CHECKING_NEW_VERSION);
+        }
 
-        if (!ota_.CheckVersion()) {
+        // HTTP 请求在独立任务中执行，等待期间主循环照常处理其它事件
+        bool checked = co_await RunInTask("check_version", [this]() { return ota_.CheckVersion(); });
+        if (!checked) {
             retry_count++;
             if (retry_count >= MAX_RETRY) {
                 ESP_LOGE(TAG, "Too many retries, exit version check");
                 ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === CheckNewVersion() 因重试次数过多而退出");
-                return;
+                co_return false;
             }
 
-            char buffer[128];
-            snprintf(buffer, sizeof(buffer), Lang::Strings::CHECK_NEW_VERSION_FAILED, retry_delay, ota_.GetCheckVersionUrl().c_str());
-            Alert(Lang::Strings::ERROR, buffer, "sad", Lang::Sounds::P3_EXCLAMATION);
+            // 后台检查失败不打扰用户，服务器配置仍可使用
+            if (!background) {
+                char buffer[128];
+                snprintf(buffer, sizeof(buffer), Lang::Strings::CHECK_NEW_VERSION_FAILED, retry_delay, ota_.GetCheckVersionUrl().c_str());
+                Alert(Lang::Strings::ERROR, buffer, "sad", Lang::Sounds::P3_EXCLAMATION);
+            }
 
             ESP_LOGW(TAG, "Check new version failed, retry in %d seconds (%d/%d)", retry_delay, retry_count, MAX_RETRY);
             for (int i = 0; i < retry_delay; i++) {
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                if (device_state_ == kDeviceStateIdle) {
+                co_await Delay(1000, 100);
+                if (!background && device_state_ == kDeviceStateIdle) {
                     break;
                 }
             }
@@ -111,10 +126,19 @@ void Application::CheckNewVersion() {
         retry_count = 0;
         retry_delay = 10; // 重置重试延迟时间
 
+        if (background && (ota_.HasNewVersion() || ota_.HasActivationCode() || ota_.HasActivationChallenge())) {
+            // 后台检查发现需要升级或重新激活，等对话结束回到待机后再继续
+            while (device_state_ != kDeviceStateIdle) {
+                co_await Delay(1000, 1000);
+            }
+            background = false;
+            SetDeviceState(kDeviceStateActivating);
+        }
+
         if (ota_.HasNewVersion()) {
             Alert(Lang::Strings::OTA_UPGRADE, Lang::Strings::UPGRADING, "happy", Lang::Sounds::P3_UPGRADE);
 
-            vTaskDelay(pdMS_TO_TICKS(3000));
+            co_await Delay(3000);
 
             SetDeviceState(kDeviceStateUpgrading);
             
@@ -127,17 +151,21 @@ void Application::CheckNewVersion() {
 #if CONFIG_USE_WAKE_WORD_DETECT
             wake_word_detect_.StopDetection();
 #endif
+            // 后台检查时协议已经启动，先关闭音频通道，升级过程中不再收发音频
+            if (protocol_ && protocol_->IsAudioChannelOpened()) {
+                protocol_->CloseAudioChannel();
+            }
             // 预先关闭音频输出，避免升级过程有音频操作
             auto codec = board.GetAudioCodec();
             codec->EnableInput(false);
             codec->EnableOutput(false);
             {
                 std::lock_guard<std::mutex> lock(mutex_);
-                audio_decode_queue_.clear();
+                ClearAudioQueue();
             }
+            // 只等待已提交的任务完成，不释放 background_task_，协议和音频回调可能仍会提交任务
             background_task_->WaitForCompletion();
-            delete background_task_;
-            background_task_ = nullptr;
+            // 以下直到重启都阻塞主循环
             vTaskDelay(pdMS_TO_TICKS(1000));
 
             ota_.StartUpgrade([display](int progress, size_t speed) {
@@ -151,16 +179,23 @@ void Application::CheckNewVersion() {
             ESP_LOGI(TAG, "Firmware upgrade failed...");
             vTaskDelay(pdMS_TO_TICKS(3000));
             Reboot();
-            return;
+            co_return false;
         }
 
         // No new version, mark the current version as valid
         ota_.MarkCurrentVersionValid();
         if (!ota_.HasActivationCode() && !ota_.HasActivationChallenge()) {
+            if (protocol_ && ota_.IsServerConfigChanged()) {
+                // 后台检查或重新激活后服务器下发了新配置，协议仍在使用 NVS 中的旧配置，回到待机后重新创建
+                while (device_state_ != kDeviceStateIdle && device_state_ != kDeviceStateActivating) {
+                    co_await Delay(1000, 1000);
+                }
+                RestartProtocol();
+            } else {
+                ota_.SaveServerConfig();
+            }
             ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === CheckNewVersion() 正常完成，准备进入主循环");
-            xEventGroupSetBits(event_group_, CHECK_NEW_VERSION_DONE_EVENT);
-            // Exit the loop if done checking new version
-            break;
+            co_return true;
         }
 
         display->SetStatus(Lang::Strings::ACTIVATION);
@@ -169,17 +204,16 @@ void Application::CheckNewVersion() {
             ShowActivationCode();
         }
 
-        // This will block the loop until the activation is done or timeout
+        // 激活成功或放弃后重新检查版本，取得激活后的服务器配置
         for (int i = 0; i < 10; ++i) {
             ESP_LOGI(TAG, "Activating... %d/%d", i + 1, 10);
-            esp_err_t err = ota_.Activate();
+            esp_err_t err = co_await RunInTask("activate", [this]() { return ota_.Activate(); });
             if (err == ESP_OK) {
-                xEventGroupSetBits(event_group_, CHECK_NEW_VERSION_DONE_EVENT);
                 break;
             } else if (err == ESP_ERR_TIMEOUT) {
-                vTaskDelay(pdMS_TO_TICKS(3000));
+                co_await Delay(3000);
             } else {
-                vTaskDelay(pdMS_TO_TICKS(10000));
+                co_await Delay(10000);
             }
             if (device_state_ == kDeviceStateIdle) {
                 break;
@@ -250,8 +284,6 @@ void Application::PlaySound(const std::string_view& sound) {
             return audio_decode_queue_.empty();
         });
     }
-    background_task_->WaitForCompletion();
-
     // The assets are encoded at 16000Hz, 60ms frame duration
     SetDecodeSampleRate(16000, 60);
     const char* data = sound.data();
@@ -267,7 +299,7 @@ void Application::PlaySound(const std::string_view& sound) {
         p += payload_size;
 
         std::lock_guard<std::mutex> lock(mutex_);
-        audio_decode_queue_.emplace_back(std::move(packet));
+        QueueAudioPacket(std::move(packet));
     }
 }
 
@@ -284,12 +316,11 @@ void Application::ToggleChatState() {
 
     if (device_state_ == kDeviceStateIdle) {
         Schedule([this]() {
-            SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
-                return;
-            }
-
-            SetListeningMode(realtime_chat_enabled_ ? kListeningModeRealtime : kListeningModeAutoStop);
+            OpenAudioChannel([this](bool success) {
+                if (success) {
+                    SetListeningMode(realtime_chat_enabled_ ? kListeningModeRealtime : kListeningModeAutoStop);
+                }
+            });
         });
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
@@ -315,14 +346,15 @@ void Application::StartListening() {
     
     if (device_state_ == kDeviceStateIdle) {
         Schedule([this]() {
-            if (!protocol_->IsAudioChannelOpened()) {
-                SetDeviceState(kDeviceStateConnecting);
-                if (!protocol_->OpenAudioChannel()) {
-                    return;
-                }
+            if (protocol_->IsAudioChannelOpened()) {
+                SetListeningMode(kListeningModeManualStop);
+                return;
             }
-
-            SetListeningMode(kListeningModeManualStop);
+            OpenAudioChannel([this](bool success) {
+                if (success) {
+                    SetListeningMode(kListeningModeManualStop);
+                }
+            });
         });
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
@@ -351,148 +383,135 @@ void Application::StopListening() {
     });
 }
 
-void Application::Start() {
-    ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === Application::Start() 开始");
-    auto& board = Board::GetInstance();
-    SetDeviceState(kDeviceStateStarting);
+// Open the audio channel without blocking the main loop,
+// the callback is executed in the main loop once the channel is opened or failed
+void Application::OpenAudioChannel(std::function<void(bool success)> callback) {
+    SetDeviceState(kDeviceStateConnecting);
+    protocol_->OpenAudioChannelAsync([this, callback](bool success) {
+        Schedule([this, callback, success]() {
+            // 打开过程中状态可能已被网络错误等改变
+            bool opened = success && device_state_ == kDeviceStateConnecting;
+            if (!opened && device_state_ == kDeviceStateConnecting) {
+                SetDeviceState(kDeviceStateIdle);
+            }
+            callback(opened);
+        });
+    });
+}
 
-    /* Setup the display */
+// 按 ota_ 中的服务器配置创建协议并注册回调
+void Application::InitializeProtocol() {
+    auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
-
-    /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    if (realtime_chat_enabled_) {
-        ESP_LOGI(TAG, "Realtime chat enabled, setting opus encoder complexity to 0");
-        opus_encoder_->SetComplexity(0);
-    } else if (board.GetBoardType() == "ml307") {
-        ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
-        opus_encoder_->SetComplexity(5);
-    } else {
-        ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 3");
-        opus_encoder_->SetComplexity(3);
-    }
 
-    if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
-    }
-    codec->Start();
+    display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
-#if CONFIG_USE_AUDIO_PROCESSOR
-    xTaskCreatePinnedToCore([](void* arg) {
-        Application* app = (Application*)arg;
-        app->AudioLoop();
-        vTaskDelete(NULL);
-    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, 1);
-#else
-    xTaskCreate([](void* arg) {
-        Application* app = (Application*)arg;
-        app->AudioLoop();
-        vTaskDelete(NULL);
-    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_);
+#if CONFIG_USE_SESSION_RECORDER
+    // 需要在注册协议回调之前启动
+    SessionRecorder::GetInstance().Start(CONFIG_SESSION_RECORDER_BUFFER_KB * 1024);
 #endif
 
-    /* Wait for the network to be ready */
-    board.StartNetwork();
-
-    // Check for new firmware version or get the MQTT broker address
-    CheckNewVersion();
-
-    // Initialize the protocol
-    display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
-
-    if (ota_.HasMqttConfig()) {
-        protocol_ = std::make_unique<MqttProtocol>();
-    } else if (ota_.HasWebsocketConfig()) {
-        protocol_ = std::make_unique<WebsocketProtocol>();
-        protocol_->OpenAudioChannel(); // 启动时立即连接WebSocket服务器
-        
+    bool connect_on_start = false;
+    auto& iot_digest = iot::ThingManager::GetInstance().GetDescriptorsDigest();
+    auto& timer_service = TimerService::GetInstance();
+    // 重新创建协议时定时器已存在，只按新的协议类型启动或停止
+    if (heartbeat_timer_id_ < 0) {
         // 新增：定期发送WebSocket心跳包
-        static esp_timer_handle_t heartbeat_timer_handle = nullptr;
-        esp_timer_create_args_t heartbeat_timer_args = {
-            .callback = [](void* arg) {
-                Application* app = (Application*)arg;
-                if (app->protocol_ && app->protocol_->IsAudioChannelOpened()) {
-                    app->protocol_->SendPing();
-                }
-            },
-            .arg = this,
-            .dispatch_method = ESP_TIMER_TASK,
-            .name = "heartbeat_timer",
-            .skip_unhandled_events = true
-        };
-        esp_timer_create(&heartbeat_timer_args, &heartbeat_timer_handle);
-        esp_timer_start_periodic(heartbeat_timer_handle, 30000000); // 30秒
-        
+        heartbeat_timer_id_ = timer_service.Create("heartbeat_timer", kTimerDispatchMainLoop, [this]() {
+            if (protocol_ && protocol_->IsAudioChannelOpened()) {
+                protocol_->SendPing();
+            }
+        });
         // 新增：WebSocket连接状态检测和自动重连
-        static esp_timer_handle_t connection_check_timer_handle = nullptr;
-        esp_timer_create_args_t connection_check_timer_args = {
-            .callback = [](void* arg) {
-                Application* app = (Application*)arg;
-                // 只在空闲状态时检测连接状态，避免在对话过程中干扰
-                if (app->device_state_ == kDeviceStateIdle) {
-                    if (app->protocol_ && !app->protocol_->IsAudioChannelOpened()) {
-                        ESP_LOGI(TAG, "定期检测：WebSocket连接断开，尝试重新连接...");
-                        app->protocol_->OpenAudioChannel();
-                    } else if (app->protocol_ && app->protocol_->IsAudioChannelOpened()) {
-                        ESP_LOGD(TAG, "WebSocket连接状态正常");
-                    }
+        connection_check_timer_id_ = timer_service.Create("connection_check_timer", kTimerDispatchMainLoop, [this]() {
+            // 只在空闲状态时检测连接状态，避免在对话过程中干扰
+            if (device_state_ == kDeviceStateIdle) {
+                if (protocol_ && !protocol_->IsAudioChannelOpened()) {
+                    ESP_LOGI(TAG, "定期检测：WebSocket连接断开，尝试重新连接...");
+                    protocol_->OpenAudioChannelAsync(nullptr);
+                } else if (protocol_ && protocol_->IsAudioChannelOpened()) {
+                    ESP_LOGD(TAG, "WebSocket连接状态正常");
                 }
-            },
-            .arg = this,
-            .dispatch_method = ESP_TIMER_TASK,
-            .name = "connection_check_timer",
-            .skip_unhandled_events = true
-        };
-        esp_timer_create(&connection_check_timer_args, &connection_check_timer_handle);
-        esp_timer_start_periodic(connection_check_timer_handle, 5000000); // 改为5秒检测一次，更频繁
+            }
+        });
+    }
+
+    std::unique_ptr<Protocol> protocol;
+    if (ota_.HasMqttConfig()) {
+        protocol = std::make_unique<MqttProtocol>();
+        protocol->SetIotDescriptorsDigest(iot_digest);
+        timer_service.Stop(heartbeat_timer_id_);
+        timer_service.Stop(connection_check_timer_id_);
+    } else if (ota_.HasWebsocketConfig()) {
+        protocol = std::make_unique<WebsocketProtocol>();
+        protocol->SetIotDescriptorsDigest(iot_digest);
+        connect_on_start = true;
+        timer_service.StartPeriodic(heartbeat_timer_id_, 30000, 5000); // 30秒
+        timer_service.StartPeriodic(connection_check_timer_id_, 5000, 1000); // 改为5秒检测一次，更频繁
     } else {
         ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
-        protocol_ = std::make_unique<MqttProtocol>();
+        protocol = std::make_unique<MqttProtocol>();
+        protocol->SetIotDescriptorsDigest(iot_digest);
+        timer_service.Stop(heartbeat_timer_id_);
+        timer_service.Stop(connection_check_timer_id_);
     }
 
-    protocol_->OnNetworkError([this](const std::string& message) {
-        SetDeviceState(kDeviceStateIdle);
-        Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
+    protocol->OnNetworkError([this](const std::string& message) {
+        // 网络错误可能在打开通道的任务中上报，切回主循环处理
+        Schedule([this, message]() {
+            SetDeviceState(kDeviceStateIdle);
+            Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
+        });
     });
-    protocol_->OnIncomingAudio([this](AudioStreamPacket&& packet) {
-        const int max_packets_in_queue = 600 / OPUS_FRAME_DURATION_MS;
+    // 在协议的接收任务中回调，直接使用所属的协议对象，不读取可能正被主循环替换的 protocol_
+    protocol->OnIncomingAudio([this, protocol = protocol.get()](AudioStreamPacket&& packet) {
+        // 抖动越大，允许缓存的音频越多，最多 1.2 秒
+        auto quality = protocol->link_quality();
+        int buffer_ms = std::min(600 + 4 * quality.rtt_var_ms, 1200);
+        const int max_packets_in_queue = buffer_ms / OPUS_FRAME_DURATION_MS;
         std::lock_guard<std::mutex> lock(mutex_);
         if (audio_decode_queue_.size() < max_packets_in_queue) {
-            audio_decode_queue_.emplace_back(std::move(packet));
+            QueueAudioPacket(std::move(packet));
         }
     });
-    protocol_->OnAudioChannelOpened([this, codec, &board]() {
-        board.SetPowerSaveMode(false);
-        if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
-            ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
-                protocol_->server_sample_rate(), codec->output_sample_rate());
-        }
-        SetDecodeSampleRate(protocol_->server_sample_rate(), protocol_->server_frame_duration());
-        auto& thing_manager = iot::ThingManager::GetInstance();
-        protocol_->SendIotDescriptors(thing_manager.GetDescriptorsJson());
-        std::string states;
-        if (thing_manager.GetStatesJson(states, false)) {
-            protocol_->SendIotStates(states);
-        }
+    // 在 open_channel 任务中回调，切换解码器等操作放到主循环中执行，与 PlaySound 等串行
+    protocol->OnAudioChannelOpened([this, codec, &board]() {
+        Schedule([this, codec, &board]() {
+            board.SetPowerSaveMode(false);
+            if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
+                ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
+                    protocol_->server_sample_rate(), codec->output_sample_rate());
+            }
+            SetDecodeSampleRate(protocol_->server_sample_rate(), protocol_->server_frame_duration());
+            auto& thing_manager = iot::ThingManager::GetInstance();
+            protocol_->SendIotDescriptors(thing_manager.GetDescriptorJsonList());
+            std::string states;
+            if (thing_manager.GetStatesJson(states, false)) {
+                protocol_->SendIotStates(states);
+            }
+        });
     });
-    protocol_->OnAudioChannelClosed([this, &board]() {
+    protocol->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveMode(true);
+        // 回到待机时确保有可复用的 TLS 会话，下次唤醒重连时跳过完整握手
+        board.WarmUpConnection();
         Schedule([this]() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
+    protocol->OnIncomingJson([this, display](const cJSON* root) {
         // Parse JSON data
         auto type = cJSON_GetObjectItem(root, "type");
         if (strcmp(type->valuestring, "tts") == 0) {
             auto state = cJSON_GetObjectItem(root, "state");
             if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
+                Schedule([this, display]() {
+                    // 上一轮剩余的字幕先显示完，本轮的字幕另起一条消息
+                    FlushCaptions();
+                    display->StartCaption();
                     aborted_ = false;
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
                         SetDeviceState(kDeviceStateSpeaking);
@@ -500,7 +519,7 @@ void Application::Start() {
                 });
             } else if (strcmp(state->valuestring, "stop") == 0) {
                 Schedule([this]() {
-                    background_task_->WaitForCompletion();
+                    background_task_->WaitForStream(decode_stream_);
                     if (device_state_ == kDeviceStateSpeaking) {
                         if (listening_mode_ == kListeningModeManualStop) {
                             SetDeviceState(kDeviceStateIdle);
@@ -513,9 +532,18 @@ void Application::Start() {
                 auto text = cJSON_GetObjectItem(root, "text");
                 if (text != NULL) {
                     ESP_LOGI(TAG, "<< %s", text->valuestring);
+#if CONFIG_USE_CAPTION_FOLLOW_AUDIO
+                    // 文字通常先于对应的音频到达，记录此时已收到的音频包数量，播放到这里时才显示
+                    // 在主循环中加入队列，排在本轮 tts start 的 FlushCaptions 之后，不会被并入上一轮的消息
+                    Schedule([this, position = audio_queued_packets_.load(), message = std::string(text->valuestring)]() mutable {
+                        std::lock_guard<std::mutex> lock(caption_mutex_);
+                        pending_captions_.push_back({position, std::move(message)});
+                    });
+#else
                     Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
+                        display->AppendCaption(message.c_str());
                     });
+#endif
                 }
             }
         } else if (strcmp(type->valuestring, "stt") == 0) {
@@ -551,6 +579,12 @@ void Application::Start() {
                     Schedule([this]() {
                         Reboot();
                     });
+                } else if (strcmp(command->valuestring, "dump_capture") == 0) {
+                    SessionRecorder::GetInstance().DumpAsync();
+                } else if (strcmp(command->valuestring, "dump_trace") == 0) {
+#if CONFIG_USE_TRACE_PROFILER
+                    TraceRecorder::GetInstance().DumpAsync();
+#endif
                 } else {
                     ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
                 }
@@ -566,90 +600,234 @@ void Application::Start() {
             }
         }
     });
-    bool protocol_started = protocol_->Start();
+    {
+        // 定时器任务会读取 protocol_
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        protocol_ = std::move(protocol);
+    }
+    protocol_started_ = protocol_->Start();
+    if (protocol_started_ && connect_on_start) {
+        // 启动时立即连接WebSocket服务器，回调已注册后再连接，不等待连接完成即可进入待机
+        protocol_->OpenAudioChannelAsync(nullptr);
+    }
+}
 
-    audio_processor_->Initialize(codec);
-    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            if (protocol_->IsAudioChannelBusy()) {
-                return;
-            }
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                AudioStreamPacket packet;
-                packet.payload = std::move(opus);
-                packet.timestamp = last_output_timestamp_;
-                last_output_timestamp_ = 0;
-                Schedule([this, packet = std::move(packet)]() {
-                    protocol_->SendAudio(packet);
-                });
-            });
-        });
+// 在主循环中调用，停止当前协议后写入新的服务器配置，再按新配置创建协议
+void Application::RestartProtocol() {
+    ESP_LOGI(TAG, "Server config changed, restarting protocol");
+    if (protocol_->IsAudioChannelOpened()) {
+        protocol_->CloseAudioChannel();
+    }
+    // 不在聆听状态时不会再提交编码任务，等待已提交的任务结束后它们不再读取 protocol_
+    background_task_->WaitForStream(encode_stream_);
+    std::unique_ptr<Protocol> protocol;
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        protocol = std::move(protocol_);
+    }
+    // 析构时等待协议的任务退出，不持有锁
+    protocol.reset();
+
+    ota_.SaveServerConfig();
+    InitializeProtocol();
+    if (device_state_ == kDeviceStateIdle) {
+        Board::GetInstance().GetDisplay()->SetStatus(Lang::Strings::STANDBY);
+    }
+}
+
+// 启动时的联网流程。之前激活过并保存了服务器配置时直接用它创建协议进入待机，版本检查在后台进行；
+// 否则需先检查版本（首次启动、激活）取得服务器配置
+Async<void> Application::ConnectToServer(bool use_cached_config) {
+    if (!use_cached_config) {
+        int64_t start_time = esp_timer_get_time();
+        // Check for new firmware version or get the MQTT broker address
+        if (!co_await CheckNewVersion(false)) {
+            co_return;
+        }
+        boot_sequencer_.Record("ota_check", start_time);
+
+        start_time = esp_timer_get_time();
+        InitializeProtocol();
+        boot_sequencer_.Record("protocol", start_time);
+    }
+
+    SetDeviceState(kDeviceStateIdle);
+    boot_sequencer_.Record("idle", esp_timer_get_time());
+    boot_sequencer_.PrintTimeline();
+
+    auto display = Board::GetInstance().GetDisplay();
+    if (protocol_started_) {
+        std::string message = std::string(Lang::Strings::VERSION) + ota_.GetCurrentVersion();
+        display->ShowNotification(message.c_str());
+        display->SetChatMessage("system", "");
+        // Play the success sound to indicate the device is ready
+        ResetDecoder();
+        PlaySound(Lang::Sounds::P3_SUCCESS);
+    }
+
+    if (use_cached_config) {
+        int64_t start_time = esp_timer_get_time();
+        co_await CheckNewVersion(true);
+        ESP_LOGI(TAG, "Background version check finished in %lld ms", (esp_timer_get_time() - start_time) / 1000);
+        // 后台检查中途重新激活过
+        if (device_state_ == kDeviceStateActivating) {
+            SetDeviceState(kDeviceStateIdle);
+        }
+    }
+}
+
+#if CONFIG_USE_WAKE_WORD_DETECT
+Async<void> Application::StartConversation(std::string wake_word) {
+    wake_word_detect_.EncodeWakeWordData();
+
+    bool success = co_await WaitCallback<bool>([this](std::function<void(bool)> done) {
+        OpenAudioChannel(std::move(done));
     });
-    audio_processor_->OnVadStateChange([this](bool speaking) {
-        if (device_state_ == kDeviceStateListening) {
-            Schedule([this, speaking]() {
-                if (speaking) {
-                    voice_detected_ = true;
-                } else {
-                    voice_detected_ = false;
-                }
-                auto led = Board::GetInstance().GetLed();
-                led->OnStateChanged();
-            });
+    if (!success) {
+        wake_word_detect_.StartDetection();
+        co_return;
+    }
+
+    AudioStreamPacket packet;
+    // Encode and send the wake word data to the server
+    while (wake_word_detect_.GetWakeWordOpus(packet.payload)) {
+        protocol_->SendAudio(packet);
+    }
+    // Set the chat state to wake word detected
+    protocol_->SendWakeWordDetected(wake_word);
+    ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
+    SetListeningMode(realtime_chat_enabled_ ? kListeningModeRealtime : kListeningModeAutoStop);
+}
+#endif
+
+void Application::Start() {
+    ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === Application::Start() 开始");
+    auto& board = Board::GetInstance();
+    SetDeviceState(kDeviceStateStarting);
+    auto codec = board.GetAudioCodec();
+    bool use_cached_config = ota_.LoadCachedConfig();
+
+    /* Setup the audio codec */
+    boot_sequencer_.AddStage("codec", {}, [this, codec, &board]() {
+        opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
+        opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+        if (realtime_chat_enabled_) {
+            ESP_LOGI(TAG, "Realtime chat enabled, setting opus encoder complexity to 0");
+            opus_encoder_->SetComplexity(0);
+        } else if (board.GetBoardType() == "ml307") {
+            ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
+            opus_encoder_->SetComplexity(5);
+        } else {
+            ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 3");
+            opus_encoder_->SetComplexity(3);
+        }
+
+        if (codec->input_sample_rate() != 16000) {
+            input_resampler_.Configure(codec->input_sample_rate(), 16000);
+            reference_resampler_.Configure(codec->input_sample_rate(), 16000);
         }
+        codec->Start();
+
+    #if CONFIG_USE_AUDIO_PROCESSOR
+        xTaskCreatePinnedToCore([](void* arg) {
+            Application* app = (Application*)arg;
+            app->AudioLoop();
+            vTaskDelete(NULL);
+        }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, 1);
+    #else
+        xTaskCreate([](void* arg) {
+            Application* app = (Application*)arg;
+            app->AudioLoop();
+            vTaskDelete(NULL);
+        }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_);
+    #endif
     });
 
-#if CONFIG_USE_WAKE_WORD_DETECT
-    wake_word_detect_.Initialize(codec);
-    wake_word_detect_.OnWakeWordDetected([this](const std::string& wake_word) {
-        Schedule([this, &wake_word]() {
-            if (device_state_ == kDeviceStateIdle) {
-                SetDeviceState(kDeviceStateConnecting);
-                wake_word_detect_.EncodeWakeWordData();
+    /* Wait for the network to be ready */
+    // 联网过程中可能播放提示音，需要音频输出已启动
+    boot_sequencer_.AddStage("network", {"codec"}, [&board]() {
+        board.StartNetwork();
+    });
 
-                if (!protocol_ || !protocol_->OpenAudioChannel()) {
-                    wake_word_detect_.StartDetection();
+    // AFE 和唤醒词模型的加载不依赖网络，与联网同时进行
+    boot_sequencer_.AddStage("afe", {"codec"}, [this, codec]() {
+        audio_processor_->Initialize(codec);
+        audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
+            background_task_->Schedule(encode_stream_, [this, data = std::move(data)]() mutable {
+                if (protocol_->IsAudioChannelBusy()) {
                     return;
                 }
-                
-                AudioStreamPacket packet;
-                // Encode and send the wake word data to the server
-                while (wake_word_detect_.GetWakeWordOpus(packet.payload)) {
-                    protocol_->SendAudio(packet);
-                }
-                // Set the chat state to wake word detected
-                protocol_->SendWakeWordDetected(wake_word);
-                ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
-                SetListeningMode(realtime_chat_enabled_ ? kListeningModeRealtime : kListeningModeAutoStop);
-            } else if (device_state_ == kDeviceStateSpeaking) {
-                AbortSpeaking(kAbortReasonWakeWordDetected);
-            } else if (device_state_ == kDeviceStateActivating) {
-                SetDeviceState(kDeviceStateIdle);
+                opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
+                    AudioStreamPacket packet;
+                    packet.payload = std::move(opus);
+                    packet.timestamp = last_output_timestamp_;
+                    last_output_timestamp_ = 0;
+                    // 直接进入协议层的音频发送队列，不再占用主循环
+                    protocol_->SendAudio(std::move(packet));
+                });
+            });
+        });
+        audio_processor_->OnVadStateChange([this](bool speaking) {
+            if (device_state_ == kDeviceStateListening) {
+                Schedule([this, speaking]() {
+                    if (speaking) {
+                        voice_detected_ = true;
+                    } else {
+                        voice_detected_ = false;
+                    }
+                    auto led = Board::GetInstance().GetLed();
+                    led->OnStateChanged();
+                });
             }
         });
     });
-    wake_word_detect_.StartDetection();
-#endif
 
-    // Wait for the new version check to finish
-    xEventGroupWaitBits(event_group_, CHECK_NEW_VERSION_DONE_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
-    SetDeviceState(kDeviceStateIdle);
+#if CONFIG_USE_WAKE_WORD_DETECT
+    // 与 AFE 从同一个模型分区加载，不能并发
+    boot_sequencer_.AddStage("wake_word", {"afe"}, [this, codec]() {
+        wake_word_detect_.Initialize(codec);
+        wake_word_detect_.OnWakeWordDetected([this](const std::string& wake_word) {
+            // 在检测任务中立即打印，早于打开音频通道，作为延迟测量的起点 (scripts/stub_server/bench.py)
+            ESP_LOGI(TAG, "Wake word triggered: %s", wake_word.c_str());
+            Schedule([this, wake_word]() {
+                if (device_state_ == kDeviceStateIdle) {
+                    if (!protocol_) {
+                        return;
+                    }
+                    Spawn(StartConversation(wake_word));
+                } else if (device_state_ == kDeviceStateSpeaking) {
+                    AbortSpeaking(kAbortReasonWakeWordDetected);
+                } else if (device_state_ == kDeviceStateActivating) {
+                    SetDeviceState(kDeviceStateIdle);
+                }
+            });
+        });
+        wake_word_detect_.StartDetection();
+    });
+#endif
 
-    if (protocol_started) {
-        std::string message = std::string(Lang::Strings::VERSION) + ota_.GetCurrentVersion();
-        display->ShowNotification(message.c_str());
-        display->SetChatMessage("system", "");
-        // Play the success sound to indicate the device is ready
-        ResetDecoder();
-        PlaySound(Lang::Sounds::P3_SUCCESS);
+    // 有保存的服务器配置时协议也在启动阶段中创建，不必等待版本检查
+    if (use_cached_config) {
+        boot_sequencer_.AddStage("protocol", {"network", "codec"}, [this]() {
+            InitializeProtocol();
+        });
     }
-    
+    boot_sequencer_.Run();
+
+    // 版本检查、激活在主循环中以协程执行
+    Spawn(ConnectToServer(use_cached_config));
+
     // Enter the main event loop
     ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === Application::Start() 即将进入主循环 MainEventLoop()");
     MainEventLoop();
     ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === Application::Start() 已退出（理论上不应出现）");
 }
 
+LinkQuality Application::GetLinkQuality() {
+    std::lock_guard<std::mutex> lock(protocol_mutex_);
+    return protocol_ ? protocol_->link_quality() : LinkQuality();
+}
+
 void Application::OnClockTimer() {
     ESP_LOGI(TAG, "=== DEBUG-GPIO-202406 === OnClockTimer() 被调用");
     clock_ticks_++;
@@ -686,6 +864,35 @@ void Application::OnClockTimer() {
         int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
         int min_free_sram = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
         ESP_LOGI(TAG, "Free internal: %u minimal internal: %u", free_sram, min_free_sram);
+        ESP_LOGI(TAG, "Max main loop stall: %lld ms, max state transition wait: %lld ms",
+            max_main_loop_stall_us_.exchange(0) / 1000, max_transition_wait_us_.exchange(0) / 1000);
+        auto timers = TimerService::GetInstance().GetStats();
+        ESP_LOGI(TAG, "Timers: %lu active, %lu callbacks in %lu wakeups", timers.active, timers.fired, timers.wakeups);
+        if (background_task_ != nullptr) {
+            auto encode = background_task_->GetStreamStats(encode_stream_);
+            auto decode = background_task_->GetStreamStats(decode_stream_);
+            ESP_LOGI(TAG, "Encode: %lu frames dropped %lu depth %lu max wait %lu us max run %lu us, decode: %lu frames rejected %lu depth %lu max wait %lu us max run %lu us",
+                encode.completed, encode.dropped, encode.max_depth, encode.max_wait_us, encode.max_run_us,
+                decode.completed, decode.rejected, decode.max_depth, decode.max_wait_us, decode.max_run_us);
+        }
+        std::unique_lock<std::mutex> protocol_lock(protocol_mutex_);
+        if (protocol_) {
+            auto control = protocol_->control_queue_stats();
+            auto audio = protocol_->audio_queue_stats();
+            ESP_LOGI(TAG, "Outbound control: sent %lu dropped %lu max wait %lu ms, audio: sent %lu dropped %lu max wait %lu ms",
+                control.sent, control.dropped, control.max_wait_ms, audio.sent, audio.dropped, audio.max_wait_ms);
+            auto link = protocol_->link_quality();
+            ESP_LOGI(TAG, "Link: level %d rtt %d ms var %d ms loss %.1f%% send %d ms, tx %lu B/s rx %lu B/s",
+                link.level, link.rtt_ms, link.rtt_var_ms, link.loss_rate * 100, link.send_time_ms,
+                link.tx_bytes_per_second, link.rx_bytes_per_second);
+        }
+        protocol_lock.unlock();
+        auto tls = TlsSessionCache::GetInstance().GetStats();
+        if (tls.full_count + tls.resumed_count + tls.failed_count > 0) {
+            ESP_LOGI(TAG, "TLS handshakes: full %lu avg %lu ms (session rejected %lu), resumed %lu avg %lu ms, failed %lu",
+                tls.full_count, tls.full_count ? tls.full_total_ms / tls.full_count : 0, tls.rejected_count,
+                tls.resumed_count, tls.resumed_count ? tls.resumed_total_ms / tls.resumed_count : 0, tls.failed_count);
+        }
 
         // 读取GPIO20电平
         int gpio20_level = gpio_get_level(GPIO_NUM_20);
@@ -729,7 +936,13 @@ void Application::MainEventLoop() {
             std::list<std::function<void()>> tasks = std::move(main_tasks_);
             lock.unlock();
             for (auto& task : tasks) {
+                auto start_time = esp_timer_get_time();
                 task();
+                // 记录单个任务占用主循环的最长时间
+                auto elapsed = esp_timer_get_time() - start_time;
+                if (elapsed > max_main_loop_stall_us_) {
+                    max_main_loop_stall_us_ = elapsed;
+                }
             }
         }
     }
@@ -768,18 +981,30 @@ void Application::OnAudioOutput() {
     }
 
     if (device_state_ == kDeviceStateListening) {
-        audio_decode_queue_.clear();
+        ClearAudioQueue();
         audio_decode_cv_.notify_all();
         return;
     }
 
     auto packet = std::move(audio_decode_queue_.front());
     audio_decode_queue_.pop_front();
+    audio_played_packets_++;
     lock.unlock();
     audio_decode_cv_.notify_all();
 
+    // 这一包开始播放时显示对应的字幕
+    auto captions = TakeCaptions(false);
+    if (!captions.empty()) {
+        Schedule([captions = std::move(captions)]() {
+            auto display = Board::GetInstance().GetDisplay();
+            for (auto& caption : captions) {
+                display->AppendCaption(caption.c_str());
+            }
+        });
+    }
+
     busy_decoding_audio_ = true;
-    background_task_->Schedule([this, codec, packet = std::move(packet)]() mutable {
+    background_task_->Schedule(decode_stream_, [this, codec, packet = std::move(packet)]() mutable {
         busy_decoding_audio_ = false;
         if (aborted_) {
             return;
@@ -881,7 +1106,12 @@ void Application::SetDeviceState(DeviceState state) {
 
     auto previous_state = device_state_;
     ESP_LOGI(TAG, "Device state changed from %s to %s", STATE_STRINGS[device_state_], STATE_STRINGS[state]);
+    TRACE_INSTANT(STATE_STRINGS[state], device_state_);
     device_state_ = state;
+    if (state == kDeviceStateIdle || state == kDeviceStateListening) {
+        // 播放被打断或结束，剩余的字幕不再等待
+        FlushCaptions();
+    }
 
     // 新增：对话结束后检测WebSocket连接状态
     if (state == kDeviceStateIdle && previous_state == kDeviceStateSpeaking) {
@@ -889,15 +1119,25 @@ void Application::SetDeviceState(DeviceState state) {
         ESP_LOGI(TAG, "对话结束，检测WebSocket连接状态...");
         if (protocol_ && !protocol_->IsAudioChannelOpened()) {
             ESP_LOGI(TAG, "对话结束后检测到WebSocket连接断开，立即重连...");
-            protocol_->OpenAudioChannel();
+            protocol_->OpenAudioChannelAsync(nullptr);
         } else if (protocol_ && protocol_->IsAudioChannelOpened()) {
             ESP_LOGI(TAG, "对话结束后WebSocket连接状态正常");
         }
     }
 
     clock_ticks_ = 0;
-    // The state is changed, wait for all background tasks to finish
-    background_task_->WaitForCompletion();
+    // 只等待会影响新状态的后台任务：下行解码总是等待，上行编码只在离开聆听状态时等待
+    // 等待的是切换时刻之前提交的任务，不会被持续产生的新任务拖长
+    auto wait_start_time = esp_timer_get_time();
+    auto encode_fence = background_task_->Fence(encode_stream_);
+    background_task_->WaitForStream(decode_stream_);
+    if (previous_state == kDeviceStateListening) {
+        background_task_->WaitForFence(encode_stream_, encode_fence);
+    }
+    auto wait_time = esp_timer_get_time() - wait_start_time;
+    if (wait_time > max_transition_wait_us_) {
+        max_transition_wait_us_ = wait_time;
+    }
 
     auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
@@ -957,10 +1197,41 @@ void Application::SetDeviceState(DeviceState state) {
     }
 }
 
+// 调用方需持有 mutex_
+void Application::QueueAudioPacket(AudioStreamPacket&& packet) {
+    audio_decode_queue_.emplace_back(std::move(packet));
+    audio_queued_packets_++;
+}
+
+// 被丢弃的音频也计入播放进度，避免之后的字幕一直等待
+// 调用方需持有 mutex_
+void Application::ClearAudioQueue() {
+    audio_played_packets_ += audio_decode_queue_.size();
+    audio_decode_queue_.clear();
+}
+
+// 取出对应音频已开始播放的字幕，all 为 true 时全部取出
+std::vector<std::string> Application::TakeCaptions(bool all) {
+    std::vector<std::string> captions;
+    std::lock_guard<std::mutex> lock(caption_mutex_);
+    while (!pending_captions_.empty() && (all || pending_captions_.front().position < audio_played_packets_)) {
+        captions.push_back(std::move(pending_captions_.front().text));
+        pending_captions_.pop_front();
+    }
+    return captions;
+}
+
+void Application::FlushCaptions() {
+    auto display = Board::GetInstance().GetDisplay();
+    for (auto& caption : TakeCaptions(true)) {
+        display->AppendCaption(caption.c_str());
+    }
+}
+
 void Application::ResetDecoder() {
     std::lock_guard<std::mutex> lock(mutex_);
     opus_decoder_->ResetState();
-    audio_decode_queue_.clear();
+    ClearAudioQueue();
     audio_decode_cv_.notify_all();
     last_output_time_ = std::chrono::steady_clock::now();
     
@@ -968,10 +1239,13 @@ void Application::ResetDecoder() {
     codec->EnableOutput(true);
 }
 
+// 在主循环中调用
 void Application::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
         return;
     }
+    // 已提交的解码任务仍在使用旧的解码器，只需等待解码任务完成
+    background_task_->WaitForStream(decode_stream_);
 
     opus_decoder_.reset();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
@@ -998,12 +1272,19 @@ void Application::Reboot() {
 
 void Application::WakeWordInvoke(const std::string& wake_word) {
     if (device_state_ == kDeviceStateIdle) {
-        ToggleChatState();
+        if (!protocol_) {
+            ESP_LOGE(TAG, "Protocol not initialized");
+            return;
+        }
         Schedule([this, wake_word]() {
-            if (protocol_) {
-                protocol_->SendWakeWordDetected(wake_word); 
-            }
-        }); 
+            OpenAudioChannel([this, wake_word](bool success) {
+                if (!success) {
+                    return;
+                }
+                protocol_->SendWakeWordDetected(wake_word);
+                SetListeningMode(realtime_chat_enabled_ ? kListeningModeRealtime : kListeningModeAutoStop);
+            });
+        });
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
@@ -9,6 +9,7 @@
 #include <string>
 #include <mutex>
 #include <list>
+#include <deque>
 #include <vector>
 #include <condition_variable>
 #include <memory>
@@ -20,6 +21,8 @@
 #include "protocol.h"
 #include "ota.h"
 #include "background_task.h"
+#include "async_task.h"
+#include "boot_sequencer.h"
 #include "audio_processor.h"
 
 #if CONFIG_USE_WAKE_WORD_DETECT
@@ -29,7 +32,6 @@
 #define SCHEDULE_EVENT (1 << 0)
 #define AUDIO_INPUT_READY_EVENT (1 << 1)
 #define AUDIO_OUTPUT_READY_EVENT (1 << 2)
-#define CHECK_NEW_VERSION_DONE_EVENT (1 << 3)
 
 enum DeviceState {
     kDeviceStateUnknown,
@@ -72,6 +74,8 @@ public:
     void WakeWordInvoke(const std::string& wake_word);
     void PlaySound(const std::string_view& sound);
     bool CanEnterSleepMode();
+    // 在定时器任务中由显示更新调用
+    LinkQuality GetLinkQuality();
 
 private:
     Application();
@@ -84,9 +88,15 @@ private:
     Ota ota_;
     std::mutex mutex_;
     std::list<std::function<void()>> main_tasks_;
+    // 只在主循环（及主循环开始前的启动阶段）中赋值，其它任务读取时需持有 protocol_mutex_
     std::unique_ptr<Protocol> protocol_;
+    std::mutex protocol_mutex_;
+    bool protocol_started_ = false;
+    BootSequencer boot_sequencer_;
     EventGroupHandle_t event_group_ = nullptr;
-    esp_timer_handle_t clock_timer_handle_ = nullptr;
+    int clock_timer_id_ = -1;
+    int heartbeat_timer_id_ = -1;
+    int connection_check_timer_id_ = -1;
     volatile DeviceState device_state_ = kDeviceStateUnknown;
     ListeningMode listening_mode_ = kListeningModeAutoStop;
 #if CONFIG_USE_DEVICE_AEC || CONFIG_USE_SERVER_AEC
@@ -98,15 +108,31 @@ private:
     bool voice_detected_ = false;
     bool busy_decoding_audio_ = false;
     int clock_ticks_ = 0;
+    std::atomic<int64_t> max_main_loop_stall_us_ = 0;
+    // 状态切换时等待后台任务阻塞主循环的最长时间
+    std::atomic<int64_t> max_transition_wait_us_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     // Audio encode / decode
     TaskHandle_t audio_loop_task_handle_ = nullptr;
     BackgroundTask* background_task_ = nullptr;
+    int encode_stream_ = -1;
+    int decode_stream_ = -1;
     std::chrono::steady_clock::time_point last_output_time_;
     std::atomic<uint32_t> last_output_timestamp_ = 0;
     std::list<AudioStreamPacket> audio_decode_queue_;
     std::condition_variable audio_decode_cv_;
+    // 播放进度以进入队列的音频包计数，用于字幕跟随播放
+    std::atomic<uint32_t> audio_queued_packets_ = 0;
+    std::atomic<uint32_t> audio_played_packets_ = 0;
+
+    // 等待播放到对应位置的字幕，position 为文字到达时已进入队列的音频包数量
+    struct PendingCaption {
+        uint32_t position;
+        std::string text;
+    };
+    std::mutex caption_mutex_;
+    std::deque<PendingCaption> pending_captions_;
 
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
@@ -120,11 +146,24 @@ private:
     void OnAudioOutput();
     void ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    void QueueAudioPacket(AudioStreamPacket&& packet);
+    void ClearAudioQueue();
+    std::vector<std::string> TakeCaptions(bool all);
+    void FlushCaptions();
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
-    void CheckNewVersion();
+    // 返回 false 表示重试次数过多，放弃连接服务器
+    // background 为 true 时已使用保存的配置进入待机，检查过程不改变设备状态，需要升级或激活时等待回到待机
+    Async<bool> CheckNewVersion(bool background);
+    Async<void> ConnectToServer(bool use_cached_config);
+    void InitializeProtocol();
+    void RestartProtocol();
+#if CONFIG_USE_WAKE_WORD_DETECT
+    Async<void> StartConversation(std::string wake_word);
+#endif
     void ShowActivationCode();
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
+    void OpenAudioChannel(std::function<void(bool success)> callback);
     void AudioLoop();
 };
 
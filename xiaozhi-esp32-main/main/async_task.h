@@ -0,0 +1,221 @@
+#ifndef ASYNC_TASK_H
+#define ASYNC_TASK_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "timer_service.h"
+
+/*
+ * 基于 C++20 协程的多步骤流程，全部在主循环中执行
+ * 等待（定时、阻塞调用、异步回调）时挂起协程并让出主循环，条件满足后再投递回主循环恢复，
+ * 因此协程内访问 Application 状态与其它主循环任务一样不需要加锁
+ */
+class AsyncRuntime {
+public:
+    static AsyncRuntime& GetInstance() {
+        static AsyncRuntime instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    AsyncRuntime(const AsyncRuntime&) = delete;
+    AsyncRuntime& operator=(const AsyncRuntime&) = delete;
+
+    // 主循环由 Application 提供
+    void SetMainLoopDispatcher(std::function<void(std::function<void()>)> dispatcher) { dispatcher_ = std::move(dispatcher); }
+    // 可在任意任务中调用，协程总是在主循环中恢复，不会在调用方的栈上继续执行
+    void Resume(std::coroutine_handle<> handle) {
+        dispatcher_([handle]() { handle.resume(); });
+    }
+
+private:
+    AsyncRuntime() = default;
+
+    std::function<void(std::function<void()>)> dispatcher_;
+};
+
+// 协程结束时恢复等待它的协程，没有等待者的 (Spawn 启动的) 协程自行释放
+// 协程内未捕获的异常在 co_await 处重新抛出给等待者
+struct AsyncPromiseBase {
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+    std::exception_ptr exception;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            auto& promise = handle.promise();
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            if (promise.detached) {
+                auto exception = promise.exception;
+                handle.destroy();
+                // 没有等待者时异常无处传递，与任务中未捕获的异常一样终止 (final_suspend 为 noexcept)
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    // 创建后不立即执行，被 co_await 或 Spawn 时才开始
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct AsyncPromise : AsyncPromiseBase {
+    T value{};
+    void return_value(T v) { value = std::move(v); }
+};
+
+template <>
+struct AsyncPromise<void> : AsyncPromiseBase {
+    void return_void() {}
+};
+
+template <typename T = void>
+class Async {
+public:
+    struct promise_type : AsyncPromise<T> {
+        Async get_return_object() { return Async(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    Async(Async&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Async(const Async&) = delete;
+    Async& operator=(const Async&) = delete;
+    ~Async() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+    T await_resume() {
+        if (handle_.promise().exception) {
+            std::rethrow_exception(handle_.promise().exception);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(handle_.promise().value);
+        }
+    }
+
+    // 在当前任务中开始执行，直到第一次挂起；之后由协程自己管理生命周期
+    friend void Spawn(Async<void> task);
+
+private:
+    explicit Async(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+inline void Spawn(Async<void> task) {
+    auto handle = std::exchange(task.handle_, nullptr);
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+// 挂起指定时间，由时间轮唤醒，slack 内可与其它定时器合并
+class Delay {
+public:
+    explicit Delay(uint32_t ms, uint32_t slack_ms = 0) : ms_(ms), slack_ms_(slack_ms) {}
+
+    bool await_ready() { return ms_ == 0; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        auto& timer_service = TimerService::GetInstance();
+        // 回调在主循环中执行，本对象位于挂起的协程帧中，恢复之前一直有效
+        timer_id_ = timer_service.Create("async_delay", kTimerDispatchMainLoop, [this, handle]() {
+            TimerService::GetInstance().Delete(timer_id_);
+            handle.resume();
+        });
+        timer_service.StartOnce(timer_id_, ms_, slack_ms_);
+    }
+    void await_resume() {}
+
+private:
+    uint32_t ms_;
+    uint32_t slack_ms_;
+    int timer_id_ = -1;
+};
+
+// 在独立任务中执行阻塞调用（HTTP 请求等），完成后回到主循环取得返回值
+template <typename F>
+class RunInTask {
+public:
+    using Result = std::invoke_result_t<F>;
+
+    RunInTask(const char* name, F callback, uint32_t stack_size = 4096 * 2)
+        : name_(name), callback_(std::move(callback)), stack_size_(stack_size) {}
+
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        auto ret = xTaskCreate([](void* arg) {
+            auto self = (RunInTask*)arg;
+            // 异常不能跨任务传播，带回主循环后在 co_await 处重新抛出
+            try {
+                self->result_ = self->callback_();
+            } catch (...) {
+                self->exception_ = std::current_exception();
+            }
+            AsyncRuntime::GetInstance().Resume(self->handle_);
+            vTaskDelete(NULL);
+        }, name_, stack_size_, this, 3, nullptr);
+        if (ret != pdPASS) {
+            // 无法创建任务时直接在主循环中执行
+            result_ = callback_();
+            return false;
+        }
+        return true;
+    }
+    Result await_resume() {
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+        return std::move(result_);
+    }
+
+private:
+    const char* name_;
+    F callback_;
+    uint32_t stack_size_;
+    Result result_{};
+    std::exception_ptr exception_;
+    std::coroutine_handle<> handle_;
+};
+
+// 将回调风格的异步接口转为可等待对象，start 收到的 done 可在任意任务中调用一次
+template <typename T>
+class WaitCallback {
+public:
+    explicit WaitCallback(std::function<void(std::function<void(T)>)> start) : start_(std::move(start)) {}
+
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        start_([this, handle](T result) {
+            result_ = std::move(result);
+            AsyncRuntime::GetInstance().Resume(handle);
+        });
+    }
+    T await_resume() { return std::move(result_); }
+
+private:
+    std::function<void(std::function<void(T)>)> start_;
+    T result_{};
+};
+
+#endif // ASYNC_TASK_H
@@ -1,21 +1,68 @@
 #include "background_task.h"
+#include "trace_recorder.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_task_wdt.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
 
 #define TAG "BackgroundTask"
 
-BackgroundTask::BackgroundTask(uint32_t stack_size) {
-    xTaskCreate([](void* arg) {
-        BackgroundTask* task = (BackgroundTask*)arg;
-        task->BackgroundTaskLoop();
-    }, "background_task", stack_size, this, 2, &background_task_handle_);
+struct WorkerArgs {
+    BackgroundTask* task;
+    int index;
+};
+
+BackgroundTask::BackgroundTask(uint32_t stack_size) : workers_(portNUM_PROCESSORS) {
+    for (int i = 0; i < (int)workers_.size(); i++) {
+        char name[20];
+        snprintf(name, sizeof(name), "background_task%d", i);
+        auto args = new WorkerArgs{this, i};
+        xTaskCreatePinnedToCore([](void* arg) {
+            auto args = (WorkerArgs*)arg;
+            auto task = args->task;
+            int index = args->index;
+            delete args;
+            task->WorkerLoop(index);
+        }, name, stack_size, args, 2, &workers_[i].handle, i);
+    }
 }
 
 BackgroundTask::~BackgroundTask() {
-    if (background_task_handle_ != nullptr) {
-        vTaskDelete(background_task_handle_);
+    for (auto& worker : workers_) {
+        if (worker.handle != nullptr) {
+            vTaskDelete(worker.handle);
+        }
+    }
+}
+
+int BackgroundTask::CreateStream(const char* name, int core, size_t capacity, BackgroundOverloadPolicy policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    streams_.emplace_back();
+    auto& stream = streams_.back();
+    for (auto& worker : workers_) {
+        // 环按顺序展开后扩容，保持已排队 stream 的先后顺序
+        std::vector<int> ready_streams(streams_.size());
+        for (size_t i = 0; i < worker.stream_count; i++) {
+            ready_streams[i] = worker.ready_streams[(worker.stream_head + i) % worker.ready_streams.size()];
+        }
+        worker.ready_streams.swap(ready_streams);
+        worker.stream_head = 0;
+    }
+    stream.name = name;
+    stream.core = core % workers_.size();
+    stream.policy = policy;
+    stream.slots.reset(new Slot[size]);
+    stream.mask = size - 1;
+    for (uint32_t i = 0; i < size; i++) {
+        stream.slots[i].sequence.store(i, std::memory_order_relaxed);
     }
+    return streams_.size() - 1;
 }
 
 void BackgroundTask::Schedule(std::function<void()> callback) {
@@ -27,37 +74,268 @@ void BackgroundTask::Schedule(std::function<void()> callback) {
         }
     }
     active_tasks_++;
-    main_tasks_.emplace_back([this, cb = std::move(callback)]() {
-        cb();
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            active_tasks_--;
-            if (main_tasks_.empty() && active_tasks_ == 0) {
-                condition_variable_.notify_all();
+    // 独立任务放到较空闲的工作任务上
+    Worker* target = &workers_[0];
+    for (auto& worker : workers_) {
+        if (worker.ready.size() + worker.stream_count + worker.busy < target->ready.size() + target->stream_count + target->busy) {
+            target = &worker;
+        }
+    }
+    Runnable runnable;
+    runnable.job.callback = std::move(callback);
+    runnable.job.enqueue_time_us = esp_timer_get_time();
+    target->ready.push_back(std::move(runnable));
+    work_cv_.notify_all();
+}
+
+bool BackgroundTask::TryDequeue(Stream& s, InlineTask& task, int64_t& enqueue_time_us) {
+    uint32_t pos = s.dequeue_pos.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &s.slots[pos & s.mask];
+        int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - (pos + 1));
+        if (diff == 0) {
+            if (s.dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
             }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = s.dequeue_pos.load(std::memory_order_relaxed);
         }
-    });
-    condition_variable_.notify_all();
+    }
+    slot->task.MoveTo(task);
+    enqueue_time_us = slot->enqueue_time_us;
+    slot->sequence.store(pos + s.mask + 1, std::memory_order_release);
+    return true;
+}
+
+// 只看队首槽位是否已写入完成，已占位但未写完的任务由提交方在 OnEnqueued 中负责调度
+bool BackgroundTask::IsEmpty(Stream& s) {
+    uint32_t pos = s.dequeue_pos.load(std::memory_order_relaxed);
+    return s.slots[pos & s.mask].sequence.load(std::memory_order_acquire) != pos + 1;
+}
+
+bool BackgroundTask::HasFreeSlot(Stream& s) {
+    uint32_t pos = s.enqueue_pos.load(std::memory_order_relaxed);
+    return (int32_t)(s.slots[pos & s.mask].sequence.load(std::memory_order_acquire) - pos) >= 0;
+}
+
+void BackgroundTask::BeginSubmit(Stream& s) {
+    // 先计数再入队，工作任务完成时 active_tasks_ 不会减到负数
+    active_tasks_++;
+}
+
+void BackgroundTask::OnEnqueued(Stream& s) {
+    // 与工作任务清除 scheduled 后重新检查队列配对，两边至少有一方会把 stream 放入就绪队列
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (s.scheduled.exchange(true)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    PushStream(&s - &streams_[0]);
+}
+
+void BackgroundTask::OnRejected(Stream& s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 被拒绝的任务没有占用序号，不影响 fence
+    s.stats.rejected++;
+    if (--active_tasks_ == 0) {
+        done_cv_.notify_all();
+    }
+}
+
+void BackgroundTask::DropOldest(Stream& s) {
+    InlineTask task;
+    int64_t enqueue_time_us;
+    if (!TryDequeue(s, task, enqueue_time_us)) {
+        // 队列已被工作任务取空，重新尝试入队
+        return;
+    }
+    task.Reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    s.stats.dropped++;
+    s.stats.max_depth = s.mask + 1;
+    UpdateDoneSeq(s);
+    done_cv_.notify_all();
+    if (--active_tasks_ == 0) {
+        done_cv_.notify_all();
+    }
+}
+
+void BackgroundTask::WaitForSlot(Stream& s) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // 工作任务取出任务后会通知，超时只是兜底
+    slot_cv_.wait_for(lock, std::chrono::milliseconds(10), [&s]() { return HasFreeSlot(s); });
 }
 
 void BackgroundTask::WaitForCompletion() {
     std::unique_lock<std::mutex> lock(mutex_);
-    condition_variable_.wait(lock, [this]() {
-        return main_tasks_.empty() && active_tasks_ == 0;
+    done_cv_.wait(lock, [this]() {
+        return active_tasks_ == 0;
     });
 }
 
-void BackgroundTask::BackgroundTaskLoop() {
-    ESP_LOGI(TAG, "background_task started");
+// 已占位但尚未写完的任务也计入，它一定在返回的序号之前
+uint32_t BackgroundTask::Fence(int stream) {
+    return streams_[stream].enqueue_pos.load(std::memory_order_acquire);
+}
+
+void BackgroundTask::WaitForFence(int stream, uint32_t fence) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& s = streams_[stream];
+    done_cv_.wait(lock, [&s, fence]() {
+        return (int32_t)(s.done_seq - fence) >= 0;
+    });
+}
+
+// 调用方需持有 mutex_
+// 没有任务在执行时，已出队的任务都已完成或被丢弃；否则保持不变，由执行完成时再推进
+void BackgroundTask::UpdateDoneSeq(Stream& s) {
+    if (!s.running) {
+        s.done_seq = s.dequeue_pos.load(std::memory_order_acquire);
+    }
+}
+
+BackgroundStreamStats BackgroundTask::GetStreamStats(int stream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = streams_[stream].stats;
+    streams_[stream].stats.max_depth = 0;
+    streams_[stream].stats.max_wait_us = 0;
+    streams_[stream].stats.max_run_us = 0;
+    return stats;
+}
+
+// 调用方需持有 mutex_
+void BackgroundTask::PushStream(int stream) {
+    auto& worker = workers_[streams_[stream].core];
+    worker.ready_streams[(worker.stream_head + worker.stream_count) % worker.ready_streams.size()] = stream;
+    worker.stream_count++;
+    work_cv_.notify_all();
+}
+
+// 调用方需持有 mutex_
+bool BackgroundTask::HasWork(int worker) {
+    if (workers_[worker].HasReady()) {
+        return true;
+    }
+    // 对方空闲时由它自己处理，保持核心亲和性
+    for (auto& other : workers_) {
+        if (other.busy && other.HasReady()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 调用方需持有 mutex_
+bool BackgroundTask::TakeRunnable(int worker, Runnable& runnable) {
+    // stream 承载实时音频，优先于独立任务
+    auto& own = workers_[worker];
+    if (own.stream_count > 0) {
+        runnable.stream = own.ready_streams[own.stream_head];
+        own.stream_head = (own.stream_head + 1) % own.ready_streams.size();
+        own.stream_count--;
+        return true;
+    }
+    if (!own.ready.empty()) {
+        runnable = std::move(own.ready.front());
+        own.ready.pop_front();
+        return true;
+    }
+    for (auto& other : workers_) {
+        if (!other.busy) {
+            continue;
+        }
+        if (other.stream_count > 0) {
+            other.stream_count--;
+            runnable.stream = other.ready_streams[(other.stream_head + other.stream_count) % other.ready_streams.size()];
+            return true;
+        }
+        if (!other.ready.empty()) {
+            runnable = std::move(other.ready.back());
+            other.ready.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void BackgroundTask::WorkerLoop(int worker) {
+    ESP_LOGI(TAG, "background_task%d started", worker);
+    InlineTask task;
+    std::unique_lock<std::mutex> lock(mutex_);
     while (true) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        condition_variable_.wait(lock, [this]() { return !main_tasks_.empty(); });
-        
-        std::list<std::function<void()>> tasks = std::move(main_tasks_);
+        work_cv_.wait(lock, [this, worker]() { return HasWork(worker); });
+
+        Runnable runnable;
+        if (!TakeRunnable(worker, runnable)) {
+            continue;
+        }
+        Stream* stream = nullptr;
+        if (runnable.stream >= 0) {
+            stream = &streams_[runnable.stream];
+            // 只有持有 scheduled 的工作任务会走到这里，队首任务此时一定已写入完成
+            uint32_t depth = stream->enqueue_pos.load(std::memory_order_relaxed) - stream->dequeue_pos.load(std::memory_order_relaxed);
+            stream->stats.max_depth = std::max(stream->stats.max_depth, depth);
+            if (!TryDequeue(*stream, task, runnable.job.enqueue_time_us)) {
+                // 队首任务已被 DropOldest 丢弃
+                stream->scheduled = false;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!IsEmpty(*stream) && !stream->scheduled.exchange(true)) {
+                    PushStream(runnable.stream);
+                }
+                continue;
+            }
+            // 与出队在同一次持锁中标记，DropOldest 不会越过正在执行的任务推进 done_seq
+            stream->running = true;
+            if (stream->policy == kOverloadBlock) {
+                slot_cv_.notify_all();
+            }
+        }
+        workers_[worker].busy = true;
+        if (workers_[worker].HasReady()) {
+            // 本任务开始忙碌，唤醒其它空闲工作任务窃取剩余任务
+            work_cv_.notify_all();
+        }
         lock.unlock();
 
-        for (auto& task : tasks) {
-            task();
+        auto start_time = esp_timer_get_time();
+        if (stream != nullptr) {
+            task.Invoke();
+        } else {
+            runnable.job.callback();
+        }
+        auto end_time = esp_timer_get_time();
+        TRACE_COMPLETE(stream != nullptr ? stream->name : "background_job", start_time, end_time);
+        // 尽早释放回调捕获的数据
+        task.Reset();
+        runnable.job.callback = nullptr;
+
+        lock.lock();
+        workers_[worker].busy = false;
+        if (stream != nullptr) {
+            stream->running = false;
+            UpdateDoneSeq(*stream);
+            done_cv_.notify_all();
+            auto& stats = stream->stats;
+            stats.completed++;
+            stats.max_wait_us = std::max<uint32_t>(stats.max_wait_us, start_time - runnable.job.enqueue_time_us);
+            stats.max_run_us = std::max<uint32_t>(stats.max_run_us, end_time - start_time);
+            // 还有任务时重新排到首选核心，保证同一 stream 不会并发执行
+            // 否则清除 scheduled 后再检查一次，避免与正在入队的提交方互相错过
+            bool requeue = !IsEmpty(*stream);
+            if (!requeue) {
+                stream->scheduled = false;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                requeue = !IsEmpty(*stream) && !stream->scheduled.exchange(true);
+            }
+            if (requeue) {
+                PushStream(runnable.stream);
+            }
+        }
+        if (--active_tasks_ == 0) {
+            done_cv_.notify_all();
         }
     }
 }
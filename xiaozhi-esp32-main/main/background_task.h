@@ -3,27 +3,223 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <esp_timer.h>
 #include <mutex>
 #include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
 #include <condition_variable>
 #include <atomic>
+#include <new>
+#include <cstddef>
+#include <type_traits>
 
+// 任务槽内联存储的大小，回调捕获的数据超过该大小时编译失败
+#define BACKGROUND_TASK_INLINE_SIZE 48
+
+// stream 队列满时的处理方式，由提交方在创建 stream 时指定
+enum BackgroundOverloadPolicy {
+    kOverloadBlock,         // 等待有空闲槽位
+    kOverloadDropOldest,    // 丢弃最早的未执行任务（适合实时音频，保证延迟有上限）
+    kOverloadReject,        // 拒绝新任务，Schedule 返回 false
+};
+
+struct BackgroundStreamStats {
+    uint32_t completed = 0;
+    uint32_t dropped = 0;
+    uint32_t rejected = 0;
+    uint32_t max_depth = 0;     // 队列中最多同时等待的任务数
+    uint32_t max_wait_us = 0;   // 从提交到开始执行的最长等待
+    uint32_t max_run_us = 0;
+};
+
+/*
+ * 小型可调用对象的定长存储，捕获的数据直接放在任务槽内，不像 std::function 那样另行分配内存
+ */
+class InlineTask {
+public:
+    InlineTask() = default;
+    ~InlineTask() { Reset(); }
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+
+    template <typename F>
+    void Emplace(F&& callback) {
+        using T = std::decay_t<F>;
+        static_assert(sizeof(T) <= BACKGROUND_TASK_INLINE_SIZE, "Callback is too large for a background task slot");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Callback alignment is not supported");
+        new (storage_) T(std::forward<F>(callback));
+        invoke_ = [](void* p) { (*(T*)p)(); };
+        destroy_ = [](void* p) { ((T*)p)->~T(); };
+        relocate_ = [](void* from, void* to) {
+            new (to) T(std::move(*(T*)from));
+            ((T*)from)->~T();
+        };
+    }
+    // 移到 other 中，本对象变为空
+    void MoveTo(InlineTask& other) {
+        other.Reset();
+        if (relocate_ != nullptr) {
+            relocate_(storage_, other.storage_);
+            other.invoke_ = invoke_;
+            other.destroy_ = destroy_;
+            other.relocate_ = relocate_;
+            invoke_ = nullptr;
+            destroy_ = nullptr;
+            relocate_ = nullptr;
+        }
+    }
+    void Invoke() { invoke_(storage_); }
+    void Reset() {
+        if (destroy_ != nullptr) {
+            destroy_(storage_);
+            destroy_ = nullptr;
+            invoke_ = nullptr;
+            relocate_ = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) uint8_t storage_[BACKGROUND_TASK_INLINE_SIZE];
+    void (*invoke_)(void*) = nullptr;
+    void (*destroy_)(void*) = nullptr;
+    void (*relocate_)(void*, void*) = nullptr;
+};
+
+/*
+ * 后台任务执行器，每个 CPU 核心一个工作任务，各自维护就绪队列
+ * 自己的队列为空且其它工作任务正忙时，从对方队列尾部窃取任务
+ * 同一个 stream 的任务严格按提交顺序串行执行（编码器、解码器状态不可并发访问），
+ * 优先在创建 stream 时指定的核心上运行
+ * 每个 stream 使用固定数量的任务槽（无锁有界队列），提交任务不分配内存，
+ * 只有 stream 从空闲变为待执行时才需要加锁
+ */
 class BackgroundTask {
 public:
     BackgroundTask(uint32_t stack_size = 4096 * 2);
     ~BackgroundTask();
 
+    // 需在提交任务之前创建，capacity 向上取整为 2 的幂
+    int CreateStream(const char* name, int core, size_t capacity, BackgroundOverloadPolicy policy);
+    // 不属于任何 stream 的任务，可在任意工作任务上执行
     void Schedule(std::function<void()> callback);
+    // 按 stream 的过载策略提交，任务被拒绝时返回 false
+    template <typename F>
+    bool Schedule(int stream, F&& callback) {
+        auto& s = streams_[stream];
+        BeginSubmit(s);
+        while (!TryEnqueue(s, std::forward<F>(callback))) {
+            if (s.policy == kOverloadReject) {
+                OnRejected(s);
+                return false;
+            } else if (s.policy == kOverloadDropOldest) {
+                DropOldest(s);
+            } else {
+                WaitForSlot(s);
+            }
+        }
+        OnEnqueued(s);
+        return true;
+    }
     void WaitForCompletion();
+    // 返回 stream 当前已入队的任务序号，WaitForFence 只等待该序号之前的任务执行完成或被丢弃，不受之后新任务影响
+    uint32_t Fence(int stream);
+    void WaitForFence(int stream, uint32_t fence);
+    void WaitForStream(int stream) { WaitForFence(stream, Fence(stream)); }
+    // 返回统计并清零最大值
+    BackgroundStreamStats GetStreamStats(int stream);
 
 private:
+    struct Job {
+        std::function<void()> callback;
+        int64_t enqueue_time_us = 0;
+    };
+    struct Slot {
+        std::atomic<uint32_t> sequence{0};
+        int64_t enqueue_time_us = 0;
+        InlineTask task;
+    };
+    struct Stream {
+        const char* name = nullptr;
+        int core = 0;
+        BackgroundOverloadPolicy policy = kOverloadBlock;
+        std::unique_ptr<Slot[]> slots;
+        uint32_t mask = 0;
+        std::atomic<uint32_t> enqueue_pos{0};
+        std::atomic<uint32_t> dequeue_pos{0};
+        std::atomic<bool> scheduled{false};     // 已在某个就绪队列中或正在执行
+        // 以下由 mutex_ 保护；序号即入队位置，done_seq 之前的任务均已执行完成或被丢弃
+        // 正在执行的任务之后的任务可能先被丢弃，此时 done_seq 停在正在执行的任务上
+        bool running = false;
+        uint32_t done_seq = 0;
+        BackgroundStreamStats stats;
+    };
+    // stream 小于 0 表示独立任务，否则表示轮到该 stream 执行其队首任务，不携带回调
+    struct Runnable {
+        int stream = -1;
+        Job job;
+    };
+    struct Worker {
+        TaskHandle_t handle = nullptr;
+        std::deque<Runnable> ready;
+        // 待执行的 stream，每个 stream 同时最多在一个环中出现一次，容量等于 stream 数量即可，入队不分配内存
+        std::vector<int> ready_streams;
+        size_t stream_head = 0;
+        size_t stream_count = 0;
+        bool busy = false;
+
+        bool HasReady() const { return !ready.empty() || stream_count > 0; }
+    };
+
     std::mutex mutex_;
-    std::list<std::function<void()>> main_tasks_;
-    std::condition_variable condition_variable_;
-    TaskHandle_t background_task_handle_ = nullptr;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::condition_variable slot_cv_;
+    std::vector<Worker> workers_;
+    std::deque<Stream> streams_;   // deque 扩容时不移动已有元素
     std::atomic<size_t> active_tasks_{0};
 
-    void BackgroundTaskLoop();
+    // 有界 MPMC 队列 (Vyukov)，槽位的 sequence 表示其当前可写入或可读取的位置
+    // 入队成功时才会移走 callback
+    template <typename F>
+    static bool TryEnqueue(Stream& s, F&& callback) {
+        uint32_t pos = s.enqueue_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &s.slots[pos & s.mask];
+            int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (s.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = s.enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->task.Emplace(std::forward<F>(callback));
+        slot->enqueue_time_us = esp_timer_get_time();
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    // 取出队首任务移到 task 中并立即归还槽位
+    static bool TryDequeue(Stream& s, InlineTask& task, int64_t& enqueue_time_us);
+    static void UpdateDoneSeq(Stream& s);
+    static bool IsEmpty(Stream& s);
+    static bool HasFreeSlot(Stream& s);
+
+    void BeginSubmit(Stream& s);
+    void OnEnqueued(Stream& s);
+    void OnRejected(Stream& s);
+    void DropOldest(Stream& s);
+    void WaitForSlot(Stream& s);
+    void PushStream(int stream);
+    bool HasWork(int worker);
+    bool TakeRunnable(int worker, Runnable& runnable);
+    void WorkerLoop(int worker);
 };
 
 #endif
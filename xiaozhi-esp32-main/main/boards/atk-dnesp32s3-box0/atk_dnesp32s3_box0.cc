@@ -106,7 +106,7 @@ private:
                         }
 
                         if (self->power_manager_->low_voltage_ < 2877 && self->power_status_ != kDeviceTypecSupply) {
-                            esp_timer_stop(self->power_manager_->timer_handle_);
+                            TimerService::GetInstance().Stop(self->power_manager_->timer_id_);
                             gpio_set_level(CHG_CTRL_PIN, 0);
                             vTaskDelay(pdMS_TO_TICKS(100));
                             gpio_set_level(SYS_POW_PIN, 0);     
@@ -158,7 +158,7 @@ private:
         });
         power_save_timer_->OnShutdownRequest([this]() {
             if (power_status_ == kDeviceBatterySupply) {
-                esp_timer_stop(power_manager_->timer_handle_);
+                TimerService::GetInstance().Stop(power_manager_->timer_id_);
                 gpio_set_level(CHG_CTRL_PIN, 0);
                 vTaskDelay(pdMS_TO_TICKS(100));
                 gpio_set_level(SYS_POW_PIN, 0);
@@ -220,7 +220,7 @@ private:
             }
 
             if (XiaozhiStatus_ == kDevice_Distributionnetwork || XiaozhiStatus_ == kDevice_Exit_Sleep) {
-                esp_timer_stop(power_manager_->timer_handle_);
+                TimerService::GetInstance().Stop(power_manager_->timer_id_);
                 gpio_set_level(CHG_CTRL_PIN, 0);
                 vTaskDelay(pdMS_TO_TICKS(100));
                 gpio_set_level(SYS_POW_PIN, 0);
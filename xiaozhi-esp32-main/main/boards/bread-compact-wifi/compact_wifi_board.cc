@@ -10,6 +10,7 @@
 #include "assets/lang_config.h"
 #include "dht11.h"
 #include "system_info.h"
+#include "timer_service.h"
 
 #include <wifi_station.h>
 #include <esp_log.h>
@@ -41,7 +42,7 @@ private:
     
     // DHT11传感器相关
     DHT11* dht11_sensor_;
-    esp_timer_handle_t dht11_timer_;
+    int dht11_timer_ = -1;
     float temperature_threshold_ = 29.0f;  // 温度阈值，默认30°C
     float humidity_threshold_ = 88.0f;     // 湿度阈值，默认70%
     bool temperature_trigger_enabled_ = true;
@@ -202,20 +203,12 @@ private:
         // 创建DHT11传感器实例，使用config.h中定义的GPIO引脚
         dht11_sensor_ = new DHT11(DHT11_GPIO_PIN);
         
-        // 创建定时器，每5秒读取一次DHT11数据
-        esp_timer_create_args_t timer_args = {
-            .callback = [](void* arg) {
-                CompactWifiBoard* board = static_cast<CompactWifiBoard*>(arg);
-                board->ReadDht11Data();
-            },
-            .arg = this,
-            .dispatch_method = ESP_TIMER_TASK,
-            .name = "dht11_timer",
-            .skip_unhandled_events = true,
-        };
-        
-        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &dht11_timer_));
-        ESP_ERROR_CHECK(esp_timer_start_periodic(dht11_timer_, 1000000)); // 1秒
+        // 创建定时器，每秒读取一次DHT11数据，温湿度变化缓慢，允许合并到其它定时器的唤醒上
+        auto& timer_service = TimerService::GetInstance();
+        dht11_timer_ = timer_service.Create("dht11_timer", kTimerDispatchTimerTask, [this]() {
+            ReadDht11Data();
+        });
+        timer_service.StartPeriodic(dht11_timer_, 1000, 1000); // 1秒
         
         ESP_LOGI(TAG, "DHT11传感器初始化完成，使用GPIO %d", DHT11_GPIO_PIN);
     }
@@ -339,9 +332,8 @@ public:
     }
     
     ~CompactWifiBoard() {
-        if (dht11_timer_) {
-            esp_timer_stop(dht11_timer_);
-            esp_timer_delete(dht11_timer_);
+        if (dht11_timer_ >= 0) {
+            TimerService::GetInstance().Delete(dht11_timer_);
         }
         if (dht11_sensor_) {
             delete dht11_sensor_;
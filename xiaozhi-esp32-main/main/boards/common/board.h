@@ -42,6 +42,8 @@ public:
     virtual WebSocket* CreateWebSocket() = 0;
     virtual Mqtt* CreateMqtt() = 0;
     virtual Udp* CreateUdp() = 0;
+    // 预先完成一次 TLS 握手并缓存会话，默认不做任何事
+    virtual void WarmUpConnection() {}
     virtual void StartNetwork() = 0;
     virtual const char* GetNetworkStateIcon() = 0;
     virtual bool GetBatteryLevel(int &level, bool& charging, bool& discharging);
@@ -0,0 +1,175 @@
+#include "dns_cache.h"
+#include "settings.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#include <sstream>
+
+#define TAG "DnsCache"
+
+#define DNS_CACHE_TTL_SECONDS 300
+#define DNS_CACHE_NEGATIVE_TTL_SECONDS 10
+// 过期超过该时间的结果不再使用
+#define DNS_CACHE_MAX_STALE_SECONDS (24 * 3600)
+#define DNS_CACHE_MAX_PERSISTED 8
+
+DnsCache::DnsCache() {
+    LoadFromSettings();
+}
+
+std::string DnsCache::Resolve(const std::string& host) {
+    struct in_addr addr;
+    if (inet_aton(host.c_str(), &addr)) {
+        return host;
+    }
+
+    auto now = esp_timer_get_time();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(host);
+        if (it != entries_.end()) {
+            auto& entry = it->second;
+            if (entry.revalidate) {
+                if (entry.loaded) {
+                    entry.loaded = false;
+                    RefreshAsync(host);
+                    return entry.address;
+                }
+                // 最近一次重新解析失败
+                if (now < entry.expire_time_us) {
+                    return "";
+                }
+            } else {
+                if (now < entry.expire_time_us) {
+                    return entry.address;
+                }
+                if (!entry.address.empty() && now < entry.expire_time_us + DNS_CACHE_MAX_STALE_SECONDS * 1000000LL) {
+                    auto address = entry.address;
+                    RefreshAsync(host);
+                    return address;
+                }
+            }
+        }
+    }
+
+    auto start_time = esp_timer_get_time();
+    auto address = Lookup(host);
+    ESP_LOGI(TAG, "Resolved %s -> %s in %lld ms", host.c_str(), address.empty() ? "(failed)" : address.c_str(),
+        (esp_timer_get_time() - start_time) / 1000);
+    Update(host, address);
+    return address;
+}
+
+// 只标记为待验证，不改动 NVS，重新解析成功后才会覆盖保存的地址
+void DnsCache::Invalidate(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(host);
+    if (it == entries_.end()) {
+        return;
+    }
+    it->second.revalidate = true;
+    it->second.loaded = false;
+    it->second.expire_time_us = 0;
+}
+
+std::string DnsCache::Lookup(const std::string& host) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    int ret = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if (ret != 0 || result == nullptr) {
+        ESP_LOGW(TAG, "Failed to resolve %s: %d", host.c_str(), ret);
+        return "";
+    }
+    char address[INET_ADDRSTRLEN];
+    auto sin = (struct sockaddr_in*)result->ai_addr;
+    inet_ntop(AF_INET, &sin->sin_addr, address, sizeof(address));
+    freeaddrinfo(result);
+    return address;
+}
+
+void DnsCache::Update(const std::string& host, const std::string& address) {
+    auto now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = entries_[host];
+    if (address.empty()) {
+        // 待验证的地址不再使用，但保留在 NVS 中，直到重新解析成功
+        if (entry.revalidate && !entry.address.empty()) {
+            entry.loaded = false;
+            entry.expire_time_us = now + DNS_CACHE_NEGATIVE_TTL_SECONDS * 1000000LL;
+            return;
+        }
+        // 解析失败时保留旧地址，过期后仍可作为后备使用
+        if (!entry.address.empty() && now < entry.expire_time_us + DNS_CACHE_MAX_STALE_SECONDS * 1000000LL) {
+            return;
+        }
+        entry.address.clear();
+        entry.expire_time_us = now + DNS_CACHE_NEGATIVE_TTL_SECONDS * 1000000LL;
+        return;
+    }
+    bool changed = entry.address != address;
+    entry.address = address;
+    entry.expire_time_us = now + DNS_CACHE_TTL_SECONDS * 1000000LL;
+    entry.revalidate = false;
+    entry.loaded = false;
+    if (changed) {
+        SaveToSettings();
+    }
+}
+
+// 调用方需持有 mutex_
+void DnsCache::RefreshAsync(const std::string& host) {
+    if (!refreshing_.insert(host).second) {
+        return;
+    }
+    auto arg = new std::string(host);
+    xTaskCreate([](void* arg) {
+        auto host = (std::string*)arg;
+        auto& cache = DnsCache::GetInstance();
+        cache.Update(*host, Lookup(*host));
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex_);
+            cache.refreshing_.erase(*host);
+        }
+        delete host;
+        vTaskDelete(NULL);
+    }, "dns_refresh", 4096, arg, 2, nullptr);
+}
+
+// 每行一条 "host address"，载入的结果只直接使用一次，同时在后台重新解析
+void DnsCache::LoadFromSettings() {
+    Settings settings("dns", false);
+    std::istringstream stream(settings.GetString("hosts"));
+    std::string host, address;
+    while (stream >> host >> address) {
+        auto& entry = entries_[host];
+        entry.address = address;
+        entry.revalidate = true;
+        entry.loaded = true;
+    }
+    if (!entries_.empty()) {
+        ESP_LOGI(TAG, "Loaded %u cached hosts", entries_.size());
+    }
+}
+
+// 调用方需持有 mutex_
+void DnsCache::SaveToSettings() {
+    std::string hosts;
+    int count = 0;
+    for (auto& [host, entry] : entries_) {
+        if (entry.address.empty()) {
+            continue;
+        }
+        hosts += host + " " + entry.address + "\n";
+        if (++count >= DNS_CACHE_MAX_PERSISTED) {
+            break;
+        }
+    }
+    Settings settings("dns", true);
+    settings.SetString("hosts", hosts);
+}
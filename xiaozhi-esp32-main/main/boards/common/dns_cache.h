@@ -0,0 +1,58 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+/*
+ * 域名解析缓存，减少每次连接服务器时的 DNS 查询
+ * - 成功和失败的结果都会缓存，失败结果的有效期较短
+ * - 过期但未超过最长保留时间的结果会先直接返回，同时在后台重新解析
+ * - 最近成功的结果保存到 NVS，开机后第一次连接不必等待 DNS；保存的地址不知道已过去多久，
+ *   只直接使用一次并在后台重新解析，之后必须重新解析成功才继续使用
+ * - 连接失败的地址标记为待验证，NVS 中的地址保留到重新解析成功为止
+ * getaddrinfo 不返回记录的 TTL，因此使用固定的有效期
+ */
+class DnsCache {
+public:
+    static DnsCache& GetInstance() {
+        static DnsCache instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    // 返回 IPv4 地址字符串，解析失败返回空字符串；host 本身是 IP 时原样返回
+    std::string Resolve(const std::string& host);
+    // 用缓存的地址连接失败时调用，下次连接前重新解析
+    void Invalidate(const std::string& host);
+
+private:
+    DnsCache();
+    ~DnsCache() = default;
+
+    struct Entry {
+        std::string address;    // 空表示解析失败
+        int64_t expire_time_us = 0;
+        // 地址来自 NVS 或连接失败过，重新解析成功之前不作为有效结果
+        bool revalidate = false;
+        // 从 NVS 载入后尚未使用，第一次使用时不等待解析
+        bool loaded = false;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    std::set<std::string> refreshing_;
+
+    static std::string Lookup(const std::string& host);
+    void Update(const std::string& host, const std::string& address);
+    void RefreshAsync(const std::string& host);
+    void LoadFromSettings();
+    void SaveToSettings();
+};
+
+#endif // DNS_CACHE_H
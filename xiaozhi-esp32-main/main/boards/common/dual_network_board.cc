@@ -80,6 +80,10 @@ WebSocket* DualNetworkBoard::CreateWebSocket() {
     return current_board_->CreateWebSocket();
 }
 
+void DualNetworkBoard::WarmUpConnection() {
+    current_board_->WarmUpConnection();
+}
+
 Mqtt* DualNetworkBoard::CreateMqtt() {
     return current_board_->CreateMqtt();
 }
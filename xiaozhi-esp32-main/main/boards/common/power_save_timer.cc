@@ -1,5 +1,6 @@
 #include "power_save_timer.h"
 #include "application.h"
+#include "timer_service.h"
 
 #include <esp_log.h>
 
@@ -8,32 +9,24 @@
 
 PowerSaveTimer::PowerSaveTimer(int cpu_max_freq, int seconds_to_sleep, int seconds_to_shutdown)
     : cpu_max_freq_(cpu_max_freq), seconds_to_sleep_(seconds_to_sleep), seconds_to_shutdown_(seconds_to_shutdown) {
-    esp_timer_create_args_t timer_args = {
-        .callback = [](void* arg) {
-            auto self = static_cast<PowerSaveTimer*>(arg);
-            self->PowerSaveCheck();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "power_save_timer",
-        .skip_unhandled_events = true,
-    };
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &power_save_timer_));
+    power_save_timer_ = TimerService::GetInstance().Create("power_save_timer", kTimerDispatchTimerTask, [this]() {
+        PowerSaveCheck();
+    });
 }
 
 PowerSaveTimer::~PowerSaveTimer() {
-    esp_timer_stop(power_save_timer_);
-    esp_timer_delete(power_save_timer_);
+    TimerService::GetInstance().Delete(power_save_timer_);
 }
 
 void PowerSaveTimer::SetEnabled(bool enabled) {
     if (enabled && !enabled_) {
         ticks_ = 0;
         enabled_ = enabled;
-        ESP_ERROR_CHECK(esp_timer_start_periodic(power_save_timer_, 1000000));
+        // 按秒计数，可以合并到其它定时器的唤醒上
+        TimerService::GetInstance().StartPeriodic(power_save_timer_, 1000, 1000);
         ESP_LOGI(TAG, "Power save timer enabled");
     } else if (!enabled && enabled_) {
-        ESP_ERROR_CHECK(esp_timer_stop(power_save_timer_));
+        TimerService::GetInstance().Stop(power_save_timer_);
         enabled_ = enabled;
         WakeUp();
         ESP_LOGI(TAG, "Power save timer disabled");
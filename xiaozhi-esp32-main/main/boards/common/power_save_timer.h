@@ -2,7 +2,6 @@
 
 #include <functional>
 
-#include <esp_timer.h>
 #include <esp_pm.h>
 
 class PowerSaveTimer {
@@ -19,7 +18,7 @@ public:
 private:
     void PowerSaveCheck();
 
-    esp_timer_handle_t power_save_timer_ = nullptr;
+    int power_save_timer_ = -1;
     bool enabled_ = false;
     bool in_sleep_mode_ = false;
     int ticks_ = 0;
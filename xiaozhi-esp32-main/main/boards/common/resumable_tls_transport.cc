@@ -0,0 +1,141 @@
+#include "resumable_tls_transport.h"
+#include "tls_session_cache.h"
+#include "dns_cache.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_crt_bundle.h>
+#include <mbedtls/ssl.h>
+#include <cstring>
+
+#define TAG "ResumableTls"
+
+#define TLS_CONNECT_TIMEOUT_MS 10000
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+// 服务器接受复用时 (Session ID 或 Session Ticket) 沿用原会话的主密钥，完整握手则生成新的主密钥
+// 携带会话不代表复用成功，服务器可以忽略它并完整握手
+static bool IsResumedSession(const esp_tls_client_session_t* offered, const esp_tls_client_session_t* negotiated) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    const auto& a = offered->saved_session;
+    const auto& b = negotiated->saved_session;
+    return memcmp(a.MBEDTLS_PRIVATE(master), b.MBEDTLS_PRIVATE(master), sizeof(a.MBEDTLS_PRIVATE(master))) == 0;
+#else
+    // TLS 1.3 的会话不保存主密钥，无法区分，按完整握手统计
+    return false;
+#endif
+}
+#endif
+
+ResumableTlsTransport::ResumableTlsTransport() {
+}
+
+ResumableTlsTransport::~ResumableTlsTransport() {
+    Disconnect();
+}
+
+bool ResumableTlsTransport::Connect(const char* host, int port) {
+    Disconnect();
+    tls_ = esp_tls_init();
+    if (tls_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create esp_tls");
+        return false;
+    }
+
+    // 连接解析好的地址，证书校验和 SNI 仍使用域名
+    auto& dns_cache = DnsCache::GetInstance();
+    auto address = dns_cache.Resolve(host);
+    if (address.empty()) {
+        ESP_LOGE(TAG, "Failed to resolve %s", host);
+        esp_tls_conn_destroy(tls_);
+        tls_ = nullptr;
+        return false;
+    }
+
+    auto& cache = TlsSessionCache::GetInstance();
+    // 持有会话的引用，握手期间即使缓存被其它连接替换也不会被释放
+    auto session = cache.Get(host, port);
+
+    esp_tls_cfg_t cfg = {};
+    cfg.crt_bundle_attach = esp_crt_bundle_attach;
+    cfg.timeout_ms = TLS_CONNECT_TIMEOUT_MS;
+    cfg.common_name = host;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = session.get();
+#endif
+
+    auto start_time = esp_timer_get_time();
+    int ret = esp_tls_conn_new_sync(address.c_str(), address.size(), port, &cfg, tls_);
+    auto duration = esp_timer_get_time() - start_time;
+    bool resumed = false;
+    TlsSession new_session;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (ret == 1) {
+        auto client_session = esp_tls_get_client_session(tls_);
+        if (client_session != nullptr) {
+            new_session = TlsSession(client_session, esp_tls_free_client_session);
+            resumed = session != nullptr && IsResumedSession(session.get(), client_session);
+        }
+    }
+#endif
+    cache.RecordHandshake(session != nullptr, resumed, ret == 1, duration);
+    if (ret != 1) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%d (%s), ret=%d", host, port, address.c_str(), ret);
+        // 会话可能已被服务器拒绝，缓存的地址也可能已失效，下次重新握手和解析
+        cache.Remove(host, port);
+        dns_cache.Invalidate(host);
+        esp_tls_conn_destroy(tls_);
+        tls_ = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "Connected to %s:%d in %lld ms (%s)", host, port, duration / 1000,
+        resumed ? "resumed" : (session != nullptr ? "full handshake, cached session rejected" : "full handshake"));
+
+    cache.Put(host, port, new_session);
+    connected_ = true;
+    return true;
+}
+
+void ResumableTlsTransport::Disconnect() {
+    connected_ = false;
+    if (tls_ != nullptr) {
+        esp_tls_conn_destroy(tls_);
+        tls_ = nullptr;
+    }
+}
+
+int ResumableTlsTransport::Send(const char* data, size_t length) {
+    if (tls_ == nullptr) {
+        return -1;
+    }
+    size_t total_sent = 0;
+    while (total_sent < length) {
+        int ret = esp_tls_conn_write(tls_, data + total_sent, length - total_sent);
+        if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "esp_tls_conn_write failed: %d", ret);
+            connected_ = false;
+            return ret;
+        }
+        total_sent += ret;
+    }
+    return total_sent;
+}
+
+int ResumableTlsTransport::Receive(char* buffer, size_t bufferSize) {
+    if (tls_ == nullptr) {
+        return -1;
+    }
+    while (true) {
+        int ret = esp_tls_conn_read(tls_, buffer, bufferSize);
+        if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret <= 0) {
+            connected_ = false;
+        }
+        return ret;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef RESUMABLE_TLS_TRANSPORT_H
+#define RESUMABLE_TLS_TRANSPORT_H
+
+#include <transport.h>
+#include <esp_tls.h>
+
+/*
+ * 基于 esp_tls 的 TLS 传输层，连接时复用 TlsSessionCache 中的会话
+ * 需要开启 CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS，否则每次都是完整握手
+ */
+class ResumableTlsTransport : public Transport {
+public:
+    ResumableTlsTransport();
+    ~ResumableTlsTransport();
+
+    bool Connect(const char* host, int port) override;
+    void Disconnect() override;
+    int Send(const char* data, size_t length) override;
+    int Receive(char* buffer, size_t bufferSize) override;
+
+private:
+    esp_tls_t* tls_ = nullptr;
+};
+
+#endif // RESUMABLE_TLS_TRANSPORT_H
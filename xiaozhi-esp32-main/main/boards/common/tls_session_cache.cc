@@ -0,0 +1,96 @@
+#include "tls_session_cache.h"
+#include "resumable_tls_transport.h"
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define TAG "TlsSessionCache"
+
+static std::string MakeKey(const std::string& host, int port) {
+    return host + ":" + std::to_string(port);
+}
+
+TlsSession TlsSessionCache::Get(const std::string& host, int port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(MakeKey(host, port));
+    if (it == sessions_.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void TlsSessionCache::Put(const std::string& host, int port, TlsSession session) {
+    if (session == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_[MakeKey(host, port)] = session;
+}
+
+void TlsSessionCache::Remove(const std::string& host, int port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.erase(MakeKey(host, port));
+}
+
+void TlsSessionCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.clear();
+}
+
+void TlsSessionCache::RecordHandshake(bool offered, bool resumed, bool success, int64_t duration_us) {
+    uint32_t duration_ms = duration_us / 1000;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!success) {
+        stats_.failed_count++;
+        return;
+    }
+    stats_.last_ms = duration_ms;
+    if (resumed) {
+        stats_.resumed_count++;
+        stats_.resumed_total_ms += duration_ms;
+    } else {
+        stats_.full_count++;
+        stats_.full_total_ms += duration_ms;
+        if (offered) {
+            stats_.rejected_count++;
+        }
+    }
+}
+
+TlsHandshakeStats TlsSessionCache::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+struct WarmUpTarget {
+    std::string host;
+    int port;
+};
+
+void TlsSessionCache::WarmUpAsync(const std::string& host, int port) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (warming_up_ || sessions_.find(MakeKey(host, port)) != sessions_.end()) {
+            return;
+        }
+        warming_up_ = true;
+    }
+
+    auto target = new WarmUpTarget{host, port};
+    xTaskCreate([](void* arg) {
+        auto target = (WarmUpTarget*)arg;
+        ResumableTlsTransport transport;
+        if (transport.Connect(target->host.c_str(), target->port)) {
+            transport.Disconnect();
+            ESP_LOGI(TAG, "Warmed up TLS session for %s:%d", target->host.c_str(), target->port);
+        }
+        auto& cache = TlsSessionCache::GetInstance();
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex_);
+            cache.warming_up_ = false;
+        }
+        delete target;
+        vTaskDelete(NULL);
+    }, "tls_warm_up", 4096 * 2, target, 2, nullptr);
+}
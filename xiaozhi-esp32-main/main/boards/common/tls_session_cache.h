@@ -0,0 +1,66 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <esp_tls.h>
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+/*
+ * TLS 会话缓存，按 host:port 保存最近一次握手得到的会话 (Session ID / Session Ticket)
+ * 同一服务器的后续连接复用该会话，省去证书校验和密钥交换
+ * 缓存位于 RAM 中，浅睡眠后仍然有效，深度睡眠或重启后失效
+ */
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+typedef std::shared_ptr<esp_tls_client_session_t> TlsSession;
+#else
+typedef std::shared_ptr<void> TlsSession;
+#endif
+
+struct TlsHandshakeStats {
+    uint32_t full_count = 0;        // 完整握手次数，包括携带会话但被服务器拒绝的
+    uint32_t resumed_count = 0;     // 服务器接受复用的握手次数
+    uint32_t rejected_count = 0;    // 携带缓存会话但服务器要求完整握手的次数
+    uint32_t failed_count = 0;
+    uint32_t full_total_ms = 0;
+    uint32_t resumed_total_ms = 0;
+    uint32_t last_ms = 0;
+};
+
+class TlsSessionCache {
+public:
+    static TlsSessionCache& GetInstance() {
+        static TlsSessionCache instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    TlsSession Get(const std::string& host, int port);
+    void Put(const std::string& host, int port, TlsSession session);
+    void Remove(const std::string& host, int port);
+    void Clear();
+
+    // offered 表示握手时携带了缓存的会话，resumed 表示服务器实际接受了复用
+    void RecordHandshake(bool offered, bool resumed, bool success, int64_t duration_us);
+    TlsHandshakeStats GetStats();
+
+    // 在后台完成一次握手，让之后的第一次连接就能复用会话
+    void WarmUpAsync(const std::string& host, int port);
+
+private:
+    TlsSessionCache() = default;
+    ~TlsSessionCache() = default;
+
+    std::mutex mutex_;
+    std::map<std::string, TlsSession> sessions_;
+    TlsHandshakeStats stats_;
+    bool warming_up_ = false;
+};
+
+#endif // TLS_SESSION_CACHE_H
@@ -5,6 +5,8 @@
 #include "system_info.h"
 #include "font_awesome_symbols.h"
 #include "settings.h"
+#include "resumable_tls_transport.h"
+#include "tls_session_cache.h"
 #include "assets/lang_config.h"
 
 #include <freertos/FreeRTOS.h>
@@ -13,7 +15,6 @@
 #include <esp_mqtt.h>
 #include <esp_udp.h>
 #include <tcp_transport.h>
-#include <tls_transport.h>
 #include <web_socket.h>
 #include <esp_log.h>
 
@@ -118,13 +119,33 @@ WebSocket* WifiBoard::CreateWebSocket() {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     if (url.find("wss://") == 0) {
-        return new WebSocket(new TlsTransport());
+        return new WebSocket(new ResumableTlsTransport());
     } else {
         return new WebSocket(new TcpTransport());
     }
     return nullptr;
 }
 
+void WifiBoard::WarmUpConnection() {
+    if (wifi_config_mode_ || !WifiStation::GetInstance().IsConnected()) {
+        return;
+    }
+    Settings settings("websocket", false);
+    std::string url = settings.GetString("url");
+    if (url.find("wss://") != 0) {
+        return;
+    }
+    // wss://host[:port][/path]
+    std::string host = url.substr(6, url.find('/', 6) - 6);
+    int port = 443;
+    auto colon = host.find(':');
+    if (colon != std::string::npos) {
+        port = atoi(host.substr(colon + 1).c_str());
+        host = host.substr(0, colon);
+    }
+    TlsSessionCache::GetInstance().WarmUpAsync(host, port);
+}
+
 Mqtt* WifiBoard::CreateMqtt() {
     return new EspMqtt();
 }
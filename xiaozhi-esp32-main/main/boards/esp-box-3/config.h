@@ -34,6 +34,10 @@
 #define DISPLAY_OFFSET_X  0
 #define DISPLAY_OFFSET_Y  0
 
+#define DISPLAY_BUFFER_MODE       kDisplayBufferDouble
+#define DISPLAY_BUFFER_LINES      40
+#define DISPLAY_MERGE_DIRTY_ROWS  true
+
 #define DISPLAY_BACKLIGHT_PIN GPIO_NUM_47
 #define DISPLAY_BACKLIGHT_OUTPUT_INVERT false
 
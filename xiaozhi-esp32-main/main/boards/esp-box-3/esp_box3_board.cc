@@ -131,6 +131,11 @@ private:
 #else
                                         .emoji_font = font_emoji_64_init(),
 #endif
+                                    },
+                                    {
+                                        .mode = DISPLAY_BUFFER_MODE,
+                                        .lines = DISPLAY_BUFFER_LINES,
+                                        .merge_rows = DISPLAY_MERGE_DIRTY_ROWS,
                                     });
     }
 
@@ -46,6 +46,11 @@
 #define DISPLAY_OFFSET_X  0
 #define DISPLAY_OFFSET_Y  0
 
+// 整屏大小的两块 PSRAM 绘制缓冲区，经内部 DMA 中转缓冲区分段传输
+#define DISPLAY_BUFFER_MODE       kDisplayBufferPsram
+#define DISPLAY_BUFFER_LINES      DISPLAY_HEIGHT
+#define DISPLAY_MERGE_DIRTY_ROWS  true
+
 #define TP_PORT          (I2C_NUM_1)
 #define TP_PIN_NUM_SDA   (GPIO_NUM_1)
 #define TP_PIN_NUM_SCL   (GPIO_NUM_3)
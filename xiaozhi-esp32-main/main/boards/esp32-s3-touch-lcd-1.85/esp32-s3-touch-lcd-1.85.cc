@@ -364,6 +364,11 @@ private:
                                         .text_font = &font_puhui_16_4,
                                         .icon_font = &font_awesome_16_4,
                                         .emoji_font = font_emoji_64_init(),
+                                    },
+                                    {
+                                        .mode = DISPLAY_BUFFER_MODE,
+                                        .lines = DISPLAY_BUFFER_LINES,
+                                        .merge_rows = DISPLAY_MERGE_DIRTY_ROWS,
                                     });
     }
  
@@ -2,17 +2,18 @@
 #include <vector>
 #include <functional>
 
-#include <esp_timer.h>
 #include <driver/gpio.h>
 #include <esp_adc/adc_oneshot.h>
 
+#include "timer_service.h"
+
 #define CHARGING_PIN GPIO_NUM_48
 #define CHARGING_ACTIVE_STATE 0
 
 
 class PowerManager {
 private:
-    esp_timer_handle_t timer_handle_;
+    int timer_id_ = -1;
     std::function<void(bool)> on_charging_status_changed_;
     std::function<void(bool)> on_low_battery_status_changed_;
 
@@ -130,18 +131,12 @@ public:
         gpio_config(&io_conf);
 
         // 创建电池电量检查定时器
-        esp_timer_create_args_t timer_args = {
-            .callback = [](void* arg) {
-                PowerManager* self = static_cast<PowerManager*>(arg);
-                self->CheckBatteryStatus();
-            },
-            .arg = this,
-            .dispatch_method = ESP_TIMER_TASK,
-            .name = "battery_check_timer",
-            .skip_unhandled_events = true,
-        };
-        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_handle_));
-        ESP_ERROR_CHECK(esp_timer_start_periodic(timer_handle_, 1000000));
+        // 电量变化缓慢，允许合并到其它定时器的唤醒上
+        auto& timer_service = TimerService::GetInstance();
+        timer_id_ = timer_service.Create("battery_check_timer", kTimerDispatchTimerTask, [this]() {
+            CheckBatteryStatus();
+        });
+        timer_service.StartPeriodic(timer_id_, 1000, 1000);
 
         // 初始化 ADC
         adc_oneshot_unit_init_cfg_t init_config = {
@@ -158,9 +153,8 @@ public:
     }
 
     ~PowerManager() {
-        if (timer_handle_) {
-            esp_timer_stop(timer_handle_);
-            esp_timer_delete(timer_handle_);
+        if (timer_id_ >= 0) {
+            TimerService::GetInstance().Delete(timer_id_);
         }
         if (adc_handle_) {
             adc_oneshot_del_unit(adc_handle_);
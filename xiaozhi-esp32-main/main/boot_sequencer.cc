@@ -0,0 +1,123 @@
+#include "boot_sequencer.h"
+#include "trace_recorder.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "BootSequencer"
+
+void BootSequencer::AddStage(const char* name, std::initializer_list<const char*> depends, std::function<void()> callback, uint32_t stack_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stage stage;
+    stage.name = name;
+    stage.callback = std::move(callback);
+    stage.stack_size = stack_size;
+    stage.sequencer = this;
+    for (auto depend : depends) {
+        auto it = std::find_if(stages_.begin(), stages_.end(), [depend](const Stage& s) {
+            return strcmp(s.name, depend) == 0;
+        });
+        if (it == stages_.end()) {
+            ESP_LOGE(TAG, "Stage %s depends on unknown stage %s", name, depend);
+            continue;
+        }
+        stage.depends.push_back(it - stages_.begin());
+    }
+    stages_.push_back(std::move(stage));
+}
+
+void BootSequencer::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    StartReadyStages(lock);
+    done_cv_.wait(lock, [this]() {
+        return std::all_of(stages_.begin(), stages_.end(), [](const Stage& s) { return s.done; });
+    });
+}
+
+void BootSequencer::Record(const char* name, int64_t start_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stage stage;
+    stage.name = name;
+    stage.started = true;
+    stage.done = true;
+    stage.start_us = start_us;
+    stage.end_us = esp_timer_get_time();
+    TRACE_COMPLETE(name, stage.start_us, stage.end_us);
+    stages_.push_back(std::move(stage));
+}
+
+// 调用方需持有 mutex_
+bool BootSequencer::IsReady(const Stage& stage) {
+    if (stage.started) {
+        return false;
+    }
+    return std::all_of(stage.depends.begin(), stage.depends.end(), [this](int depend) {
+        return stages_[depend].done;
+    });
+}
+
+// 调用方需持有 mutex_
+void BootSequencer::StartReadyStages(std::unique_lock<std::mutex>& lock) {
+    for (auto& stage : stages_) {
+        if (!IsReady(stage)) {
+            continue;
+        }
+        stage.started = true;
+        auto ret = xTaskCreate([](void* arg) {
+            auto stage = (Stage*)arg;
+            stage->sequencer->RunStage(*stage);
+            vTaskDelete(NULL);
+        }, stage.name, stage.stack_size, &stage, 3, nullptr);
+        if (ret != pdPASS) {
+            // 内存不足时在当前任务中执行
+            ESP_LOGE(TAG, "Failed to create task for stage %s", stage.name);
+            lock.unlock();
+            RunStage(stage);
+            lock.lock();
+        }
+    }
+}
+
+void BootSequencer::RunStage(Stage& stage) {
+    stage.start_us = esp_timer_get_time();
+    TRACE_BEGIN(stage.name);
+    stage.callback();
+    TRACE_END(stage.name);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    stage.end_us = esp_timer_get_time();
+    stage.done = true;
+    // 由完成的阶段启动后续阶段，不需要等待 Run 的调用方被唤醒
+    StartReadyStages(lock);
+    done_cv_.notify_all();
+}
+
+void BootSequencer::PrintTimeline() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<const Stage*> stages;
+    int64_t end_us = 1;
+    for (auto& stage : stages_) {
+        if (stage.done) {
+            stages.push_back(&stage);
+            end_us = std::max(end_us, stage.end_us);
+        }
+    }
+    std::stable_sort(stages.begin(), stages.end(), [](const Stage* a, const Stage* b) {
+        return a->start_us < b->start_us;
+    });
+
+    ESP_LOGI(TAG, "Boot timeline (ms since power-on):");
+    for (auto stage : stages) {
+        char bar[BOOT_TIMELINE_WIDTH + 1];
+        int begin = stage->start_us * BOOT_TIMELINE_WIDTH / end_us;
+        int end = std::max<int>(stage->end_us * BOOT_TIMELINE_WIDTH / end_us, begin + 1);
+        for (int i = 0; i < BOOT_TIMELINE_WIDTH; i++) {
+            bar[i] = (i >= begin && i < end) ? '#' : '.';
+        }
+        bar[BOOT_TIMELINE_WIDTH] = '\0';
+        ESP_LOGI(TAG, "%-12s %6lld - %6lld %6lld ms |%s|", stage->name, stage->start_us / 1000,
+            stage->end_us / 1000, (stage->end_us - stage->start_us) / 1000, bar);
+    }
+}
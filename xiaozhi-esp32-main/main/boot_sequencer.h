@@ -0,0 +1,57 @@
+#ifndef BOOT_SEQUENCER_H
+#define BOOT_SEQUENCER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <condition_variable>
+
+// 时间线报告中进度条的宽度（字符数）
+#define BOOT_TIMELINE_WIDTH 40
+
+/*
+ * 启动阶段的依赖图，依赖全部完成的阶段立即在各自的任务中并行执行
+ * 例如唤醒词模型和 AFE 的加载不依赖网络，可以与连接 Wi-Fi 同时进行
+ * 所有阶段和之后记录的事件 (Record) 以上电后的时间输出为时间线，便于查看启动耗时分布
+ */
+class BootSequencer {
+public:
+    BootSequencer() = default;
+    // 删除拷贝构造函数和赋值运算符
+    BootSequencer(const BootSequencer&) = delete;
+    BootSequencer& operator=(const BootSequencer&) = delete;
+
+    // depends 中的阶段需已添加，Run 之后不能再添加阶段
+    void AddStage(const char* name, std::initializer_list<const char*> depends, std::function<void()> callback, uint32_t stack_size = 4096 * 2);
+    // 阻塞直到所有阶段完成
+    void Run();
+    // 记录图之外的启动事件，从 start_us 持续到现在
+    void Record(const char* name, int64_t start_us);
+    void PrintTimeline();
+
+private:
+    struct Stage {
+        const char* name = nullptr;
+        std::vector<int> depends;
+        std::function<void()> callback;
+        uint32_t stack_size = 0;
+        bool started = false;
+        bool done = false;
+        int64_t start_us = 0;
+        int64_t end_us = 0;
+        BootSequencer* sequencer = nullptr;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    std::vector<Stage> stages_;     // 阶段任务持有元素指针，Run 期间大小不变
+
+    bool IsReady(const Stage& stage);
+    void StartReadyStages(std::unique_lock<std::mutex>& lock);
+    void RunStage(Stage& stage);
+};
+
+#endif // BOOT_SEQUENCER_H
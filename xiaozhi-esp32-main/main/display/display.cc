@@ -10,43 +10,80 @@
 #include "font_awesome_symbols.h"
 #include "audio_codec.h"
 #include "settings.h"
+#include "timer_service.h"
+#include "trace_recorder.h"
 #include "assets/lang_config.h"
 
 #define TAG "Display"
 
+// 信号强度只反映无线侧，服务器链路质量差时同样降低网络图标的格数
+static const char* ApplyLinkQuality(const char* icon, LinkQualityLevel level) {
+    if (level != kLinkQualityFair && level != kLinkQualityPoor) {
+        return icon;
+    }
+    if (strcmp(icon, FONT_AWESOME_WIFI) == 0 || strcmp(icon, FONT_AWESOME_WIFI_FAIR) == 0) {
+        return level == kLinkQualityPoor ? FONT_AWESOME_WIFI_WEAK : FONT_AWESOME_WIFI_FAIR;
+    }
+    static const char* const signal_icons[] = {
+        FONT_AWESOME_SIGNAL_1, FONT_AWESOME_SIGNAL_2, FONT_AWESOME_SIGNAL_3, FONT_AWESOME_SIGNAL_4,
+    };
+    int max_bars = level == kLinkQualityPoor ? 1 : 2;
+    for (int i = max_bars; i < 4; i++) {
+        if (strcmp(icon, signal_icons[i]) == 0) {
+            return signal_icons[max_bars - 1];
+        }
+    }
+    return icon;
+}
+
+void Display::TraceRendering() {
+#if CONFIG_USE_TRACE_PROFILER
+    // 在 LVGL 任务中回调；送显使用 DMA 时 flush 只是提交，等待上一次传输完成的时间单独记录
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        switch (lv_event_get_code(e)) {
+            case LV_EVENT_REFR_START:
+                TRACE_BEGIN("lvgl_refresh");
+                break;
+            case LV_EVENT_REFR_READY:
+                TRACE_END("lvgl_refresh");
+                break;
+            case LV_EVENT_FLUSH_START:
+                TRACE_BEGIN("lvgl_flush");
+                break;
+            case LV_EVENT_FLUSH_FINISH:
+                TRACE_END("lvgl_flush");
+                break;
+            case LV_EVENT_FLUSH_WAIT_START:
+                TRACE_BEGIN("lvgl_flush_wait");
+                break;
+            case LV_EVENT_FLUSH_WAIT_FINISH:
+                TRACE_END("lvgl_flush_wait");
+                break;
+            default:
+                break;
+        }
+    }, LV_EVENT_ALL, nullptr);
+#endif
+}
+
 Display::Display() {
     // Load theme from settings
     Settings settings("display", false);
     current_theme_name_ = settings.GetString("theme", "light");
 
     // Notification timer
-    esp_timer_create_args_t notification_timer_args = {
-        .callback = [](void *arg) {
-            Display *display = static_cast<Display*>(arg);
-            DisplayLockGuard lock(display);
-            lv_obj_add_flag(display->notification_label_, LV_OBJ_FLAG_HIDDEN);
-            lv_obj_clear_flag(display->status_label_, LV_OBJ_FLAG_HIDDEN);
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "notification_timer",
-        .skip_unhandled_events = false,
-    };
-    ESP_ERROR_CHECK(esp_timer_create(&notification_timer_args, &notification_timer_));
+    auto& timer_service = TimerService::GetInstance();
+    notification_timer_ = timer_service.Create("notification_timer", kTimerDispatchTimerTask, [this]() {
+        DisplayLockGuard lock(this);
+        lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
+    });
 
-    // Update display timer
-    esp_timer_create_args_t update_display_timer_args = {
-        .callback = [](void *arg) {
-            Display *display = static_cast<Display*>(arg);
-            display->Update();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "display_update_timer",
-        .skip_unhandled_events = true,
-    };
-    ESP_ERROR_CHECK(esp_timer_create(&update_display_timer_args, &update_timer_));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(update_timer_, 1000000));
+    // Update display timer，刷新时间和状态图标，不需要精确对齐到秒
+    update_timer_ = timer_service.Create("display_update_timer", kTimerDispatchTimerTask, [this]() {
+        Update();
+    });
+    timer_service.StartPeriodic(update_timer_, 1000, 1000);
 
     // Create a power management lock
     auto ret = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "display_update", &pm_lock_);
@@ -58,13 +95,12 @@ Display::Display() {
 }
 
 Display::~Display() {
-    if (notification_timer_ != nullptr) {
-        esp_timer_stop(notification_timer_);
-        esp_timer_delete(notification_timer_);
+    auto& timer_service = TimerService::GetInstance();
+    if (notification_timer_ >= 0) {
+        timer_service.Delete(notification_timer_);
     }
-    if (update_timer_ != nullptr) {
-        esp_timer_stop(update_timer_);
-        esp_timer_delete(update_timer_);
+    if (update_timer_ >= 0) {
+        timer_service.Delete(update_timer_);
     }
 
     if (network_label_ != nullptr) {
@@ -106,8 +142,7 @@ void Display::ShowNotification(const char* notification, int duration_ms) {
     lv_obj_clear_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
     lv_obj_add_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
 
-    esp_timer_stop(notification_timer_);
-    ESP_ERROR_CHECK(esp_timer_start_once(notification_timer_, duration_ms * 1000));
+    TimerService::GetInstance().StartOnce(notification_timer_, duration_ms, 100);
 }
 
 void Display::Update() {
@@ -182,6 +217,9 @@ void Display::Update() {
     };
     if (std::find(allowed_states.begin(), allowed_states.end(), device_state) != allowed_states.end()) {
         icon = board.GetNetworkStateIcon();
+        if (icon != nullptr) {
+            icon = ApplyLinkQuality(icon, Application::GetInstance().GetLinkQuality().level);
+        }
         if (network_label_ != nullptr && icon != nullptr && network_icon_ != icon) {
             DisplayLockGuard lock(this);
             network_icon_ = icon;
@@ -257,6 +295,10 @@ void Display::SetChatMessage(const char* role, const char* content) {
     lv_label_set_text(chat_message_label_, content);
 }
 
+void Display::AppendCaption(const char* text) {
+    SetChatMessage("assistant", text);
+}
+
 void Display::SetTheme(const std::string& theme_name) {
     current_theme_name_ = theme_name;
     Settings settings("display", true);
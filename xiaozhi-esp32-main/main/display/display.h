@@ -24,6 +24,10 @@ public:
     virtual void ShowNotification(const std::string &notification, int duration_ms = 3000);
     virtual void SetEmotion(const char* emotion);
     virtual void SetChatMessage(const char* role, const char* content);
+    // 流式字幕：一轮回复开始时调用 StartCaption，之后每句调用 AppendCaption 追加到同一条助手消息
+    // 默认实现每句替换显示的内容
+    virtual void StartCaption() {}
+    virtual void AppendCaption(const char* text);
     virtual void SetIcon(const char* icon);
     virtual void SetTheme(const std::string& theme_name);
     virtual std::string GetTheme() { return current_theme_name_; }
@@ -53,14 +57,16 @@ protected:
     bool muted_ = false;
     std::string current_theme_name_;
 
-    esp_timer_handle_t notification_timer_ = nullptr;
-    esp_timer_handle_t update_timer_ = nullptr;
+    int notification_timer_ = -1;
+    int update_timer_ = -1;
 
     friend class DisplayLockGuard;
     virtual bool Lock(int timeout_ms = 0) = 0;
     virtual void Unlock() = 0;
 
     virtual void Update();
+    // 启用时间线剖析时记录 LVGL 的刷新和送显，需在创建 display_ 之后调用
+    void TraceRendering();
 };
 
 
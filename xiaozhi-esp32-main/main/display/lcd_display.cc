@@ -1,89 +1,31 @@
 #include "lcd_display.h"
 
 #include <vector>
+#include <algorithm>
 #include <font_awesome_symbols.h>
 #include <esp_log.h>
 #include <esp_err.h>
 #include <esp_lvgl_port.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include "assets/lang_config.h"
 #include <cstring>
 #include "settings.h"
+#include "trace_recorder.h"
 
 #include "board.h"
 
 #define TAG "LcdDisplay"
 
-// Color definitions for dark theme
-#define DARK_BACKGROUND_COLOR       lv_color_hex(0x121212)     // Dark background
-#define DARK_TEXT_COLOR             lv_color_white()           // White text
-#define DARK_CHAT_BACKGROUND_COLOR  lv_color_hex(0x1E1E1E)     // Slightly lighter than background
-#define DARK_USER_BUBBLE_COLOR      lv_color_hex(0x1A6C37)     // Dark green
-#define DARK_ASSISTANT_BUBBLE_COLOR lv_color_hex(0x333333)     // Dark gray
-#define DARK_SYSTEM_BUBBLE_COLOR    lv_color_hex(0x2A2A2A)     // Medium gray
-#define DARK_SYSTEM_TEXT_COLOR      lv_color_hex(0xAAAAAA)     // Light gray text
-#define DARK_BORDER_COLOR           lv_color_hex(0x333333)     // Dark gray border
-#define DARK_LOW_BATTERY_COLOR      lv_color_hex(0xFF0000)     // Red for dark mode
-
-// Color definitions for light theme
-#define LIGHT_BACKGROUND_COLOR       lv_color_white()           // White background
-#define LIGHT_TEXT_COLOR             lv_color_black()           // Black text
-#define LIGHT_CHAT_BACKGROUND_COLOR  lv_color_hex(0xE0E0E0)     // Light gray background
-#define LIGHT_USER_BUBBLE_COLOR      lv_color_hex(0x95EC69)     // WeChat green
-#define LIGHT_ASSISTANT_BUBBLE_COLOR lv_color_white()           // White
-#define LIGHT_SYSTEM_BUBBLE_COLOR    lv_color_hex(0xE0E0E0)     // Light gray
-#define LIGHT_SYSTEM_TEXT_COLOR      lv_color_hex(0x666666)     // Dark gray text
-#define LIGHT_BORDER_COLOR           lv_color_hex(0xE0E0E0)     // Light gray border
-#define LIGHT_LOW_BATTERY_COLOR      lv_color_black()           // Black for light mode
-
-// Theme color structure
-struct ThemeColors {
-    lv_color_t background;
-    lv_color_t text;
-    lv_color_t chat_background;
-    lv_color_t user_bubble;
-    lv_color_t assistant_bubble;
-    lv_color_t system_bubble;
-    lv_color_t system_text;
-    lv_color_t border;
-    lv_color_t low_battery;
-};
-
-// Define dark theme colors
-static const ThemeColors DARK_THEME = {
-    .background = DARK_BACKGROUND_COLOR,
-    .text = DARK_TEXT_COLOR,
-    .chat_background = DARK_CHAT_BACKGROUND_COLOR,
-    .user_bubble = DARK_USER_BUBBLE_COLOR,
-    .assistant_bubble = DARK_ASSISTANT_BUBBLE_COLOR,
-    .system_bubble = DARK_SYSTEM_BUBBLE_COLOR,
-    .system_text = DARK_SYSTEM_TEXT_COLOR,
-    .border = DARK_BORDER_COLOR,
-    .low_battery = DARK_LOW_BATTERY_COLOR
-};
-
-// Define light theme colors
-static const ThemeColors LIGHT_THEME = {
-    .background = LIGHT_BACKGROUND_COLOR,
-    .text = LIGHT_TEXT_COLOR,
-    .chat_background = LIGHT_CHAT_BACKGROUND_COLOR,
-    .user_bubble = LIGHT_USER_BUBBLE_COLOR,
-    .assistant_bubble = LIGHT_ASSISTANT_BUBBLE_COLOR,
-    .system_bubble = LIGHT_SYSTEM_BUBBLE_COLOR,
-    .system_text = LIGHT_SYSTEM_TEXT_COLOR,
-    .border = LIGHT_BORDER_COLOR,
-    .low_battery = LIGHT_LOW_BATTERY_COLOR
-};
-
-// Current theme - initialize based on default config
-static ThemeColors current_theme = LIGHT_THEME;
-
+// 刷新统计的输出间隔
+#define RENDER_STATS_INTERVAL_US (5 * 1000 * 1000)
 
 LV_FONT_DECLARE(font_awesome_30_4);
 
 SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                            int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy,
-                           DisplayFonts fonts)
-    : LcdDisplay(panel_io, panel, fonts) {
+                           DisplayFonts fonts, DisplayBufferConfig buffer_config)
+    : LcdDisplay(panel_io, panel, fonts), buffer_config_(buffer_config) {
     width_ = width;
     height_ = height;
 
@@ -106,13 +48,20 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     port_cfg.timer_period_ms = 50;
     lvgl_port_init(&port_cfg);
 
-    ESP_LOGI(TAG, "Adding LCD screen");
+    if (buffer_config_.mode == kDisplayBufferPsram && !InitBounceBuffers()) {
+        ESP_LOGW(TAG, "PSRAM draw buffers unavailable, using internal double buffers");
+        buffer_config_.mode = kDisplayBufferDouble;
+        buffer_config_.lines = std::min(buffer_config_.lines, LCD_DEFAULT_BUFFER_LINES);
+    }
+    bool psram = buffer_config_.mode == kDisplayBufferPsram;
+
+    ESP_LOGI(TAG, "Adding LCD screen, buffer mode %d, %d lines", buffer_config_.mode, buffer_config_.lines);
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = false,
+        .buffer_size = static_cast<uint32_t>(width_ * buffer_config_.lines),
+        .double_buffer = buffer_config_.mode != kDisplayBufferSingle,
         .trans_size = 0,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
@@ -124,8 +73,8 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         },
         .color_format = LV_COLOR_FORMAT_RGB565,
         .flags = {
-            .buff_dma = 1,
-            .buff_spiram = 0,
+            .buff_dma = !psram,
+            .buff_spiram = psram,
             .sw_rotate = 0,
             .swap_bytes = 1,
             .full_refresh = 0,
@@ -138,16 +87,33 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+    TraceRendering();
+    ReportRendering();
+
+    if (psram) {
+        // 替换 esp_lvgl_port 的 flush，最后一段传输完成时才通知 LVGL，期间 LVGL 渲染另一块缓冲区
+        bounce_display_ = this;
+        lv_display_set_flush_cb(display_, [](lv_display_t* disp, const lv_area_t* area, uint8_t* px_map) {
+            bounce_display_->FlushBounce(area, px_map);
+        });
+        const esp_lcd_panel_io_callbacks_t callbacks = {
+            .on_color_trans_done = OnBounceTransferDone,
+        };
+        esp_lcd_panel_io_register_event_callbacks(panel_io_, &callbacks, this);
+    }
 
-    if (offset_x != 0 || offset_y != 0) {
-        lv_display_set_offset(display_, offset_x, offset_y);
+    if (buffer_config_.merge_rows) {
+        // 刷新时 LVGL 会合并重叠的脏区域，扩展为整行后状态栏等同一行带内的多处更新合并为一个区域
+        lv_display_add_event_cb(display_, [](lv_event_t* e) {
+            auto area = static_cast<lv_area_t*>(lv_event_get_param(e));
+            auto disp = static_cast<lv_display_t*>(lv_event_get_user_data(e));
+            area->x1 = 0;
+            area->x2 = lv_display_get_horizontal_resolution(disp) - 1;
+        }, LV_EVENT_INVALIDATE_AREA, display_);
     }
 
-    // Update the theme
-    if (current_theme_name_ == "dark") {
-        current_theme = DARK_THEME;
-    } else if (current_theme_name_ == "light") {
-        current_theme = LIGHT_THEME;
+    if (offset_x != 0 || offset_y != 0) {
+        lv_display_set_offset(display_, offset_x, offset_y);
     }
 
     SetupUI();
@@ -210,19 +176,99 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         ESP_LOGE(TAG, "Failed to add RGB display");
         return;
     }
+    TraceRendering();
+    ReportRendering();
     
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
     }
 
-    // Update the theme
-    if (current_theme_name_ == "dark") {
-        current_theme = DARK_THEME;
-    } else if (current_theme_name_ == "light") {
-        current_theme = LIGHT_THEME;
+    SetupUI();
+}
+
+SpiLcdDisplay::~SpiLcdDisplay() {
+    if (bounce_free_ == nullptr) {
+        return;
     }
+    if (display_ != nullptr) {
+        // 之后的刷新不再使用中转缓冲区
+        DisplayLockGuard lock(this);
+        lv_display_set_flush_cb(display_, [](lv_display_t* disp, const lv_area_t* area, uint8_t* px_map) {
+            lv_display_flush_ready(disp);
+        });
+    }
+    bounce_display_ = nullptr;
+    // 两块中转缓冲区都归还后，说明传输已全部完成
+    xSemaphoreTake(bounce_free_, portMAX_DELAY);
+    xSemaphoreTake(bounce_free_, portMAX_DELAY);
+    const esp_lcd_panel_io_callbacks_t callbacks = {};
+    esp_lcd_panel_io_register_event_callbacks(panel_io_, &callbacks, nullptr);
+
+    vSemaphoreDelete(bounce_free_);
+    heap_caps_free(bounce_buffers_[0]);
+    heap_caps_free(bounce_buffers_[1]);
+}
 
-    SetupUI();
+bool SpiLcdDisplay::InitBounceBuffers() {
+    size_t draw_buffer_size = width_ * buffer_config_.lines * sizeof(uint16_t);
+    if (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < draw_buffer_size * 2) {
+        return false;
+    }
+
+    bounce_pixels_ = width_ * buffer_config_.bounce_lines;
+    for (auto& buffer : bounce_buffers_) {
+        buffer = (uint16_t*)heap_caps_malloc(bounce_pixels_ * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    }
+    bounce_free_ = xSemaphoreCreateCounting(2, 2);
+    if (bounce_buffers_[0] == nullptr || bounce_buffers_[1] == nullptr || bounce_free_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate bounce buffers");
+        heap_caps_free(bounce_buffers_[0]);
+        heap_caps_free(bounce_buffers_[1]);
+        bounce_buffers_[0] = bounce_buffers_[1] = nullptr;
+        if (bounce_free_ != nullptr) {
+            vSemaphoreDelete(bounce_free_);
+            bounce_free_ = nullptr;
+        }
+        return false;
+    }
+    return true;
+}
+
+// 在 LVGL 任务中调用，复制下一段到空闲的中转缓冲区时上一段仍在传输
+void SpiLcdDisplay::FlushBounce(const lv_area_t* area, uint8_t* px_map) {
+    int width = lv_area_get_width(area);
+    int lines = bounce_pixels_ / width;
+    // 段数在发送前确定，中断中减到 0 时即为最后一段
+    pending_chunks_.store((lv_area_get_height(area) + lines - 1) / lines);
+
+    auto src = reinterpret_cast<const uint16_t*>(px_map);
+    int index = 0;
+    for (int y = area->y1; y <= area->y2; y += lines) {
+        int rows = std::min(lines, area->y2 + 1 - y);
+        size_t count = rows * width;
+        xSemaphoreTake(bounce_free_, portMAX_DELAY);
+        auto dst = bounce_buffers_[index];
+        // 复制时交换字节序，与 esp_lvgl_port 的 swap_bytes 相同，PSRAM 中的数据保持不变
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = __builtin_bswap16(src[i]);
+        }
+        esp_lcd_panel_draw_bitmap(panel_, area->x1, y, area->x2 + 1, y + rows, dst);
+        src += count;
+        index ^= 1;
+    }
+}
+
+SpiLcdDisplay* SpiLcdDisplay::bounce_display_ = nullptr;
+
+// 在中断中调用
+bool SpiLcdDisplay::OnBounceTransferDone(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t* edata, void* user_ctx) {
+    auto self = static_cast<SpiLcdDisplay*>(user_ctx);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xSemaphoreGiveFromISR(self->bounce_free_, &higher_priority_task_woken);
+    if (self->pending_chunks_.fetch_sub(1) == 1) {
+        lv_display_flush_ready(self->display_);
+    }
+    return higher_priority_task_woken == pdTRUE;
 }
 
 LcdDisplay::~LcdDisplay() {
@@ -239,6 +285,24 @@ LcdDisplay::~LcdDisplay() {
     if (container_ != nullptr) {
         lv_obj_del(container_);
     }
+    if (low_battery_popup_ != nullptr) {
+        lv_obj_del(low_battery_popup_);
+        low_battery_popup_ = nullptr;
+    }
+    // 使用共享样式的对象删除之后才能释放样式，屏幕对象仍然存在，先移除它的样式
+    lv_obj_remove_style(lv_screen_active(), &screen_style_, 0);
+    lv_style_reset(&screen_style_);
+    lv_style_reset(&container_style_);
+    lv_style_reset(&status_bar_style_);
+    lv_style_reset(&content_style_);
+    lv_style_reset(&low_battery_style_);
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    lv_style_reset(&chat_row_style_);
+    lv_style_reset(&chat_bubble_style_);
+    lv_style_reset(&user_bubble_style_);
+    lv_style_reset(&assistant_bubble_style_);
+    lv_style_reset(&system_bubble_style_);
+#endif
     if (display_ != nullptr) {
         lv_display_delete(display_);
     }
@@ -259,14 +323,117 @@ void LcdDisplay::Unlock() {
     lvgl_port_unlock();
 }
 
+void LcdDisplay::ReportRendering() {
+#if CONFIG_USE_DISPLAY_RENDER_STATS
+    render_stats_.period_start_us = esp_timer_get_time();
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto self = static_cast<LcdDisplay*>(lv_event_get_user_data(e));
+        self->UpdateRenderStats(lv_event_get_code(e), lv_event_get_param(e));
+    }, LV_EVENT_ALL, this);
+#endif
+}
+
+#if CONFIG_USE_DISPLAY_RENDER_STATS
+// 在 LVGL 任务中回调，只统计有送显的刷新；忙碌时间为刷新耗时减去等待传输完成的时间
+void LcdDisplay::UpdateRenderStats(lv_event_code_t code, void* param) {
+    auto& stats = render_stats_;
+    int64_t now = esp_timer_get_time();
+    switch (code) {
+        case LV_EVENT_REFR_START:
+            stats.refresh_start_us = now;
+            stats.refresh_wait_us = 0;
+            stats.flushed = false;
+            break;
+        case LV_EVENT_FLUSH_START:
+            // 参数为本次送显的区域
+            if (param != nullptr) {
+                stats.pixels += lv_area_get_size(static_cast<const lv_area_t*>(param));
+            }
+            stats.flushed = true;
+            break;
+        case LV_EVENT_FLUSH_WAIT_START:
+            stats.wait_start_us = now;
+            break;
+        case LV_EVENT_FLUSH_WAIT_FINISH:
+            stats.refresh_wait_us += now - stats.wait_start_us;
+            break;
+        case LV_EVENT_REFR_READY:
+            if (stats.flushed) {
+                stats.frames++;
+                stats.busy_us += now - stats.refresh_start_us - stats.refresh_wait_us;
+                stats.wait_us += stats.refresh_wait_us;
+            }
+            if (now - stats.period_start_us >= RENDER_STATS_INTERVAL_US) {
+                if (stats.frames > 0) {
+                    ESP_LOGI(TAG, "Render: %.1f fps, busy %lu us/frame, wait %lu us/frame, %lu px/frame",
+                        stats.frames * 1000000.0f / (now - stats.period_start_us),
+                        (uint32_t)(stats.busy_us / stats.frames), (uint32_t)(stats.wait_us / stats.frames),
+                        (uint32_t)(stats.pixels / stats.frames));
+                }
+                stats = RenderStats();
+                stats.period_start_us = now;
+            }
+            break;
+        default:
+            break;
+    }
+}
+#endif
+
+void LcdDisplay::InitThemeStyles() {
+    lv_style_init(&screen_style_);
+    lv_style_init(&container_style_);
+    lv_style_init(&status_bar_style_);
+    lv_style_init(&content_style_);
+    lv_style_init(&low_battery_style_);
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    InitChatStyles();
+#endif
+
+    auto& themes = Themes::GetInstance();
+    auto colors = themes.Find(current_theme_name_);
+    ApplyTheme(colors != nullptr ? *colors : themes.GetDefault());
+}
+
+// 只修改共享样式的属性，调用方负责通知样式变化
+void LcdDisplay::ApplyTheme(const ThemeColors& colors) {
+    lv_style_set_bg_color(&screen_style_, colors.background);
+    lv_style_set_text_color(&screen_style_, colors.text);
+
+    // 控件的默认样式设置了文字颜色，这里需要覆盖，标签继承其父对象的颜色
+    lv_style_set_bg_color(&container_style_, colors.background);
+    lv_style_set_border_color(&container_style_, colors.border);
+    lv_style_set_text_color(&container_style_, colors.text);
+
+    lv_style_set_bg_color(&status_bar_style_, colors.background);
+    lv_style_set_text_color(&status_bar_style_, colors.text);
+
+    lv_style_set_bg_color(&content_style_, colors.chat_background);
+    lv_style_set_border_color(&content_style_, colors.border);
+    lv_style_set_text_color(&content_style_, colors.text);
+
+    lv_style_set_bg_color(&low_battery_style_, colors.low_battery);
+
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    lv_style_set_border_color(&chat_bubble_style_, colors.border);
+    lv_style_set_bg_color(&user_bubble_style_, colors.user_bubble);
+    lv_style_set_text_color(&user_bubble_style_, colors.text);
+    lv_style_set_bg_color(&assistant_bubble_style_, colors.assistant_bubble);
+    lv_style_set_text_color(&assistant_bubble_style_, colors.text);
+    lv_style_set_bg_color(&system_bubble_style_, colors.system_bubble);
+    lv_style_set_text_color(&system_bubble_style_, colors.system_text);
+#endif
+}
+
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
 void LcdDisplay::SetupUI() {
     DisplayLockGuard lock(this);
 
+    InitThemeStyles();
+
     auto screen = lv_screen_active();
     lv_obj_set_style_text_font(screen, fonts_.text_font, 0);
-    lv_obj_set_style_text_color(screen, current_theme.text, 0);
-    lv_obj_set_style_bg_color(screen, current_theme.background, 0);
+    lv_obj_add_style(screen, &screen_style_, 0);
 
     /* Container */
     container_ = lv_obj_create(screen);
@@ -275,15 +442,13 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_style_pad_all(container_, 0, 0);
     lv_obj_set_style_border_width(container_, 0, 0);
     lv_obj_set_style_pad_row(container_, 0, 0);
-    lv_obj_set_style_bg_color(container_, current_theme.background, 0);
-    lv_obj_set_style_border_color(container_, current_theme.border, 0);
+    lv_obj_add_style(container_, &container_style_, 0);
 
     /* Status bar */
     status_bar_ = lv_obj_create(container_);
     lv_obj_set_size(status_bar_, LV_HOR_RES, LV_SIZE_CONTENT);
     lv_obj_set_style_radius(status_bar_, 0, 0);
-    lv_obj_set_style_bg_color(status_bar_, current_theme.background, 0);
-    lv_obj_set_style_text_color(status_bar_, current_theme.text, 0);
+    lv_obj_add_style(status_bar_, &status_bar_style_, 0);
     
     /* Content - Chat area */
     content_ = lv_obj_create(container_);
@@ -291,8 +456,7 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_width(content_, LV_HOR_RES);
     lv_obj_set_flex_grow(content_, 1);
     lv_obj_set_style_pad_all(content_, 10, 0);
-    lv_obj_set_style_bg_color(content_, current_theme.chat_background, 0); // Background for chat area
-    lv_obj_set_style_border_color(content_, current_theme.border, 0); // Border color for chat area
+    lv_obj_add_style(content_, &content_style_, 0);
 
     // Enable scrolling for chat content
     lv_obj_set_scrollbar_mode(content_, LV_SCROLLBAR_MODE_OFF);
@@ -303,8 +467,12 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_flex_align(content_, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
     lv_obj_set_style_pad_row(content_, 10, 0); // Space between messages
 
-    // We'll create chat messages dynamically in SetChatMessage
+    // 聊天气泡在 SetChatMessage 中按需从气泡池取得
     chat_message_label_ = nullptr;
+    lv_obj_add_event_cb(content_, [](lv_event_t* e) {
+        auto self = static_cast<LcdDisplay*>(lv_event_get_user_data(e));
+        self->RevealOlderBubbles();
+    }, LV_EVENT_SCROLL_END, this);
 
     /* Status bar */
     lv_obj_set_flex_flow(status_bar_, LV_FLEX_FLOW_ROW);
@@ -322,14 +490,12 @@ void LcdDisplay::SetupUI() {
     // 创建emotion_label_在状态栏最左侧
     emotion_label_ = lv_label_create(status_bar_);
     lv_obj_set_style_text_font(emotion_label_, &font_awesome_30_4, 0);
-    lv_obj_set_style_text_color(emotion_label_, current_theme.text, 0);
     lv_label_set_text(emotion_label_, FONT_AWESOME_AI_CHIP);
     lv_obj_set_style_margin_right(emotion_label_, 5, 0); // 添加右边距，与后面的元素分隔
 
     notification_label_ = lv_label_create(status_bar_);
     lv_obj_set_flex_grow(notification_label_, 1);
     lv_obj_set_style_text_align(notification_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(notification_label_, current_theme.text, 0);
     lv_label_set_text(notification_label_, "");
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
@@ -337,31 +503,27 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_flex_grow(status_label_, 1);
     lv_label_set_long_mode(status_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(status_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(status_label_, current_theme.text, 0);
     lv_label_set_text(status_label_, Lang::Strings::INITIALIZING);
     
     mute_label_ = lv_label_create(status_bar_);
     lv_label_set_text(mute_label_, "");
     lv_obj_set_style_text_font(mute_label_, fonts_.icon_font, 0);
-    lv_obj_set_style_text_color(mute_label_, current_theme.text, 0);
 
     network_label_ = lv_label_create(status_bar_);
     lv_label_set_text(network_label_, "");
     lv_obj_set_style_text_font(network_label_, fonts_.icon_font, 0);
-    lv_obj_set_style_text_color(network_label_, current_theme.text, 0);
     lv_obj_set_style_margin_left(network_label_, 5, 0); // 添加左边距，与前面的元素分隔
 
     battery_label_ = lv_label_create(status_bar_);
     lv_label_set_text(battery_label_, "");
     lv_obj_set_style_text_font(battery_label_, fonts_.icon_font, 0);
-    lv_obj_set_style_text_color(battery_label_, current_theme.text, 0);
     lv_obj_set_style_margin_left(battery_label_, 5, 0); // 添加左边距，与前面的元素分隔
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
     lv_obj_set_size(low_battery_popup_, LV_HOR_RES * 0.9, fonts_.text_font->line_height * 2);
     lv_obj_align(low_battery_popup_, LV_ALIGN_BOTTOM_MID, 0, 0);
-    lv_obj_set_style_bg_color(low_battery_popup_, current_theme.low_battery, 0);
+    lv_obj_add_style(low_battery_popup_, &low_battery_style_, 0);
     lv_obj_set_style_radius(low_battery_popup_, 10, 0);
     low_battery_label_ = lv_label_create(low_battery_popup_);
     lv_label_set_text(low_battery_label_, Lang::Strings::BATTERY_NEED_CHARGE);
@@ -370,197 +532,232 @@ void LcdDisplay::SetupUI() {
     lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
 }
 
-#define  MAX_MESSAGES 20
-void LcdDisplay::SetChatMessage(const char* role, const char* content) {
-    DisplayLockGuard lock(this);
-    if (content_ == nullptr) {
+void LcdDisplay::InitChatStyles() {
+    lv_style_init(&chat_row_style_);
+    lv_style_set_width(&chat_row_style_, LV_HOR_RES);
+    lv_style_set_height(&chat_row_style_, LV_SIZE_CONTENT);
+    lv_style_set_bg_opa(&chat_row_style_, LV_OPA_TRANSP);
+    lv_style_set_border_width(&chat_row_style_, 0);
+    lv_style_set_pad_all(&chat_row_style_, 0);
+
+    lv_style_init(&chat_bubble_style_);
+    lv_style_set_width(&chat_bubble_style_, LV_SIZE_CONTENT);
+    lv_style_set_height(&chat_bubble_style_, LV_SIZE_CONTENT);
+    lv_style_set_radius(&chat_bubble_style_, 8);
+    lv_style_set_border_width(&chat_bubble_style_, 1);
+    lv_style_set_pad_all(&chat_bubble_style_, 8);
+    // 流式字幕的多个段落在气泡内纵向排列
+    lv_style_set_layout(&chat_bubble_style_, LV_LAYOUT_FLEX);
+    lv_style_set_flex_flow(&chat_bubble_style_, LV_FLEX_FLOW_COLUMN);
+    lv_style_set_pad_row(&chat_bubble_style_, 0);
+
+    // 角色样式决定气泡颜色和在行内的对齐，文字颜色由标签继承，颜色在 ApplyTheme 中设置
+    lv_style_init(&user_bubble_style_);
+    lv_style_set_align(&user_bubble_style_, LV_ALIGN_RIGHT_MID);
+    lv_style_set_x(&user_bubble_style_, -25);
+
+    lv_style_init(&assistant_bubble_style_);
+    lv_style_set_align(&assistant_bubble_style_, LV_ALIGN_LEFT_MID);
+
+    lv_style_init(&system_bubble_style_);
+    lv_style_set_align(&system_bubble_style_, LV_ALIGN_CENTER);
+}
+
+LcdDisplay::ChatBubble& LcdDisplay::AcquireChatBubble() {
+    if (chat_count_ == CHAT_BUBBLE_POOL_SIZE) {
+        // 复用最早的消息，移到列表末尾
+        auto& oldest = chat_bubbles_[chat_oldest_];
+        chat_oldest_ = (chat_oldest_ + 1) % CHAT_BUBBLE_POOL_SIZE;
+        if (chat_shown_from_ > 0) {
+            chat_shown_from_--;
+        }
+        lv_obj_move_to_index(oldest.row, -1);
+        return oldest;
+    }
+
+    auto& slot = GetChatBubble(chat_count_++);
+    if (slot.row == nullptr) {
+        slot.row = lv_obj_create(content_);
+        lv_obj_add_style(slot.row, &chat_row_style_, 0);
+
+        slot.bubble = lv_obj_create(slot.row);
+        lv_obj_add_style(slot.bubble, &chat_bubble_style_, 0);
+        lv_obj_set_scrollbar_mode(slot.bubble, LV_SCROLLBAR_MODE_OFF);
+
+        slot.label = lv_label_create(slot.bubble);
+        lv_label_set_long_mode(slot.label, LV_LABEL_LONG_WRAP);
+    }
+    return slot;
+}
+
+// 最新消息之上保留约两屏参与布局，更早的消息隐藏，新消息的排版只涉及这部分对象
+void LcdDisplay::HideOffscreenBubbles() {
+    lv_obj_update_layout(content_);
+    int32_t keep_height = lv_obj_get_content_height(content_) * 2;
+    int32_t pad_row = lv_obj_get_style_pad_row(content_, 0);
+
+    int32_t height = 0;
+    int first = chat_count_ - 1;
+    while (first > chat_shown_from_ && height < keep_height) {
+        first--;
+        height += lv_obj_get_height(GetChatBubble(first).row) + pad_row;
+    }
+    if (first == chat_shown_from_) {
         return;
     }
-    
-    //避免出现空的消息框
-    if(strlen(content) == 0) return;
-    
-    // 检查消息数量是否超过限制
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // 删除最早的消息（第一个子对象）
-        lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-        }
-        // Scroll to the last message immediately
-        if (last_child != nullptr) {
-            lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
-        }
+
+    int32_t removed = 0;
+    for (int i = chat_shown_from_; i < first; i++) {
+        auto row = GetChatBubble(i).row;
+        removed += lv_obj_get_height(row) + pad_row;
+        lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
     }
-    
-    // 折叠系统消息（如果是系统消息，检查最后一个消息是否也是系统消息）
-    if (strcmp(role, "system") == 0 && child_count > 0) {
-        // 获取最后一个消息容器
-        lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-        if (last_container != nullptr && lv_obj_get_child_cnt(last_container) > 0) {
-            // 获取容器内的气泡
-            lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-            if (last_bubble != nullptr) {
-                // 检查气泡类型是否为系统消息
-                void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                    // 如果最后一个消息也是系统消息，则删除它
-                    lv_obj_del(last_container);
-                }
-            }
-        }
+    chat_shown_from_ = first;
+
+    // 隐藏的消息都在可视区域之上，调整滚动位置使画面保持不变
+    lv_obj_update_layout(content_);
+    lv_obj_scroll_to_y(content_, std::max<int32_t>(lv_obj_get_scroll_y(content_) - removed, 0), LV_ANIM_OFF);
+}
+
+// 手动滚动接近顶部时，恢复约一屏更早的消息
+void LcdDisplay::RevealOlderBubbles() {
+    int32_t viewport = lv_obj_get_content_height(content_);
+    if (chat_shown_from_ == 0 || lv_obj_get_scroll_top(content_) >= viewport / 2) {
+        return;
     }
-    
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 1, 0);
-    lv_obj_set_style_border_color(msg_bubble, current_theme.border, 0);
-    lv_obj_set_style_pad_all(msg_bubble, 8, 0);
-
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
-    
-    // 计算文本实际宽度
-    lv_coord_t text_width = lv_txt_get_width(content, strlen(content), fonts_.text_font, 0);
 
-    // 计算气泡宽度
-    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 屏幕宽度的85%
-    lv_coord_t min_width = 20;  
-    lv_coord_t bubble_width;
-    
-    // 确保文本宽度不小于最小宽度
-    if (text_width < min_width) {
-        text_width = min_width;
+    int32_t pad_row = lv_obj_get_style_pad_row(content_, 0);
+    int32_t height = 0;
+    while (chat_shown_from_ > 0 && height < viewport) {
+        auto row = GetChatBubble(--chat_shown_from_).row;
+        lv_obj_remove_flag(row, LV_OBJ_FLAG_HIDDEN);
+        // 隐藏前已完成布局，高度仍然有效
+        height += lv_obj_get_height(row) + pad_row;
     }
 
-    // 如果文本宽度小于最大宽度，使用文本宽度
-    if (text_width < max_width) {
-        bubble_width = text_width; 
-    } else {
-        bubble_width = max_width;
+    lv_obj_update_layout(content_);
+    lv_obj_scroll_to_y(content_, lv_obj_get_scroll_y(content_) + height, LV_ANIM_OFF);
+}
+
+// 计算文本实际宽度，气泡最宽为屏幕宽度的 85%，超出时换行
+void LcdDisplay::FitChatLabel(lv_obj_t* label) {
+    const char* text = lv_label_get_text(label);
+    lv_coord_t text_width = lv_txt_get_width(text, strlen(text), fonts_.text_font, 0);
+    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;
+    lv_coord_t min_width = 20;
+    lv_obj_set_width(label, std::clamp(text_width, min_width, max_width));
+}
+
+// 调用方需持有显示锁
+LcdDisplay::ChatBubble& LcdDisplay::ShowChatMessage(lv_style_t* role_style, const char* content) {
+    // 折叠系统消息：最后一条也是系统消息时直接替换它的内容
+    ChatBubble* slot = nullptr;
+    if (role_style == &system_bubble_style_ && chat_count_ > 0) {
+        auto& last = GetChatBubble(chat_count_ - 1);
+        if (last.role_style == &system_bubble_style_) {
+            slot = &last;
+        }
+    }
+    if (slot == nullptr) {
+        slot = &AcquireChatBubble();
     }
-    
-    // 设置消息文本的宽度
-    lv_obj_set_width(msg_text, bubble_width);  // 减去padding
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
-    lv_obj_set_style_text_font(msg_text, fonts_.text_font, 0);
 
-    // 设置气泡宽度
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
+    if (slot->role_style != role_style) {
+        if (slot->role_style != nullptr) {
+            lv_obj_remove_style(slot->bubble, slot->role_style, 0);
+        }
+        lv_obj_add_style(slot->bubble, role_style, 0);
+        slot->role_style = role_style;
+    }
+    // 复用的槽位可能带有上一条字幕的后续段落
+    for (size_t i = 0; i < slot->more_used; i++) {
+        lv_obj_add_flag(slot->more_labels[i], LV_OBJ_FLAG_HIDDEN);
+    }
+    slot->more_used = 0;
 
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme.user_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme.text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme.assistant_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme.text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme.system_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme.system_text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
+    lv_label_set_text(slot->label, content);
+    FitChatLabel(slot->label);
+
+    lv_obj_remove_flag(slot->row, LV_OBJ_FLAG_HIDDEN);
+    HideOffscreenBubbles();
+
+    // Auto-scroll to the new message
+    lv_obj_scroll_to_view_recursive(slot->row, LV_ANIM_ON);
+
+    // Store reference to the latest message label
+    chat_message_label_ = slot->label;
+    return *slot;
+}
+
+void LcdDisplay::SetChatMessage(const char* role, const char* content) {
+    DisplayLockGuard lock(this);
+    if (content_ == nullptr) {
+        return;
     }
-    
-    // Create a full-width container for user messages to ensure right alignment
+
+    //避免出现空的消息框
+    if(strlen(content) == 0) return;
+
+    lv_style_t* role_style;
     if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
+        role_style = &user_bubble_style_;
     } else if (strcmp(role, "system") == 0) {
-        // 为系统消息创建全宽容器以确保居中对齐
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // 使容器透明且无边框
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // 将消息气泡移入此容器
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // 将气泡居中对齐在容器中
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        
-        // 自动滚动底部
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
+        role_style = &system_bubble_style_;
     } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
+        role_style = &assistant_bubble_style_;
+    }
+    // 其它消息插入后，之后的字幕另起一条消息
+    caption_ = nullptr;
+    ShowChatMessage(role_style, content);
+}
+
+void LcdDisplay::StartCaption() {
+    DisplayLockGuard lock(this);
+    caption_ = nullptr;
+}
 
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
+void LcdDisplay::AppendCaption(const char* text) {
+    DisplayLockGuard lock(this);
+    TRACE_SCOPE("caption_append");
+    if (content_ == nullptr || strlen(text) == 0) {
+        return;
     }
-    
-    // Store reference to the latest message label
-    chat_message_label_ = msg_text;
+    if (caption_ == nullptr) {
+        caption_ = &ShowChatMessage(&assistant_bubble_style_, text);
+        return;
+    }
+
+    // 追加到最后一段，段落已经足够长时另起一段，之前的段落不再重新排版
+    lv_obj_t* tail = caption_->more_used > 0 ? caption_->more_labels[caption_->more_used - 1] : caption_->label;
+    if (strlen(lv_label_get_text(tail)) + strlen(text) <= CAPTION_CHUNK_SIZE) {
+        lv_label_ins_text(tail, LV_LABEL_POS_LAST, text);
+        FitChatLabel(tail);
+    } else {
+        if (caption_->more_used == caption_->more_labels.size()) {
+            auto label = lv_label_create(caption_->bubble);
+            lv_label_set_long_mode(label, LV_LABEL_LONG_WRAP);
+            caption_->more_labels.push_back(label);
+        }
+        tail = caption_->more_labels[caption_->more_used++];
+        lv_obj_remove_flag(tail, LV_OBJ_FLAG_HIDDEN);
+        lv_label_set_text(tail, text);
+        FitChatLabel(tail);
+        HideOffscreenBubbles();
+    }
+
+    // 只在最后一段超出可视区域时滚动
+    lv_obj_scroll_to_view_recursive(tail, LV_ANIM_ON);
+    chat_message_label_ = tail;
 }
 #else
 void LcdDisplay::SetupUI() {
     DisplayLockGuard lock(this);
 
+    InitThemeStyles();
+
     auto screen = lv_screen_active();
     lv_obj_set_style_text_font(screen, fonts_.text_font, 0);
-    lv_obj_set_style_text_color(screen, current_theme.text, 0);
-    lv_obj_set_style_bg_color(screen, current_theme.background, 0);
+    lv_obj_add_style(screen, &screen_style_, 0);
 
     /* Container */
     container_ = lv_obj_create(screen);
@@ -569,15 +766,13 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_style_pad_all(container_, 0, 0);
     lv_obj_set_style_border_width(container_, 0, 0);
     lv_obj_set_style_pad_row(container_, 0, 0);
-    lv_obj_set_style_bg_color(container_, current_theme.background, 0);
-    lv_obj_set_style_border_color(container_, current_theme.border, 0);
+    lv_obj_add_style(container_, &container_style_, 0);
 
     /* Status bar */
     status_bar_ = lv_obj_create(container_);
     lv_obj_set_size(status_bar_, LV_HOR_RES, fonts_.text_font->line_height);
     lv_obj_set_style_radius(status_bar_, 0, 0);
-    lv_obj_set_style_bg_color(status_bar_, current_theme.background, 0);
-    lv_obj_set_style_text_color(status_bar_, current_theme.text, 0);
+    lv_obj_add_style(status_bar_, &status_bar_style_, 0);
     
     /* Content */
     content_ = lv_obj_create(container_);
@@ -586,15 +781,13 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_width(content_, LV_HOR_RES);
     lv_obj_set_flex_grow(content_, 1);
     lv_obj_set_style_pad_all(content_, 5, 0);
-    lv_obj_set_style_bg_color(content_, current_theme.chat_background, 0);
-    lv_obj_set_style_border_color(content_, current_theme.border, 0); // Border color for content
+    lv_obj_add_style(content_, &content_style_, 0);
 
     lv_obj_set_flex_flow(content_, LV_FLEX_FLOW_COLUMN); // 垂直布局（从上到下）
     lv_obj_set_flex_align(content_, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_SPACE_EVENLY); // 子对象居中对齐，等距分布
 
     emotion_label_ = lv_label_create(content_);
     lv_obj_set_style_text_font(emotion_label_, &font_awesome_30_4, 0);
-    lv_obj_set_style_text_color(emotion_label_, current_theme.text, 0);
     lv_label_set_text(emotion_label_, FONT_AWESOME_AI_CHIP);
 
     chat_message_label_ = lv_label_create(content_);
@@ -602,7 +795,6 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_width(chat_message_label_, LV_HOR_RES * 0.9); // 限制宽度为屏幕宽度的 90%
     lv_label_set_long_mode(chat_message_label_, LV_LABEL_LONG_WRAP); // 设置为自动换行模式
     lv_obj_set_style_text_align(chat_message_label_, LV_TEXT_ALIGN_CENTER, 0); // 设置文本居中对齐
-    lv_obj_set_style_text_color(chat_message_label_, current_theme.text, 0);
 
     /* Status bar */
     lv_obj_set_flex_flow(status_bar_, LV_FLEX_FLOW_ROW);
@@ -615,12 +807,10 @@ void LcdDisplay::SetupUI() {
     network_label_ = lv_label_create(status_bar_);
     lv_label_set_text(network_label_, "");
     lv_obj_set_style_text_font(network_label_, fonts_.icon_font, 0);
-    lv_obj_set_style_text_color(network_label_, current_theme.text, 0);
 
     notification_label_ = lv_label_create(status_bar_);
     lv_obj_set_flex_grow(notification_label_, 1);
     lv_obj_set_style_text_align(notification_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(notification_label_, current_theme.text, 0);
     lv_label_set_text(notification_label_, "");
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
@@ -628,23 +818,20 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_flex_grow(status_label_, 1);
     lv_label_set_long_mode(status_label_, LV_LABEL_LONG_SCROLL_CIRCULAR);
     lv_obj_set_style_text_align(status_label_, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_style_text_color(status_label_, current_theme.text, 0);
     lv_label_set_text(status_label_, Lang::Strings::INITIALIZING);
     mute_label_ = lv_label_create(status_bar_);
     lv_label_set_text(mute_label_, "");
     lv_obj_set_style_text_font(mute_label_, fonts_.icon_font, 0);
-    lv_obj_set_style_text_color(mute_label_, current_theme.text, 0);
 
     battery_label_ = lv_label_create(status_bar_);
     lv_label_set_text(battery_label_, "");
     lv_obj_set_style_text_font(battery_label_, fonts_.icon_font, 0);
-    lv_obj_set_style_text_color(battery_label_, current_theme.text, 0);
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
     lv_obj_set_size(low_battery_popup_, LV_HOR_RES * 0.9, fonts_.text_font->line_height * 2);
     lv_obj_align(low_battery_popup_, LV_ALIGN_BOTTOM_MID, 0, 0);
-    lv_obj_set_style_bg_color(low_battery_popup_, current_theme.low_battery, 0);
+    lv_obj_add_style(low_battery_popup_, &low_battery_style_, 0);
     lv_obj_set_style_radius(low_battery_popup_, 10, 0);
     low_battery_label_ = lv_label_create(low_battery_popup_);
     lv_label_set_text(low_battery_label_, Lang::Strings::BATTERY_NEED_CHARGE);
@@ -713,194 +900,19 @@ void LcdDisplay::SetIcon(const char* icon) {
 }
 
 void LcdDisplay::SetTheme(const std::string& theme_name) {
-    DisplayLockGuard lock(this);
-    
-    if (theme_name == "dark" || theme_name == "DARK") {
-        current_theme = DARK_THEME;
-    } else if (theme_name == "light" || theme_name == "LIGHT") {
-        current_theme = LIGHT_THEME;
-    } else {
-        // Invalid theme name, return false
+    auto colors = Themes::GetInstance().Find(theme_name);
+    if (colors == nullptr) {
         ESP_LOGE(TAG, "Invalid theme name: %s", theme_name.c_str());
         return;
     }
-    
-    // Get the active screen
-    lv_obj_t* screen = lv_screen_active();
-    
-    // Update the screen colors
-    lv_obj_set_style_bg_color(screen, current_theme.background, 0);
-    lv_obj_set_style_text_color(screen, current_theme.text, 0);
-    
-    // Update container colors
-    if (container_ != nullptr) {
-        lv_obj_set_style_bg_color(container_, current_theme.background, 0);
-        lv_obj_set_style_border_color(container_, current_theme.border, 0);
-    }
-    
-    // Update status bar colors
-    if (status_bar_ != nullptr) {
-        lv_obj_set_style_bg_color(status_bar_, current_theme.background, 0);
-        lv_obj_set_style_text_color(status_bar_, current_theme.text, 0);
-        
-        // Update status bar elements
-        if (network_label_ != nullptr) {
-            lv_obj_set_style_text_color(network_label_, current_theme.text, 0);
-        }
-        if (status_label_ != nullptr) {
-            lv_obj_set_style_text_color(status_label_, current_theme.text, 0);
-        }
-        if (notification_label_ != nullptr) {
-            lv_obj_set_style_text_color(notification_label_, current_theme.text, 0);
-        }
-        if (mute_label_ != nullptr) {
-            lv_obj_set_style_text_color(mute_label_, current_theme.text, 0);
-        }
-        if (battery_label_ != nullptr) {
-            lv_obj_set_style_text_color(battery_label_, current_theme.text, 0);
-        }
-        if (emotion_label_ != nullptr) {
-            lv_obj_set_style_text_color(emotion_label_, current_theme.text, 0);
-        }
-    }
-    
-    // Update content area colors
-    if (content_ != nullptr) {
-        lv_obj_set_style_bg_color(content_, current_theme.chat_background, 0);
-        lv_obj_set_style_border_color(content_, current_theme.border, 0);
-        
-        // If we have the chat message style, update all message bubbles
-#if CONFIG_USE_WECHAT_MESSAGE_STYLE
-        // Iterate through all children of content (message containers or bubbles)
-        uint32_t child_count = lv_obj_get_child_cnt(content_);
-        for (uint32_t i = 0; i < child_count; i++) {
-            lv_obj_t* obj = lv_obj_get_child(content_, i);
-            if (obj == nullptr) continue;
-            
-            lv_obj_t* bubble = nullptr;
-            
-            // 检查这个对象是容器还是气泡
-            // 如果是容器（用户或系统消息），则获取其子对象作为气泡
-            // 如果是气泡（助手消息），则直接使用
-            if (lv_obj_get_child_cnt(obj) > 0) {
-                // 可能是容器，检查它是否为用户或系统消息容器
-                // 用户和系统消息容器是透明的
-                lv_opa_t bg_opa = lv_obj_get_style_bg_opa(obj, 0);
-                if (bg_opa == LV_OPA_TRANSP) {
-                    // 这是用户或系统消息的容器
-                    bubble = lv_obj_get_child(obj, 0);
-                } else {
-                    // 这可能是助手消息的气泡自身
-                    bubble = obj;
-                }
-            } else {
-                // 没有子元素，可能是其他UI元素，跳过
-                continue;
-            }
-            
-            if (bubble == nullptr) continue;
-            
-            // 使用保存的用户数据来识别气泡类型
-            void* bubble_type_ptr = lv_obj_get_user_data(bubble);
-            if (bubble_type_ptr != nullptr) {
-                const char* bubble_type = static_cast<const char*>(bubble_type_ptr);
-                
-                // 根据气泡类型应用正确的颜色
-                if (strcmp(bubble_type, "user") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme.user_bubble, 0);
-                } else if (strcmp(bubble_type, "assistant") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme.assistant_bubble, 0); 
-                } else if (strcmp(bubble_type, "system") == 0) {
-                    lv_obj_set_style_bg_color(bubble, current_theme.system_bubble, 0);
-                }
-                
-                // Update border color
-                lv_obj_set_style_border_color(bubble, current_theme.border, 0);
-                
-                // Update text color for the message
-                if (lv_obj_get_child_cnt(bubble) > 0) {
-                    lv_obj_t* text = lv_obj_get_child(bubble, 0);
-                    if (text != nullptr) {
-                        // 根据气泡类型设置文本颜色
-                        if (strcmp(bubble_type, "system") == 0) {
-                            lv_obj_set_style_text_color(text, current_theme.system_text, 0);
-                        } else {
-                            lv_obj_set_style_text_color(text, current_theme.text, 0);
-                        }
-                    }
-                }
-            } else {
-                // 如果没有标记，回退到之前的逻辑（颜色比较）
-                // ...保留原有的回退逻辑...
-                lv_color_t bg_color = lv_obj_get_style_bg_color(bubble, 0);
-            
-                // 改进bubble类型检测逻辑，不仅使用颜色比较
-                bool is_user_bubble = false;
-                bool is_assistant_bubble = false;
-                bool is_system_bubble = false;
-            
-                // 检查用户bubble
-                if (lv_color_eq(bg_color, DARK_USER_BUBBLE_COLOR) || 
-                    lv_color_eq(bg_color, LIGHT_USER_BUBBLE_COLOR) ||
-                    lv_color_eq(bg_color, current_theme.user_bubble)) {
-                    is_user_bubble = true;
-                }
-                // 检查系统bubble
-                else if (lv_color_eq(bg_color, DARK_SYSTEM_BUBBLE_COLOR) || 
-                         lv_color_eq(bg_color, LIGHT_SYSTEM_BUBBLE_COLOR) ||
-                         lv_color_eq(bg_color, current_theme.system_bubble)) {
-                    is_system_bubble = true;
-                }
-                // 剩余的都当作助手bubble处理
-                else {
-                    is_assistant_bubble = true;
-                }
-            
-                // 根据bubble类型应用正确的颜色
-                if (is_user_bubble) {
-                    lv_obj_set_style_bg_color(bubble, current_theme.user_bubble, 0);
-                } else if (is_assistant_bubble) {
-                    lv_obj_set_style_bg_color(bubble, current_theme.assistant_bubble, 0);
-                } else if (is_system_bubble) {
-                    lv_obj_set_style_bg_color(bubble, current_theme.system_bubble, 0);
-                }
-                
-                // Update border color
-                lv_obj_set_style_border_color(bubble, current_theme.border, 0);
-                
-                // Update text color for the message
-                if (lv_obj_get_child_cnt(bubble) > 0) {
-                    lv_obj_t* text = lv_obj_get_child(bubble, 0);
-                    if (text != nullptr) {
-                        // 回退到颜色检测逻辑
-                        if (lv_color_eq(bg_color, current_theme.system_bubble) ||
-                            lv_color_eq(bg_color, DARK_SYSTEM_BUBBLE_COLOR) || 
-                            lv_color_eq(bg_color, LIGHT_SYSTEM_BUBBLE_COLOR)) {
-                            lv_obj_set_style_text_color(text, current_theme.system_text, 0);
-                        } else {
-                            lv_obj_set_style_text_color(text, current_theme.text, 0);
-                        }
-                    }
-                }
-            }
-        }
-#else
-        // Simple UI mode - just update the main chat message
-        if (chat_message_label_ != nullptr) {
-            lv_obj_set_style_text_color(chat_message_label_, current_theme.text, 0);
-        }
-        
-        if (emotion_label_ != nullptr) {
-            lv_obj_set_style_text_color(emotion_label_, current_theme.text, 0);
-        }
-#endif
-    }
-    
-    // Update low battery popup
-    if (low_battery_popup_ != nullptr) {
-        lv_obj_set_style_bg_color(low_battery_popup_, current_theme.low_battery, 0);
+
+    {
+        DisplayLockGuard lock(this);
+        ApplyTheme(*colors);
+        // 所有控件引用共享样式，通知一次即可全部刷新，耗时与控件和聊天记录的数量无关
+        lv_obj_report_style_change(nullptr);
     }
 
-    // No errors occurred. Save theme to settings
+    // Save theme to settings
     Display::SetTheme(theme_name);
 }
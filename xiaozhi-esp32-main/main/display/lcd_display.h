@@ -2,12 +2,37 @@
 #define LCD_DISPLAY_H
 
 #include "display.h"
+#include "theme.h"
 
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
 #include <font_emoji.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include <atomic>
+#include <vector>
+
+// 聊天记录最多保留的消息数量，气泡对象循环复用
+#define CHAT_BUBBLE_POOL_SIZE 20
+// 字幕每段的最大字节数，追加字幕时只重新排版最后一段
+#define CAPTION_CHUNK_SIZE 128
+// 绘制缓冲区的默认行数
+#define LCD_DEFAULT_BUFFER_LINES 20
+
+// 绘制缓冲区模式，由板子在 config.h 中选择
+enum DisplayBufferMode {
+    kDisplayBufferSingle,       // 一块内部 DMA 缓冲区，渲染和传输交替进行
+    kDisplayBufferDouble,       // 两块内部 DMA 缓冲区，渲染下一块的同时传输上一块
+    kDisplayBufferPsram,        // 两块 PSRAM 缓冲区，经两块内部 DMA 中转缓冲区分段传输
+};
+
+struct DisplayBufferConfig {
+    DisplayBufferMode mode = kDisplayBufferSingle;
+    int lines = LCD_DEFAULT_BUFFER_LINES;   // 每块绘制缓冲区的行数
+    int bounce_lines = 10;                  // PSRAM 模式下每块中转缓冲区的行数
+    bool merge_rows = false;                // 脏区域扩展为整行，同一行带内的更新合并为一次连续传输
+};
 
 class LcdDisplay : public Display {
 protected:
@@ -22,6 +47,68 @@ protected:
 
     DisplayFonts fonts_;
 
+    // 与主题相关的颜色都放在共享样式中，控件不设置本地颜色，标签继承父对象的文字颜色
+    lv_style_t screen_style_;
+    lv_style_t container_style_;
+    lv_style_t status_bar_style_;
+    lv_style_t content_style_;
+    lv_style_t low_battery_style_;
+
+    void InitThemeStyles();
+    void ApplyTheme(const ThemeColors& colors);
+
+#if CONFIG_USE_DISPLAY_RENDER_STATS
+    struct RenderStats {
+        int64_t period_start_us = 0;
+        int64_t refresh_start_us = 0;
+        int64_t wait_start_us = 0;
+        int64_t refresh_wait_us = 0;    // 本次刷新中等待传输完成的时间
+        bool flushed = false;
+        uint32_t frames = 0;
+        int64_t busy_us = 0;
+        int64_t wait_us = 0;
+        uint64_t pixels = 0;
+    } render_stats_;
+
+    void UpdateRenderStats(lv_event_code_t code, void* param);
+#endif
+    // 启用刷新统计时定期输出帧率和每帧耗时，需在创建 display_ 之后调用
+    void ReportRendering();
+
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    // 每条消息占用一个槽位，第一次使用时创建，之后只更换文字和样式，不再创建和删除对象
+    struct ChatBubble {
+        lv_obj_t* row = nullptr;        // 全宽透明容器，气泡在其中按角色对齐
+        lv_obj_t* bubble = nullptr;
+        lv_obj_t* label = nullptr;
+        lv_style_t* role_style = nullptr;
+        // 流式字幕的后续段落，槽位复用时隐藏而不删除
+        std::vector<lv_obj_t*> more_labels;
+        size_t more_used = 0;
+    };
+    ChatBubble chat_bubbles_[CHAT_BUBBLE_POOL_SIZE];
+    int chat_oldest_ = 0;           // 最早一条消息所在的槽位
+    int chat_count_ = 0;
+    int chat_shown_from_ = 0;       // 按时间顺序，之前的消息远离可视区域，已隐藏且不参与布局
+    ChatBubble* caption_ = nullptr; // 正在追加字幕的助手消息
+
+    // 所有气泡共用的样式，主题切换时只需修改样式本身
+    lv_style_t chat_row_style_;
+    lv_style_t chat_bubble_style_;
+    lv_style_t user_bubble_style_;
+    lv_style_t assistant_bubble_style_;
+    lv_style_t system_bubble_style_;
+
+    void InitChatStyles();
+    // 按时间顺序取消息，0 为最早的一条
+    ChatBubble& GetChatBubble(int index) { return chat_bubbles_[(chat_oldest_ + index) % CHAT_BUBBLE_POOL_SIZE]; }
+    ChatBubble& AcquireChatBubble();
+    ChatBubble& ShowChatMessage(lv_style_t* role_style, const char* content);
+    void FitChatLabel(lv_obj_t* label);
+    void HideOffscreenBubbles();
+    void RevealOlderBubbles();
+#endif
+
     void SetupUI();
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
@@ -37,6 +124,8 @@ public:
     virtual void SetIcon(const char* icon) override;
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
     virtual void SetChatMessage(const char* role, const char* content) override; 
+    virtual void StartCaption() override;
+    virtual void AppendCaption(const char* text) override;
 #endif  
 
     // Add theme switching function
@@ -63,20 +152,34 @@ public:
 
 // // SPI LCD显示器
 class SpiLcdDisplay : public LcdDisplay {
+private:
+    DisplayBufferConfig buffer_config_;
+    // PSRAM 模式的中转缓冲区，轮流使用，传输完成时在中断中归还
+    uint16_t* bounce_buffers_[2] = {nullptr, nullptr};
+    size_t bounce_pixels_ = 0;
+    SemaphoreHandle_t bounce_free_ = nullptr;
+    std::atomic<int> pending_chunks_{0};
+    // display 的 user_data 存放 esp_lvgl_port 的 lvgl_port_display_ctx_t，不能占用
+    // 每块板只有一块屏，flush 回调通过静态指针找到本对象
+    static SpiLcdDisplay* bounce_display_;
+
+    bool InitBounceBuffers();
+    void FlushBounce(const lv_area_t* area, uint8_t* px_map);
+    static bool OnBounceTransferDone(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t* edata, void* user_ctx);
+
 public:
     SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                   int width, int height, int offset_x, int offset_y,
                   bool mirror_x, bool mirror_y, bool swap_xy,
-                  DisplayFonts fonts);
+                  DisplayFonts fonts, DisplayBufferConfig buffer_config = {});
+    ~SpiLcdDisplay();
 };
 
 // QSPI LCD显示器
-class QspiLcdDisplay : public LcdDisplay {
+// QSPI 面板同样通过 esp_lcd_new_panel_io_spi 创建，送显路径与 SPI 相同，绘制缓冲区配置 (DisplayBufferConfig) 同样适用
+class QspiLcdDisplay : public SpiLcdDisplay {
 public:
-    QspiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
-                   int width, int height, int offset_x, int offset_y,
-                   bool mirror_x, bool mirror_y, bool swap_xy,
-                   DisplayFonts fonts);
+    using SpiLcdDisplay::SpiLcdDisplay;
 };
 
 // MCU8080 LCD显示器
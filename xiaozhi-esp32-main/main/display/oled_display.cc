@@ -55,6 +55,7 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+    TraceRendering();
 
     if (height_ == 64) {
         SetupUI_128x64();
@@ -0,0 +1,81 @@
+#include "theme.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <cstdlib>
+#include <strings.h>
+
+#define TAG "Themes"
+
+extern const char themes_json_start[] asm("_binary_themes_json_start");
+
+// 解析 "#RRGGBB" 格式的颜色
+static bool ParseColor(const cJSON* theme, const char* key, lv_color_t& color) {
+    auto item = cJSON_GetObjectItem(theme, key);
+    if (!cJSON_IsString(item) || item->valuestring[0] != '#') {
+        ESP_LOGE(TAG, "Invalid color %s in theme %s", key, theme->string);
+        return false;
+    }
+    color = lv_color_hex(strtoul(item->valuestring + 1, nullptr, 16));
+    return true;
+}
+
+Themes::Themes() {
+    auto root = cJSON_Parse(themes_json_start);
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Failed to parse themes");
+    }
+
+    cJSON* theme = nullptr;
+    cJSON_ArrayForEach(theme, root) {
+        ThemeColors colors;
+        if (ParseColor(theme, "background", colors.background) &&
+            ParseColor(theme, "text", colors.text) &&
+            ParseColor(theme, "chat_background", colors.chat_background) &&
+            ParseColor(theme, "user_bubble", colors.user_bubble) &&
+            ParseColor(theme, "assistant_bubble", colors.assistant_bubble) &&
+            ParseColor(theme, "system_bubble", colors.system_bubble) &&
+            ParseColor(theme, "system_text", colors.system_text) &&
+            ParseColor(theme, "border", colors.border) &&
+            ParseColor(theme, "low_battery", colors.low_battery)) {
+            themes_.push_back({theme->string, colors});
+        }
+    }
+    cJSON_Delete(root);
+
+    if (themes_.empty()) {
+        // 至少保留默认的浅色主题
+        themes_.push_back({"light", {
+            .background = lv_color_white(),
+            .text = lv_color_black(),
+            .chat_background = lv_color_hex(0xE0E0E0),
+            .user_bubble = lv_color_hex(0x95EC69),
+            .assistant_bubble = lv_color_white(),
+            .system_bubble = lv_color_hex(0xE0E0E0),
+            .system_text = lv_color_hex(0x666666),
+            .border = lv_color_hex(0xE0E0E0),
+            .low_battery = lv_color_black(),
+        }});
+    }
+    ESP_LOGI(TAG, "Loaded %u themes: %s", themes_.size(), GetNames().c_str());
+}
+
+const ThemeColors* Themes::Find(const std::string& name) const {
+    for (auto& theme : themes_) {
+        if (strcasecmp(theme.name.c_str(), name.c_str()) == 0) {
+            return &theme.colors;
+        }
+    }
+    return nullptr;
+}
+
+std::string Themes::GetNames() const {
+    std::string names;
+    for (auto& theme : themes_) {
+        if (!names.empty()) {
+            names += ", ";
+        }
+        names += theme.name;
+    }
+    return names;
+}
@@ -0,0 +1,52 @@
+#ifndef THEME_H
+#define THEME_H
+
+#include <lvgl.h>
+#include <string>
+#include <vector>
+
+// 主题颜色，每个主题一组
+struct ThemeColors {
+    lv_color_t background;
+    lv_color_t text;
+    lv_color_t chat_background;
+    lv_color_t user_bubble;
+    lv_color_t assistant_bubble;
+    lv_color_t system_bubble;
+    lv_color_t system_text;
+    lv_color_t border;
+    lv_color_t low_battery;
+};
+
+/*
+ * 主题定义在 assets/common/themes.json 中，编译时嵌入固件，第一次使用时解析
+ * 增加主题只需在文件中添加一组颜色，不需要修改代码
+ */
+class Themes {
+public:
+    static Themes& GetInstance() {
+        static Themes instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    Themes(const Themes&) = delete;
+    Themes& operator=(const Themes&) = delete;
+
+    // 找不到时返回 nullptr
+    const ThemeColors* Find(const std::string& name) const;
+    // 名称无效时使用的主题，即文件中的第一个主题
+    const ThemeColors& GetDefault() const { return themes_.front().colors; }
+    // 所有主题名称，以逗号分隔
+    std::string GetNames() const;
+
+private:
+    Themes();
+
+    struct Theme {
+        std::string name;
+        ThemeColors colors;
+    };
+    std::vector<Theme> themes_;
+};
+
+#endif // THEME_H
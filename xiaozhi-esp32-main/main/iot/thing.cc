@@ -37,11 +37,22 @@ std::string Thing::GetDescriptorJson() {
 }
 
 std::string Thing::GetStateJson() {
-    std::string json_str = "{";
-    json_str += "\"name\":\"" + name_ + "\",";
-    json_str += "\"state\":" + properties_.GetStateJson();
-    json_str += "}";
-    return json_str;
+    std::string json;
+    AppendStateJson(json, false);
+    return json;
+}
+
+bool Thing::AppendStateJson(std::string& json, bool delta) {
+    size_t start = json.size();
+    json += "{\"name\":\"";
+    json += name_;
+    json += "\",\"state\":";
+    if (properties_.AppendStateJson(json, delta) == 0 && delta) {
+        json.resize(start);
+        return false;
+    }
+    json += '}';
+    return true;
 }
 
 void Thing::Invoke(const cJSON* command) {
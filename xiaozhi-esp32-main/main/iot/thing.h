@@ -6,6 +6,7 @@
 #include <functional>
 #include <vector>
 #include <stdexcept>
+#include <cstdio>
 #include <cJSON.h>
 
 namespace iot {
@@ -55,16 +56,57 @@ public:
         return json_str;
     }
 
-    std::string GetStateJson() {
+    // 读取当前值并与上次读取的值比较，返回是否有变化，首次读取总是视为变化
+    bool Update() {
+        bool changed = !has_value_;
+        has_value_ = true;
         if (type_ == kValueTypeBoolean) {
-            return boolean_getter_() ? "true" : "false";
+            bool value = boolean_getter_();
+            changed = changed || value != boolean_value_;
+            boolean_value_ = value;
         } else if (type_ == kValueTypeNumber) {
-            return std::to_string(number_getter_());
+            int value = number_getter_();
+            changed = changed || value != number_value_;
+            number_value_ = value;
         } else if (type_ == kValueTypeString) {
-            return "\"" + string_getter_() + "\"";
+            std::string value = string_getter_();
+            if (changed || value != string_value_) {
+                changed = true;
+                string_value_.swap(value);
+            }
         }
-        return "null";
+        return changed;
     }
+
+    // 追加最近一次 Update() 读取到的值
+    void AppendStateJson(std::string& json) const {
+        if (type_ == kValueTypeBoolean) {
+            json += boolean_value_ ? "true" : "false";
+        } else if (type_ == kValueTypeNumber) {
+            char buffer[12];
+            json.append(buffer, snprintf(buffer, sizeof(buffer), "%d", number_value_));
+        } else if (type_ == kValueTypeString) {
+            json += '"';
+            json += string_value_;
+            json += '"';
+        } else {
+            json += "null";
+        }
+    }
+
+    std::string GetStateJson() {
+        std::string json;
+        Update();
+        AppendStateJson(json);
+        return json;
+    }
+
+private:
+    // 上次读取的值，用于判断属性是否变化
+    bool has_value_ = false;
+    bool boolean_value_ = false;
+    int number_value_ = 0;
+    std::string string_value_;
 };
 
 class PropertyList {
@@ -106,16 +148,30 @@ public:
         return json_str;
     }
 
-    std::string GetStateJson() {
-        std::string json_str = "{";
+    // 追加 {"属性名":值,...}，delta 为 true 时只包含有变化的属性，返回包含的属性个数
+    int AppendStateJson(std::string& json, bool delta) {
+        int count = 0;
+        json += '{';
         for (auto& property : properties_) {
-            json_str += "\"" + property.name() + "\":" + property.GetStateJson() + ",";
-        }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+            if (!property.Update() && delta) {
+                continue;
+            }
+            if (count++ > 0) {
+                json += ',';
+            }
+            json += '"';
+            json += property.name();
+            json += "\":";
+            property.AppendStateJson(json);
         }
-        json_str += "}";
-        return json_str;
+        json += '}';
+        return count;
+    }
+
+    std::string GetStateJson() {
+        std::string json;
+        AppendStateJson(json, false);
+        return json;
     }
 };
 
@@ -268,6 +324,8 @@ public:
 
     virtual std::string GetDescriptorJson();
     virtual std::string GetStateJson();
+    // 追加状态 JSON，delta 为 true 且没有属性变化时不追加并返回 false
+    virtual bool AppendStateJson(std::string& json, bool delta);
     virtual void Invoke(const cJSON* command);
 
     const std::string& name() const { return name_; }
@@ -1,19 +1,25 @@
 #include "thing_manager.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+#include <algorithm>
 
 #define TAG "ThingManager"
 
 namespace iot {
 
 void ThingManager::AddThing(Thing* thing) {
+    std::lock_guard<std::mutex> lock(mutex_);
     things_.push_back(thing);
+    descriptors_.clear();
+    descriptors_digest_.clear();
 }
 
 std::string ThingManager::GetDescriptorsJson() {
     std::string json_str = "[";
-    for (auto& thing : things_) {
-        json_str += thing->GetDescriptorJson() + ",";
+    for (auto& descriptor : GetDescriptorJsonList()) {
+        json_str += descriptor + ",";
     }
     if (json_str.back() == ',') {
         json_str.pop_back();
@@ -22,31 +28,69 @@ std::string ThingManager::GetDescriptorsJson() {
     return json_str;
 }
 
-bool ThingManager::GetStatesJson(std::string& json, bool delta) {
-    if (!delta) {
-        last_states_.clear();
+const std::vector<std::string>& ThingManager::GetDescriptorJsonList() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (descriptors_.empty() && !things_.empty()) {
+        BuildDescriptors();
+    }
+    return descriptors_;
+}
+
+const std::string& ThingManager::GetDescriptorsDigest() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (descriptors_.empty() && !things_.empty()) {
+        BuildDescriptors();
+    }
+    return descriptors_digest_;
+}
+
+// 调用方需持有 mutex_
+void ThingManager::BuildDescriptors() {
+    auto start_time = esp_timer_get_time();
+    size_t total_size = 0;
+    mbedtls_sha256_context sha256;
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    for (auto& thing : things_) {
+        descriptors_.push_back(thing->GetDescriptorJson());
+        auto& descriptor = descriptors_.back();
+        mbedtls_sha256_update(&sha256, (const unsigned char*)descriptor.data(), descriptor.size() + 1);
+        total_size += descriptor.size();
+    }
+    unsigned char hash[32];
+    mbedtls_sha256_finish(&sha256, hash);
+    mbedtls_sha256_free(&sha256);
+
+    // 取前 8 字节，足以区分不同固件的描述符
+    char hex[17];
+    for (int i = 0; i < 8; i++) {
+        snprintf(hex + i * 2, 3, "%02x", hash[i]);
     }
+    descriptors_digest_ = hex;
+    ESP_LOGI(TAG, "Serialized %u descriptors (%u bytes) in %lld us, digest: %s", descriptors_.size(), total_size,
+        esp_timer_get_time() - start_time, descriptors_digest_.c_str());
+}
+
+bool ThingManager::GetStatesJson(std::string& json, bool delta) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 每个属性缓存上次读取的值，delta 为 true 时只序列化有变化的属性
     bool changed = false;
-    json = "[";
-    // 枚举thing，获取每个thing的state，如果发生变化，则更新，保存到last_states_
-    // 如果delta为true，则只返回变化的部分
+    json.clear();
+    json.reserve(last_states_size_);
+    json += '[';
     for (auto& thing : things_) {
-        std::string state = thing->GetStateJson();
-        if (delta) {
-            // 如果delta为true，则只返回变化的部分
-            auto it = last_states_.find(thing->name());
-            if (it != last_states_.end() && it->second == state) {
-                continue;
-            }
+        size_t start = json.size();
+        if (changed) {
+            json += ',';
+        }
+        if (thing->AppendStateJson(json, delta)) {
             changed = true;
-            last_states_[thing->name()] = state;
+        } else {
+            json.resize(start);
         }
-        json += state + ",";
-    }
-    if (json.back() == ',') {
-        json.pop_back();
     }
-    json += "]";
+    json += ']';
+    last_states_size_ = std::max(last_states_size_, json.size());
     return changed;
 }
 
@@ -10,6 +10,7 @@
 #include <memory>
 #include <functional>
 #include <map>
+#include <mutex>
 
 namespace iot {
 
@@ -25,6 +26,10 @@ public:
     void AddThing(Thing* thing);
 
     std::string GetDescriptorsJson();
+    // 描述符在运行期间不变，首次调用时逐个序列化并缓存
+    const std::vector<std::string>& GetDescriptorJsonList();
+    // 全部描述符的摘要，服务器据此判断是否需要重新接收描述符
+    const std::string& GetDescriptorsDigest();
     bool GetStatesJson(std::string& json, bool delta = false);
     void Invoke(const cJSON* command);
 
@@ -32,8 +37,13 @@ private:
     ThingManager() = default;
     ~ThingManager() = default;
 
+    std::mutex mutex_;
     std::vector<Thing*> things_;
-    std::map<std::string, std::string> last_states_;
+    size_t last_states_size_ = 0;
+    std::vector<std::string> descriptors_;
+    std::string descriptors_digest_;
+
+    void BuildDescriptors();
 };
 
 
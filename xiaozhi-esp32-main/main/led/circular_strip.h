@@ -37,7 +37,7 @@ private:
     std::vector<StripColor> colors_;
     int blink_counter_ = 0;
     int blink_interval_ms_ = 0;
-    esp_timer_handle_t strip_timer_ = nullptr;
+    int strip_timer_ = -1;
     std::function<void()> strip_callback_ = nullptr;
 
     uint8_t default_brightness_ = DEFAULT_BRIGHTNESS;
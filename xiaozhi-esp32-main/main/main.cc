@@ -7,6 +7,7 @@
 
 #include "application.h"
 #include "system_info.h"
+#include "trace_recorder.h"
 
 #define TAG "main"
 
@@ -24,6 +25,11 @@ extern "C" void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+#if CONFIG_USE_TRACE_PROFILER
+    // 在创建 Application 之前启动，覆盖完整的启动过程
+    TraceRecorder::GetInstance().Start(CONFIG_TRACE_BUFFER_KB * 1024);
+#endif
+
     // Launch the application
     Application::GetInstance().Start();
 }
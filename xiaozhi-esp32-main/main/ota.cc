@@ -23,6 +23,9 @@
 
 
 Ota::Ota() {
+    // 后台检查版本时主循环可能同时读取，只在这里赋值
+    current_version_ = esp_app_get_description()->version;
+
     {
         Settings settings("wifi", false);
         check_version_url_ = settings.GetString("ota_url");
@@ -46,6 +49,8 @@ Ota::Ota() {
 }
 
 Ota::~Ota() {
+    cJSON_Delete(mqtt_config_);
+    cJSON_Delete(websocket_config_);
 }
 
 void Ota::SetHeader(const std::string& key, const std::string& value) {
@@ -73,10 +78,8 @@ Http* Ota::SetupHttp() {
 
 bool Ota::CheckVersion() {
     auto& board = Board::GetInstance();
-    auto app_desc = esp_app_get_description();
 
     // Check if there is a new firmware version available
-    current_version_ = app_desc->version;
     ESP_LOGI(TAG, "Current version: %s", current_version_.c_str());
 
     if (check_version_url_.length() < 10) {
@@ -131,40 +134,32 @@ bool Ota::CheckVersion() {
         }
     }
 
-    has_mqtt_config_ = false;
+    // 协议可能正在使用 NVS 中的配置，这里只记录，由 SaveServerConfig 在协议停止或创建之前写入
     cJSON *mqtt = cJSON_GetObjectItem(root, "mqtt");
-    if (mqtt != NULL) {
-        Settings settings("mqtt", true);
-        cJSON *item = NULL;
-        cJSON_ArrayForEach(item, mqtt) {
-            if (item->type == cJSON_String) {
-                if (settings.GetString(item->string) != item->valuestring) {
-                    settings.SetString(item->string, item->valuestring);
-                }
-            }
-        }
-        has_mqtt_config_ = true;
-    } else {
+    cJSON_Delete(mqtt_config_);
+    mqtt_config_ = mqtt != NULL ? cJSON_Duplicate(mqtt, true) : NULL;
+    has_mqtt_config_ = mqtt != NULL;
+    if (mqtt == NULL) {
         ESP_LOGI(TAG, "No mqtt section found !");
     }
 
-    has_websocket_config_ = false;
     cJSON *websocket = cJSON_GetObjectItem(root, "websocket");
-    if (websocket != NULL) {
-        Settings settings("websocket", true);
-        cJSON *item = NULL;
-        cJSON_ArrayForEach(item, websocket) {
-            if (item->type == cJSON_String) {
-                settings.SetString(item->string, item->valuestring);
-            } else if (item->type == cJSON_Number) {
-                settings.SetInt(item->string, item->valueint);
-            }
-        }
-        has_websocket_config_ = true;
-    } else {
+    cJSON_Delete(websocket_config_);
+    websocket_config_ = websocket != NULL ? cJSON_Duplicate(websocket, true) : NULL;
+    has_websocket_config_ = websocket != NULL;
+    if (websocket == NULL) {
         ESP_LOGI(TAG, "No websocket section found!");
     }
 
+    // 只有已激活设备的配置才能在下次启动时直接使用
+    bool config_usable = (has_mqtt_config_ || has_websocket_config_) && !has_activation_code_ && !has_activation_challenge_;
+    {
+        Settings settings("ota", true);
+        if (settings.GetInt("cached_config") != (config_usable ? 1 : 0)) {
+            settings.SetInt("cached_config", config_usable ? 1 : 0);
+        }
+    }
+
     has_server_time_ = false;
     cJSON *server_time = cJSON_GetObjectItem(root, "server_time");
     if (server_time != NULL) {
@@ -224,6 +219,66 @@ bool Ota::CheckVersion() {
     return true;
 }
 
+// 逐项比较或写入一个命名空间，section 为空表示服务器已停用该协议，清除旧配置，避免下次启动时使用
+static bool SyncConfigSection(const char* ns, const char* required_key, const cJSON* section, bool with_numbers, bool save) {
+    Settings settings(ns, save);
+    bool changed = false;
+    if (section == NULL) {
+        if (!settings.GetString(required_key).empty()) {
+            changed = true;
+            if (save) {
+                settings.EraseAll();
+            }
+        }
+        return changed;
+    }
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, section) {
+        if (item->type == cJSON_String) {
+            if (settings.GetString(item->string) != item->valuestring) {
+                changed = true;
+                if (save) {
+                    settings.SetString(item->string, item->valuestring);
+                }
+            }
+        } else if (with_numbers && item->type == cJSON_Number) {
+            if (settings.GetInt(item->string) != item->valueint) {
+                changed = true;
+                if (save) {
+                    settings.SetInt(item->string, item->valueint);
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+bool Ota::IsServerConfigChanged() {
+    bool changed = SyncConfigSection("mqtt", "endpoint", mqtt_config_, false, false);
+    changed |= SyncConfigSection("websocket", "url", websocket_config_, true, false);
+    return changed;
+}
+
+void Ota::SaveServerConfig() {
+    SyncConfigSection("mqtt", "endpoint", mqtt_config_, false, true);
+    SyncConfigSection("websocket", "url", websocket_config_, true, true);
+}
+
+bool Ota::LoadCachedConfig() {
+    {
+        Settings settings("ota", false);
+        if (settings.GetInt("cached_config") != 1) {
+            return false;
+        }
+    }
+    Settings mqtt("mqtt", false);
+    has_mqtt_config_ = !mqtt.GetString("endpoint").empty();
+    Settings websocket("websocket", false);
+    has_websocket_config_ = !websocket.GetString("url").empty();
+    return has_mqtt_config_ || has_websocket_config_;
+}
+
 void Ota::MarkCurrentVersionValid() {
     auto partition = esp_ota_get_running_partition();
     if (strcmp(partition->label, "factory") == 0) {
@@ -6,6 +6,7 @@
 #include <map>
 
 #include <esp_err.h>
+#include <cJSON.h>
 #include "board.h"
 
 class Ota {
@@ -15,6 +16,12 @@ public:
 
     void SetHeader(const std::string& key, const std::string& value);
     bool CheckVersion();
+    // 读取上次检查版本时保存的服务器配置，没有可用配置（首次启动或未激活）时返回 false
+    bool LoadCachedConfig();
+    // CheckVersion 取得的服务器配置与 NVS 中保存的是否不同
+    bool IsServerConfigChanged();
+    // 将 CheckVersion 取得的服务器配置写入 NVS，协议运行时会读取这些配置，需在协议停止后或创建之前调用
+    void SaveServerConfig();
     esp_err_t Activate();
     bool HasActivationChallenge() { return has_activation_challenge_; }
     bool HasNewVersion() { return has_new_version_; }
@@ -49,6 +56,8 @@ private:
     std::string serial_number_;
     int activation_timeout_ms_ = 30000;
     std::map<std::string, std::string> headers_;
+    cJSON* mqtt_config_ = nullptr;
+    cJSON* websocket_config_ = nullptr;
 
     void Upgrade(const std::string& firmware_url);
     std::function<void(int progress, size_t speed)> upgrade_callback_;
@@ -0,0 +1,127 @@
+#include "control_codec.h"
+
+static const char* const kMessageTypeNames[] = {
+    nullptr, "listen", "abort", "iot", "tts", "stt", "llm"
+};
+static const char* const kFieldNames[] = {
+    nullptr, "state", "mode", "reason", "text", "emotion", "states", "descriptors", "commands"
+};
+static const char* const kStateNames[] = {
+    "start", "stop", "detect", "sentence_start", "sentence_end"
+};
+static const char* const kModeNames[] = {
+    "auto", "manual", "realtime"
+};
+static const char* const kReasonNames[] = {
+    "none", "wake_word_detected"
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+ControlRecord::ControlRecord(ControlMessageType type) {
+    data_.reserve(32);
+    data_.push_back((char)type);
+    data_.push_back(0);
+}
+
+bool ControlRecord::AddField(ControlField field, const char* value, size_t size) {
+    if ((uint8_t)data_[1] >= CONTROL_RECORD_MAX_FIELDS || data_.size() + 3 + size > CONTROL_RECORD_MAX_SIZE) {
+        return false;
+    }
+    data_.push_back((char)field);
+    data_.push_back((char)(size >> 8));
+    data_.push_back((char)(size & 0xFF));
+    data_.append(value, size);
+    data_[1]++;
+    return true;
+}
+
+bool ControlRecord::AddEnum(ControlField field, uint8_t value) {
+    return AddField(field, (const char*)&value, 1);
+}
+
+bool ControlRecord::AddString(ControlField field, const std::string& value) {
+    return AddField(field, value.data(), value.size());
+}
+
+static const char* GetEnumName(uint8_t tag, uint8_t value) {
+    switch (tag) {
+        case kControlFieldState:
+            return value < ARRAY_SIZE(kStateNames) ? kStateNames[value] : nullptr;
+        case kControlFieldMode:
+            return value < ARRAY_SIZE(kModeNames) ? kModeNames[value] : nullptr;
+        case kControlFieldReason:
+            return value < ARRAY_SIZE(kReasonNames) ? kReasonNames[value] : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+static bool DecodeField(cJSON* root, uint8_t tag, const uint8_t* value, size_t size) {
+    if (tag == 0 || tag >= ARRAY_SIZE(kFieldNames)) {
+        // 忽略未知字段，便于服务器扩展
+        return true;
+    }
+
+    const char* name = kFieldNames[tag];
+    switch (tag) {
+        case kControlFieldState:
+        case kControlFieldMode:
+        case kControlFieldReason: {
+            if (size != 1) {
+                return false;
+            }
+            auto enum_name = GetEnumName(tag, value[0]);
+            if (enum_name == nullptr) {
+                return false;
+            }
+            cJSON_AddStringToObject(root, name, enum_name);
+            return true;
+        }
+        case kControlFieldText:
+        case kControlFieldEmotion: {
+            std::string text((const char*)value, size);
+            cJSON_AddStringToObject(root, name, text.c_str());
+            return true;
+        }
+        default: {
+            cJSON* json = cJSON_ParseWithLength((const char*)value, size);
+            if (json == nullptr) {
+                return false;
+            }
+            cJSON_AddItemToObject(root, name, json);
+            return true;
+        }
+    }
+}
+
+cJSON* DecodeControlRecord(const uint8_t* data, size_t size) {
+    if (size < 2) {
+        return nullptr;
+    }
+    uint8_t type = data[0];
+    if (type == 0 || type >= ARRAY_SIZE(kMessageTypeNames)) {
+        return nullptr;
+    }
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", kMessageTypeNames[type]);
+
+    int field_count = data[1];
+    size_t offset = 2;
+    for (int i = 0; i < field_count; ++i) {
+        if (offset + 3 > size) {
+            cJSON_Delete(root);
+            return nullptr;
+        }
+        uint8_t tag = data[offset];
+        size_t length = (data[offset + 1] << 8) | data[offset + 2];
+        offset += 3;
+        if (offset + length > size || !DecodeField(root, tag, data + offset, length)) {
+            cJSON_Delete(root);
+            return nullptr;
+        }
+        offset += length;
+    }
+    return root;
+}
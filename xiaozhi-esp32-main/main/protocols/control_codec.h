@@ -0,0 +1,81 @@
+#ifndef CONTROL_CODEC_H
+#define CONTROL_CODEC_H
+
+#include <cJSON.h>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Protocol v4 二进制控制消息，承载在 BinaryProtocol3 帧中 (type = 1)
+ * 负载格式：
+ * |msg_type 1u|field_count 1u|{field_tag 1u|field_len 2u|field_value field_len}...|
+ * 多字节整数均为网络字节序，枚举字段占 1 字节，JSON 字段保存原始 JSON 文本
+ * 不依赖 ESP-IDF，可同时用于设备端和主机端工具
+ */
+
+#define BINARY_PROTOCOL_TYPE_AUDIO 0
+#define BINARY_PROTOCOL_TYPE_CONTROL 1
+// BinaryProtocol3 的 payload_size 为 16 位，整条记录不能超过该长度
+#define CONTROL_RECORD_MAX_SIZE 0xFFFF
+#define CONTROL_RECORD_MAX_FIELDS 0xFF
+
+enum ControlMessageType : uint8_t {
+    kControlMessageListen = 1,
+    kControlMessageAbort = 2,
+    kControlMessageIot = 3,
+    kControlMessageTts = 4,
+    kControlMessageStt = 5,
+    kControlMessageLlm = 6,
+};
+
+enum ControlField : uint8_t {
+    kControlFieldState = 1,         // enum ControlState
+    kControlFieldMode = 2,          // enum ControlMode
+    kControlFieldReason = 3,        // enum ControlReason
+    kControlFieldText = 4,          // string
+    kControlFieldEmotion = 5,       // string
+    kControlFieldStates = 6,        // json
+    kControlFieldDescriptors = 7,   // json
+    kControlFieldCommands = 8,      // json
+};
+
+enum ControlState : uint8_t {
+    kControlStateStart = 0,
+    kControlStateStop = 1,
+    kControlStateDetect = 2,
+    kControlStateSentenceStart = 3,
+    kControlStateSentenceEnd = 4,
+};
+
+enum ControlMode : uint8_t {
+    kControlModeAuto = 0,
+    kControlModeManual = 1,
+    kControlModeRealtime = 2,
+};
+
+enum ControlReason : uint8_t {
+    kControlReasonNone = 0,
+    kControlReasonWakeWordDetected = 1,
+};
+
+class ControlRecord {
+public:
+    explicit ControlRecord(ControlMessageType type);
+
+    // 超出长度或字段数限制时返回 false，记录保持不变，调用方应改用 JSON 发送
+    bool AddEnum(ControlField field, uint8_t value);
+    bool AddString(ControlField field, const std::string& value);
+
+    const std::string& data() const { return data_; }
+
+private:
+    std::string data_;
+
+    bool AddField(ControlField field, const char* value, size_t size);
+};
+
+// 解码为与 JSON 控制消息结构相同的 cJSON 对象，调用方负责 cJSON_Delete
+cJSON* DecodeControlRecord(const uint8_t* data, size_t size);
+
+#endif // CONTROL_CODEC_H
@@ -0,0 +1,112 @@
+#include "link_quality.h"
+
+#include <cmath>
+
+// 平滑系数参考 RFC 6298: SRTT 取 1/8，RTTVAR 取 1/4
+#define LINK_QUALITY_RTT_ALPHA 0.125f
+#define LINK_QUALITY_RTT_BETA 0.25f
+#define LINK_QUALITY_LOSS_ALPHA 0.05f
+#define LINK_QUALITY_SEND_ALPHA 0.1f
+#define LINK_QUALITY_RATE_ALPHA 0.3f
+
+void LinkQualityEstimator::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    has_rtt_ = false;
+    srtt_us_ = 0;
+    rttvar_us_ = 0;
+    loss_rate_ = 0;
+    has_send_time_ = false;
+    send_time_us_ = 0;
+    tx_ = RateMeter();
+    rx_ = RateMeter();
+}
+
+void LinkQualityEstimator::OnRttSample(int64_t rtt_us) {
+    if (rtt_us < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_rtt_) {
+        has_rtt_ = true;
+        srtt_us_ = rtt_us;
+        rttvar_us_ = rtt_us / 2.0f;
+        return;
+    }
+    rttvar_us_ += LINK_QUALITY_RTT_BETA * (std::fabs(srtt_us_ - rtt_us) - rttvar_us_);
+    srtt_us_ += LINK_QUALITY_RTT_ALPHA * (rtt_us - srtt_us_);
+}
+
+void LinkQualityEstimator::OnPacketsReceived(uint32_t received, uint32_t lost) {
+    uint32_t total = received + lost;
+    if (total == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 一次收到多个包时按包数折算，避免突发丢包被平滑得过轻
+    float sample = (float)lost / total;
+    float alpha = 1.0f - std::pow(1.0f - LINK_QUALITY_LOSS_ALPHA, (float)total);
+    loss_rate_ += alpha * (sample - loss_rate_);
+}
+
+void LinkQualityEstimator::OnBytesReceived(int64_t now_us, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rx_.Add(now_us, bytes);
+}
+
+void LinkQualityEstimator::OnSendCompleted(int64_t now_us, int64_t duration_us, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tx_.Add(now_us, bytes);
+    if (!has_send_time_) {
+        has_send_time_ = true;
+        send_time_us_ = duration_us;
+    } else {
+        send_time_us_ += LINK_QUALITY_SEND_ALPHA * (duration_us - send_time_us_);
+    }
+}
+
+LinkQuality LinkQualityEstimator::GetSnapshot(int64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tx_.Advance(now_us);
+    rx_.Advance(now_us);
+
+    LinkQuality quality;
+    quality.rtt_ms = has_rtt_ ? (int)(srtt_us_ / 1000) : -1;
+    quality.rtt_var_ms = (int)(rttvar_us_ / 1000);
+    quality.loss_rate = loss_rate_;
+    quality.send_time_ms = (int)(send_time_us_ / 1000);
+    quality.tx_bytes_per_second = (uint32_t)tx_.bytes_per_second;
+    quality.rx_bytes_per_second = (uint32_t)rx_.bytes_per_second;
+
+    if (!has_rtt_ && !has_send_time_) {
+        quality.level = kLinkQualityUnknown;
+    } else if (quality.rtt_ms > 800 || quality.loss_rate > 0.1f || quality.send_time_ms > 200) {
+        quality.level = kLinkQualityPoor;
+    } else if (quality.rtt_ms > 300 || quality.rtt_var_ms > 150 || quality.loss_rate > 0.02f || quality.send_time_ms > 60) {
+        quality.level = kLinkQualityFair;
+    } else {
+        quality.level = kLinkQualityGood;
+    }
+    return quality;
+}
+
+void LinkQualityEstimator::RateMeter::Add(int64_t now_us, size_t bytes) {
+    Advance(now_us);
+    bucket_bytes += bytes;
+}
+
+void LinkQualityEstimator::RateMeter::Advance(int64_t now_us) {
+    if (bucket_start_us == 0) {
+        bucket_start_us = now_us;
+        return;
+    }
+    // 合并已经结束的每一秒，中间没有数据的秒按 0 计算
+    while (now_us - bucket_start_us >= 1000000) {
+        bytes_per_second += LINK_QUALITY_RATE_ALPHA * (bucket_bytes - bytes_per_second);
+        bucket_bytes = 0;
+        bucket_start_us += 1000000;
+        if (bytes_per_second < 1 && now_us - bucket_start_us >= 1000000) {
+            bytes_per_second = 0;
+            bucket_start_us = now_us;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef LINK_QUALITY_H
+#define LINK_QUALITY_H
+
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * 链路质量估计，由协议层在收发时喂入 RTT、UDP 序号间隔、发送耗时和字节数
+ * 时间均由调用方传入 (微秒)，不依赖 ESP-IDF
+ */
+
+enum LinkQualityLevel {
+    kLinkQualityUnknown,
+    kLinkQualityPoor,
+    kLinkQualityFair,
+    kLinkQualityGood
+};
+
+struct LinkQuality {
+    LinkQualityLevel level = kLinkQualityUnknown;
+    int rtt_ms = -1;            // 平滑 RTT，-1 表示尚无样本
+    int rtt_var_ms = 0;         // RTT 平均偏差，反映抖动
+    float loss_rate = 0;        // 平滑丢包率 0~1，仅 UDP 有效
+    int send_time_ms = 0;       // 平滑的单帧发送耗时，传输层阻塞时升高
+    uint32_t tx_bytes_per_second = 0;
+    uint32_t rx_bytes_per_second = 0;
+};
+
+class LinkQualityEstimator {
+public:
+    void Reset();
+    void OnRttSample(int64_t rtt_us);
+    void OnPacketsReceived(uint32_t received, uint32_t lost);
+    void OnBytesReceived(int64_t now_us, size_t bytes);
+    void OnSendCompleted(int64_t now_us, int64_t duration_us, size_t bytes);
+    LinkQuality GetSnapshot(int64_t now_us);
+
+private:
+    // 按秒统计吞吐量，每过一秒以 EWMA 合并
+    struct RateMeter {
+        int64_t bucket_start_us = 0;
+        uint32_t bucket_bytes = 0;
+        float bytes_per_second = 0;
+        void Add(int64_t now_us, size_t bytes);
+        void Advance(int64_t now_us);
+    };
+
+    std::mutex mutex_;
+    bool has_rtt_ = false;
+    float srtt_us_ = 0;
+    float rttvar_us_ = 0;
+    float loss_rate_ = 0;
+    bool has_send_time_ = false;
+    float send_time_us_ = 0;
+    RateMeter tx_;
+    RateMeter rx_;
+};
+
+#endif // LINK_QUALITY_H
@@ -2,8 +2,10 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "trace_recorder.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <ml307_mqtt.h>
 #include <ml307_udp.h>
 #include <cstring>
@@ -14,16 +16,20 @@
 
 MqttProtocol::MqttProtocol() {
     event_group_handle_ = xEventGroupCreate();
+    mbedtls_aes_init(&aes_ctx_);
 }
 
 MqttProtocol::~MqttProtocol() {
     ESP_LOGI(TAG, "MqttProtocol deinit");
+    // 发送任务会使用 mqtt_、udp_ 和 aes_ctx_，先让它退出
+    StopOutboundTask();
     if (udp_ != nullptr) {
         delete udp_;
     }
     if (mqtt_ != nullptr) {
         delete mqtt_;
     }
+    mbedtls_aes_free(&aes_ctx_);
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -32,9 +38,14 @@ bool MqttProtocol::Start() {
 }
 
 bool MqttProtocol::StartMqttClient(bool report_error) {
-    if (mqtt_ != nullptr) {
-        ESP_LOGW(TAG, "Mqtt client already started");
-        delete mqtt_;
+    TRACE_SCOPE("mqtt_connect");
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (mqtt_ != nullptr) {
+            ESP_LOGW(TAG, "Mqtt client already started");
+            delete mqtt_;
+            mqtt_ = nullptr;
+        }
     }
 
     Settings settings("mqtt", false);
@@ -52,7 +63,10 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         return false;
     }
 
-    mqtt_ = Board::GetInstance().CreateMqtt();
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        mqtt_ = Board::GetInstance().CreateMqtt();
+    }
     mqtt_->SetKeepAlive(90);
 
     mqtt_->OnDisconnected([this]() {
@@ -78,9 +92,14 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
             auto session_id = cJSON_GetObjectItem(root, "session_id");
             ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
             if (session_id == nullptr || session_id_ == session_id->valuestring) {
-                Application::GetInstance().Schedule([this]() {
-                    CloseAudioChannel();
-                });
+                if (resuming_) {
+                    // 会话已过期，由 ResumeSession 改为完整握手
+                    xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_GOODBYE_EVENT);
+                } else {
+                    Application::GetInstance().Schedule([this]() {
+                        CloseAudioChannel();
+                    });
+                }
             }
         } else if (on_incoming_json_ != nullptr) {
             on_incoming_json_(root);
@@ -110,7 +129,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
 }
 
 bool MqttProtocol::SendText(const std::string& text) {
-    if (publish_topic_.empty()) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (publish_topic_.empty() || mqtt_ == nullptr) {
         return false;
     }
     if (!mqtt_->Publish(publish_topic_, text)) {
@@ -121,7 +141,7 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
-void MqttProtocol::SendAudio(const AudioStreamPacket& packet) {
+void MqttProtocol::SendAudioPacket(const AudioStreamPacket& packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return;
@@ -150,6 +170,7 @@ void MqttProtocol::SendAudio(const AudioStreamPacket& packet) {
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    ClearOutboundQueues();
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
         if (udp_ != nullptr) {
@@ -162,6 +183,7 @@ void MqttProtocol::CloseAudioChannel() {
     message += "\"session_id\":\"" + session_id_ + "\",";
     message += "\"type\":\"goodbye\"";
     message += "}";
+    RecordOutgoingText(message);
     SendText(message);
 
     if (on_audio_channel_closed_ != nullptr) {
@@ -170,6 +192,13 @@ void MqttProtocol::CloseAudioChannel() {
 }
 
 bool MqttProtocol::OpenAudioChannel() {
+    TRACE_SCOPE("mqtt_open_channel");
+    // UDP 通道和密钥仍然有效时直接复用，无需重新 hello 和重建 UDP
+    if (ResumeSession()) {
+        return true;
+    }
+
+    auto start_time = esp_timer_get_time();
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
         if (!StartMqttClient(true)) {
@@ -177,14 +206,31 @@ bool MqttProtocol::OpenAudioChannel() {
         }
     }
 
+    // 旧会话中尚未发出的消息已经没有意义
+    ClearOutboundQueues();
+    ResetLinkQuality();
     busy_sending_audio_ = false;
     error_occurred_ = false;
+    if (!SendHello()) {
+        return false;
+    }
+    ConnectUdp();
+
+    ESP_LOGI(TAG, "Audio channel opened with full handshake in %lld ms", (esp_timer_get_time() - start_time) / 1000);
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+// 发送 hello 申请 UDP 通道，收到服务器 hello 后会话、音频参数和密钥已更新
+bool MqttProtocol::SendHello() {
     session_id_ = "";
     xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 
-    // 发送 hello 消息申请 UDP 通道
     std::string message = "{";
     message += "\"type\":\"hello\",";
+    message += GetIotDigestJson();
     message += "\"version\": 3,";
     message += "\"transport\":\"udp\",";
 #if CONFIG_USE_SERVER_AEC
@@ -193,6 +239,8 @@ bool MqttProtocol::OpenAudioChannel() {
     message += "\"audio_params\":{";
     message += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(OPUS_FRAME_DURATION_MS);
     message += "}}";
+    RecordOutgoingText(message);
+    StartRttProbe();
     if (!SendText(message)) {
         return false;
     }
@@ -204,10 +252,26 @@ bool MqttProtocol::OpenAudioChannel() {
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
+    return true;
+}
 
+void MqttProtocol::ConnectUdp() {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ != nullptr) {
         delete udp_;
+        udp_ = nullptr;
+    }
+    if (udp_renegotiated_) {
+        udp_renegotiated_ = false;
+        udp_server_ = pending_udp_.server;
+        udp_port_ = pending_udp_.port;
+        aes_nonce_ = pending_udp_.nonce;
+        // 旧连接已停止接收，发送方被 channel_mutex_ 挡住，此时没有其它任务在使用 aes_ctx_
+        mbedtls_aes_free(&aes_ctx_);
+        mbedtls_aes_init(&aes_ctx_);
+        mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)pending_udp_.key.c_str(), 128);
+        local_sequence_ = 0;
+        remote_sequence_ = 0;
     }
     udp_ = Board::GetInstance().CreateUdp();
     udp_->OnMessage([this](const std::string& data) {
@@ -233,6 +297,9 @@ bool MqttProtocol::OpenAudioChannel() {
         if (sequence != remote_sequence_ + 1) {
             ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
         }
+        // 序号跳过的部分计为丢包
+        link_quality_.OnPacketsReceived(1, (remote_sequence_ != 0 && sequence > remote_sequence_ + 1) ? sequence - remote_sequence_ - 1 : 0);
+        link_quality_.OnBytesReceived(esp_timer_get_time(), data.size());
 
         size_t decrypted_size = data.size() - aes_nonce_.size();
         size_t nc_off = 0;
@@ -255,7 +322,55 @@ bool MqttProtocol::OpenAudioChannel() {
     });
 
     udp_->Connect(udp_server_, udp_port_);
+}
+
+bool MqttProtocol::ResumeSession() {
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (session_id_.empty() || udp_ == nullptr || mqtt_ == nullptr || !mqtt_->IsConnected()) {
+            return false;
+        }
+    }
+    if (error_occurred_ || IsTimeout()) {
+        return false;
+    }
+    if (!server_supports_resume_) {
+        return false;
+    }
+
+    // 服务器可能已使会话过期，先在 MQTT 上确认：回复 hello 表示会话有效，回复 goodbye 或超时则改为完整握手
+    auto start_time = esp_timer_get_time();
+    std::string session_id = session_id_;
+    xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT | MQTT_PROTOCOL_SERVER_GOODBYE_EVENT);
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        udp_renegotiated_ = false;
+    }
+    resuming_ = true;
+    std::string message = "{\"session_id\":\"" + session_id + "\",\"type\":\"hello\"}";
+    RecordOutgoingText(message);
+    StartRttProbe();
+    EventBits_t bits = 0;
+    if (SendText(message)) {
+        bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT | MQTT_PROTOCOL_SERVER_GOODBYE_EVENT,
+            pdTRUE, pdFALSE, pdMS_TO_TICKS(MQTT_RESUME_TIMEOUT_MS));
+    }
+    resuming_ = false;
+    if (!(bits & MQTT_PROTOCOL_SERVER_HELLO_EVENT) || (bits & MQTT_PROTOCOL_SERVER_GOODBYE_EVENT) || session_id_ != session_id) {
+        ESP_LOGW(TAG, "Session %s was not resumed, fall back to full handshake", session_id.c_str());
+        return false;
+    }
+    // 服务器确认时下发了新的密钥，UDP 需要按新参数重新连接
+    bool renegotiated;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        renegotiated = udp_renegotiated_;
+    }
+    if (renegotiated) {
+        ConnectUdp();
+    }
 
+    ESP_LOGI(TAG, "Resumed session %s in %lld ms, skip full hello", session_id.c_str(), (esp_timer_get_time() - start_time) / 1000);
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -263,6 +378,10 @@ bool MqttProtocol::OpenAudioChannel() {
 }
 
 void MqttProtocol::ParseServerHello(const cJSON* root) {
+    RecordIncomingJson(root);
+    CompleteRttProbe();
+    ParseIotDigest(root);
+
     auto transport = cJSON_GetObjectItem(root, "transport");
     if (transport == nullptr || strcmp(transport->valuestring, "udp") != 0) {
         ESP_LOGE(TAG, "Unsupported transport: %s", transport->valuestring);
@@ -288,23 +407,36 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         }
     }
 
+    // 复用确认的回复不携带 features，保留完整握手时的结果
+    if (!resuming_) {
+        auto features = cJSON_GetObjectItem(root, "features");
+        auto resume = features != nullptr ? cJSON_GetObjectItem(features, "resume") : nullptr;
+        server_supports_resume_ = cJSON_IsTrue(resume);
+    }
+
     auto udp = cJSON_GetObjectItem(root, "udp");
     if (udp == nullptr) {
+        if (resuming_) {
+            // 确认会话时服务器可以不下发 UDP 参数，继续使用原来的密钥
+            xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+            return;
+        }
         ESP_LOGE(TAG, "UDP is not specified");
         return;
     }
-    udp_server_ = cJSON_GetObjectItem(udp, "server")->valuestring;
-    udp_port_ = cJSON_GetObjectItem(udp, "port")->valueint;
     auto key = cJSON_GetObjectItem(udp, "key")->valuestring;
     auto nonce = cJSON_GetObjectItem(udp, "nonce")->valuestring;
 
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
-    // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
-    local_sequence_ = 0;
-    remote_sequence_ = 0;
+    // 当前 UDP 连接可能仍在收发，新参数留到 ConnectUdp 中应用
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        pending_udp_.server = cJSON_GetObjectItem(udp, "server")->valuestring;
+        pending_udp_.port = cJSON_GetObjectItem(udp, "port")->valueint;
+        pending_udp_.key = DecodeHexString(key);
+        pending_udp_.nonce = DecodeHexString(nonce);
+        udp_renegotiated_ = true;
+    }
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
@@ -328,5 +460,11 @@ std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
 }
 
 bool MqttProtocol::IsAudioChannelOpened() const {
-    return udp_ != nullptr && !error_occurred_ && !IsTimeout();
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (udp_ == nullptr) {
+            return false;
+        }
+    }
+    return !error_occurred_ && !IsTimeout();
 }
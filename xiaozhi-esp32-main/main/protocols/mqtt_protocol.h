@@ -14,11 +14,16 @@
 #include <string>
 #include <map>
 #include <mutex>
+#include <atomic>
 
 #define MQTT_PING_INTERVAL_SECONDS 90
 #define MQTT_RECONNECT_INTERVAL_MS 10000
 
+// 确认复用会话时等待服务器回复的时长，超时后改为完整握手
+#define MQTT_RESUME_TIMEOUT_MS 3000
+
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define MQTT_PROTOCOL_SERVER_GOODBYE_EVENT (1 << 1)
 
 class MqttProtocol : public Protocol {
 public:
@@ -26,7 +31,6 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    void SendAudio(const AudioStreamPacket& packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
@@ -40,7 +44,7 @@ private:
     std::string password_;
     std::string publish_topic_;
 
-    std::mutex channel_mutex_;
+    mutable std::mutex channel_mutex_;
     Mqtt* mqtt_ = nullptr;
     Udp* udp_ = nullptr;
     mbedtls_aes_context aes_ctx_;
@@ -49,12 +53,29 @@ private:
     int udp_port_;
     uint32_t local_sequence_;
     uint32_t remote_sequence_;
+    // 正在确认复用会话，此时服务器的 goodbye 只表示拒绝复用
+    std::atomic<bool> resuming_ = false;
+    // 最近一次完整握手时服务器在 features 中声明支持复用会话，否则直接完整握手，不等待确认超时
+    bool server_supports_resume_ = false;
+    // 服务器 hello 中下发的 UDP 参数和密钥，由 ConnectUdp 在停止旧连接后应用，不改动正在使用的 aes_ctx_
+    struct UdpParams {
+        std::string server;
+        int port = 0;
+        std::string key;
+        std::string nonce;
+    };
+    UdpParams pending_udp_;
+    bool udp_renegotiated_ = false;
 
     bool StartMqttClient(bool report_error=false);
+    bool ResumeSession();
+    bool SendHello();
+    void ConnectUdp();
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
 
     bool SendText(const std::string& text) override;
+    void SendAudioPacket(const AudioStreamPacket& packet) override;
 };
 
 
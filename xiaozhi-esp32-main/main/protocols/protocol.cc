@@ -1,29 +1,279 @@
 #include "protocol.h"
+#include "control_codec.h"
+#include "session_recorder.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #define TAG "Protocol"
 
+Protocol::Protocol() {
+    xTaskCreate([](void* arg) {
+        Protocol* protocol = (Protocol*)arg;
+        protocol->OutboundLoop();
+        vTaskDelete(NULL);
+    }, "protocol_send", 4096 * 2, this, 4, &outbound_task_handle_);
+}
+
+Protocol::~Protocol() {
+    // 派生类应已停止发送任务，这里只是兜底
+    StopOutboundTask();
+}
+
+void Protocol::StopOutboundTask() {
+    std::unique_lock<std::mutex> lock(outbound_mutex_);
+    if (outbound_task_handle_ == nullptr) {
+        return;
+    }
+    outbound_stopping_ = true;
+    outbound_cv_.notify_all();
+    // 正在发送的消息完成后发送任务才会退出
+    outbound_cv_.wait(lock, [this]() { return outbound_stopped_; });
+    outbound_task_handle_ = nullptr;
+}
+
+void Protocol::SendAudio(AudioStreamPacket packet) {
+    std::lock_guard<std::mutex> lock(outbound_mutex_);
+    if (audio_queue_.size() >= PROTOCOL_MAX_QUEUED_AUDIO_PACKETS) {
+        audio_queue_.pop_front();
+        audio_queue_stats_.dropped++;
+    }
+    audio_queue_.emplace_back(OutboundAudio{std::chrono::steady_clock::now(), ++outbound_sequence_, std::move(packet)});
+    outbound_cv_.notify_one();
+}
+
+bool Protocol::SendControl(const std::string& text, bool binary, OutboundPriority priority) {
+    std::lock_guard<std::mutex> lock(outbound_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (priority != kOutboundUrgent) {
+        // 控制消息之间始终保持提交顺序
+        control_queue_.emplace_back(OutboundControl{now, ++outbound_sequence_, text, binary, priority == kOutboundAheadOfAudio});
+        outbound_cv_.notify_one();
+        return true;
+    }
+
+    // 插队的消息序号为 0，排在所有普通消息之前，多条插队消息之间保持顺序；排在前面的过期音频已经没有意义，直接丢弃
+    while (!audio_queue_.empty() && now - audio_queue_.front().enqueue_time > std::chrono::milliseconds(PROTOCOL_STALE_AUDIO_MS)) {
+        audio_queue_.pop_front();
+        audio_queue_stats_.dropped++;
+    }
+    auto it = control_queue_.begin();
+    while (it != control_queue_.end() && it->sequence == 0) {
+        ++it;
+    }
+    control_queue_.insert(it, OutboundControl{now, 0, text, binary, true});
+    outbound_cv_.notify_one();
+    return true;
+}
+
+void Protocol::ClearOutboundQueues() {
+    std::lock_guard<std::mutex> lock(outbound_mutex_);
+    control_queue_stats_.dropped += control_queue_.size();
+    audio_queue_stats_.dropped += audio_queue_.size();
+    control_queue_.clear();
+    audio_queue_.clear();
+}
+
+OutboundQueueStats Protocol::control_queue_stats() {
+    std::lock_guard<std::mutex> lock(outbound_mutex_);
+    return control_queue_stats_;
+}
+
+OutboundQueueStats Protocol::audio_queue_stats() {
+    std::lock_guard<std::mutex> lock(outbound_mutex_);
+    return audio_queue_stats_;
+}
+
+LinkQuality Protocol::link_quality() {
+    return link_quality_.GetSnapshot(esp_timer_get_time());
+}
+
+void Protocol::ResetLinkQuality() {
+    rtt_probe_time_us_ = 0;
+    link_quality_.Reset();
+}
+
+void Protocol::StartRttProbe() {
+    auto now = esp_timer_get_time();
+    auto pending = rtt_probe_time_us_.load();
+    // 已有未完成的探测时保留更早的时间；超过 10 秒没有回应的探测视为丢失
+    if (pending != 0 && now - pending < 10 * 1000 * 1000) {
+        return;
+    }
+    rtt_probe_time_us_ = now;
+}
+
+void Protocol::CompleteRttProbe() {
+    auto start_time = rtt_probe_time_us_.exchange(0);
+    if (start_time != 0) {
+        link_quality_.OnRttSample(esp_timer_get_time() - start_time);
+    }
+}
+
+void Protocol::UpdateQueueStats(OutboundQueueStats& stats, std::chrono::steady_clock::time_point enqueue_time) {
+    auto wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - enqueue_time).count();
+    std::lock_guard<std::mutex> lock(outbound_mutex_);
+    stats.sent++;
+    stats.total_wait_ms += wait_ms;
+    if (wait_ms > stats.max_wait_ms) {
+        stats.max_wait_ms = wait_ms;
+    }
+}
+
+// 控制消息和音频按序号依次发送，队首的控制消息不需要等待音频时先发送
+void Protocol::OutboundLoop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(outbound_mutex_);
+        outbound_cv_.wait(lock, [this]() { return outbound_stopping_ || !control_queue_.empty() || !audio_queue_.empty(); });
+        if (outbound_stopping_) {
+            outbound_stopped_ = true;
+            outbound_cv_.notify_all();
+            return;
+        }
+
+        if (!control_queue_.empty() && (audio_queue_.empty() || control_queue_.front().ahead_of_audio ||
+            control_queue_.front().sequence < audio_queue_.front().sequence)) {
+            auto message = std::move(control_queue_.front());
+            control_queue_.pop_front();
+            lock.unlock();
+
+            auto start_time = esp_timer_get_time();
+            if (message.binary) {
+                SendControlRecord(message.text);
+            } else {
+                SendText(message.text);
+            }
+            auto end_time = esp_timer_get_time();
+            link_quality_.OnSendCompleted(end_time, end_time - start_time, message.text.size());
+            SessionRecorder::GetInstance().RecordText(kRecordOutbound, message.binary ? kRecordControl : kRecordJson, message.text);
+            UpdateQueueStats(control_queue_stats_, message.enqueue_time);
+            continue;
+        }
+
+        auto message = std::move(audio_queue_.front());
+        audio_queue_.pop_front();
+        lock.unlock();
+
+        auto start_time = esp_timer_get_time();
+        SendAudioPacket(message.packet);
+        auto end_time = esp_timer_get_time();
+        link_quality_.OnSendCompleted(end_time, end_time - start_time, message.packet.payload.size());
+        SessionRecorder::GetInstance().Record(kRecordOutbound, kRecordAudio, message.packet.payload.data(),
+            message.packet.payload.size(), message.packet.timestamp);
+        UpdateQueueStats(audio_queue_stats_, message.enqueue_time);
+    }
+}
+
+// 启用会话录制时，在回调外包装一层记录收到的消息
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
-    on_incoming_json_ = callback;
+    auto& recorder = SessionRecorder::GetInstance();
+    if (!recorder.IsEnabled()) {
+        on_incoming_json_ = callback;
+        return;
+    }
+    on_incoming_json_ = [callback](const cJSON* root) {
+        RecordIncomingJson(root);
+        callback(root);
+    };
 }
 
 void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback) {
-    on_incoming_audio_ = callback;
+    auto& recorder = SessionRecorder::GetInstance();
+    if (!recorder.IsEnabled()) {
+        on_incoming_audio_ = callback;
+        return;
+    }
+    on_incoming_audio_ = [&recorder, callback](AudioStreamPacket&& packet) {
+        recorder.Record(kRecordInbound, kRecordAudio, packet.payload.data(), packet.payload.size(), packet.timestamp);
+        callback(std::move(packet));
+    };
 }
 
 void Protocol::OnAudioChannelOpened(std::function<void()> callback) {
-    on_audio_channel_opened_ = callback;
+    on_audio_channel_opened_ = [callback]() {
+        SessionRecorder::GetInstance().RecordText(kRecordInbound, kRecordEvent, "audio_channel_opened");
+        callback();
+    };
 }
 
 void Protocol::OnAudioChannelClosed(std::function<void()> callback) {
-    on_audio_channel_closed_ = callback;
+    on_audio_channel_closed_ = [callback]() {
+        SessionRecorder::GetInstance().RecordText(kRecordInbound, kRecordEvent, "audio_channel_closed");
+        callback();
+    };
+}
+
+void Protocol::RecordIncomingJson(const cJSON* root) {
+    auto& recorder = SessionRecorder::GetInstance();
+    if (!recorder.IsEnabled()) {
+        return;
+    }
+    char* json = cJSON_PrintUnformatted(root);
+    if (json != nullptr) {
+        recorder.Record(kRecordInbound, kRecordJson, json, strlen(json));
+        cJSON_free(json);
+    }
+}
+
+void Protocol::RecordOutgoingText(const std::string& text) {
+    SessionRecorder::GetInstance().RecordText(kRecordOutbound, kRecordJson, text);
 }
 
 void Protocol::OnNetworkError(std::function<void(const std::string& message)> callback) {
     on_network_error_ = callback;
 }
 
+void Protocol::OpenAudioChannelAsync(std::function<void(bool success)> callback) {
+    {
+        std::lock_guard<std::mutex> lock(open_channel_mutex_);
+        if (callback != nullptr) {
+            open_channel_callbacks_.push_back(std::move(callback));
+        }
+        // 已有打开流程在进行中，等待其结果即可
+        if (opening_audio_channel_) {
+            return;
+        }
+        opening_audio_channel_ = true;
+    }
+
+    auto ret = xTaskCreate([](void* arg) {
+        Protocol* protocol = (Protocol*)arg;
+        bool success = protocol->OpenAudioChannel();
+
+        std::vector<std::function<void(bool success)>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(protocol->open_channel_mutex_);
+            callbacks = std::move(protocol->open_channel_callbacks_);
+            protocol->opening_audio_channel_ = false;
+        }
+        for (auto& cb : callbacks) {
+            cb(success);
+        }
+        vTaskDelete(NULL);
+    }, "open_channel", 4096 * 2, this, 3, nullptr);
+
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create open_channel task");
+        std::vector<std::function<void(bool success)>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(open_channel_mutex_);
+            callbacks = std::move(open_channel_callbacks_);
+            opening_audio_channel_ = false;
+        }
+        for (auto& cb : callbacks) {
+            cb(false);
+        }
+    }
+}
+
+bool Protocol::IsAudioChannelOpening() {
+    std::lock_guard<std::mutex> lock(open_channel_mutex_);
+    return opening_audio_channel_;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -32,21 +282,54 @@ void Protocol::SetError(const std::string& message) {
 }
 
 void Protocol::SendAbortSpeaking(AbortReason reason) {
+    if (binary_control_) {
+        ControlRecord record(kControlMessageAbort);
+        if (reason == kAbortReasonWakeWordDetected) {
+            record.AddEnum(kControlFieldReason, kControlReasonWakeWordDetected);
+        }
+        SendControl(record.data(), true, kOutboundUrgent);
+        return;
+    }
+
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
         message += ",\"reason\":\"wake_word_detected\"";
     }
     message += "}";
-    SendText(message);
+    SendControl(message, false, kOutboundUrgent);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
+    if (binary_control_) {
+        ControlRecord record(kControlMessageListen);
+        record.AddEnum(kControlFieldState, kControlStateDetect);
+        if (record.AddString(kControlFieldText, wake_word)) {
+            SendControl(record.data(), true);
+            return;
+        }
+        ESP_LOGW(TAG, "Wake word too long for a control record, sending JSON");
+    }
+
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    SendControl(json);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
+    if (binary_control_) {
+        ControlRecord record(kControlMessageListen);
+        record.AddEnum(kControlFieldState, kControlStateStart);
+        if (mode == kListeningModeRealtime) {
+            record.AddEnum(kControlFieldMode, kControlModeRealtime);
+        } else if (mode == kListeningModeAutoStop) {
+            record.AddEnum(kControlFieldMode, kControlModeAuto);
+        } else {
+            record.AddEnum(kControlFieldMode, kControlModeManual);
+        }
+        SendControl(record.data(), true);
+        return;
+    }
+
     std::string message = "{\"session_id\":\"" + session_id_ + "\"";
     message += ",\"type\":\"listen\",\"state\":\"start\"";
     if (mode == kListeningModeRealtime) {
@@ -57,62 +340,84 @@ void Protocol::SendStartListening(ListeningMode mode) {
         message += ",\"mode\":\"manual\"";
     }
     message += "}";
-    SendText(message);
+    SendControl(message);
 }
 
 void Protocol::SendStopListening() {
+    if (binary_control_) {
+        ControlRecord record(kControlMessageListen);
+        record.AddEnum(kControlFieldState, kControlStateStop);
+        SendControl(record.data(), true);
+        return;
+    }
+
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
-    SendText(message);
+    SendControl(message);
 }
 
-void Protocol::SendIotDescriptors(const std::string& descriptors) {
-    cJSON* root = cJSON_Parse(descriptors.c_str());
-    if (root == nullptr) {
-        ESP_LOGE(TAG, "Failed to parse IoT descriptors: %s", descriptors.c_str());
-        return;
+void Protocol::SendIotDescriptors(const std::vector<std::string>& descriptors) {
+    size_t total_size = 0;
+    for (auto& descriptor : descriptors) {
+        total_size += descriptor.size();
     }
-
-    if (!cJSON_IsArray(root)) {
-        ESP_LOGE(TAG, "IoT descriptors should be an array");
-        cJSON_Delete(root);
+    if (server_has_iot_descriptors_) {
+        ESP_LOGI(TAG, "Server already has IoT descriptors %s, skipped %u messages (%u bytes)",
+            iot_descriptors_digest_.c_str(), descriptors.size(), total_size);
         return;
     }
 
-    int arraySize = cJSON_GetArraySize(root);
-    for (int i = 0; i < arraySize; ++i) {
-        cJSON* descriptor = cJSON_GetArrayItem(root, i);
-        if (descriptor == nullptr) {
-            ESP_LOGE(TAG, "Failed to get IoT descriptor at index %d", i);
-            continue;
+    auto start_time = esp_timer_get_time();
+    for (auto& descriptor : descriptors) {
+        if (binary_control_) {
+            ControlRecord record(kControlMessageIot);
+            if (record.AddString(kControlFieldDescriptors, "[" + descriptor + "]")) {
+                SendControl(record.data(), true, kOutboundAheadOfAudio);
+                continue;
+            }
+            ESP_LOGW(TAG, "IoT descriptor too large for a control record (%u bytes), sending JSON", descriptor.size());
         }
 
-        cJSON* messageRoot = cJSON_CreateObject();
-        cJSON_AddStringToObject(messageRoot, "session_id", session_id_.c_str());
-        cJSON_AddStringToObject(messageRoot, "type", "iot");
-        cJSON_AddBoolToObject(messageRoot, "update", true);
-
-        cJSON* descriptorArray = cJSON_CreateArray();
-        cJSON_AddItemToArray(descriptorArray, cJSON_Duplicate(descriptor, 1));
-        cJSON_AddItemToObject(messageRoot, "descriptors", descriptorArray);
-
-        char* message = cJSON_PrintUnformatted(messageRoot);
-        if (message == nullptr) {
-            ESP_LOGE(TAG, "Failed to print JSON message for IoT descriptor at index %d", i);
-            cJSON_Delete(messageRoot);
-            continue;
-        }
+        std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"iot\",\"update\":true,\"descriptors\":[";
+        message += descriptor;
+        message += "]}";
+        SendControl(message, false, kOutboundAheadOfAudio);
+    }
+    ESP_LOGI(TAG, "Queued %u IoT descriptors (%u bytes) in %lld us", descriptors.size(), total_size,
+        esp_timer_get_time() - start_time);
+    // 复用会话时不再重复发送，重新 hello 后以服务器的确认为准
+    server_has_iot_descriptors_ = true;
+}
 
-        SendText(std::string(message));
-        cJSON_free(message);
-        cJSON_Delete(messageRoot);
+std::string Protocol::GetIotDigestJson() const {
+    if (iot_descriptors_digest_.empty()) {
+        return "";
     }
+    return "\"iot_digest\":\"" + iot_descriptors_digest_ + "\",";
+}
 
-    cJSON_Delete(root);
+void Protocol::ParseIotDigest(const cJSON* root) {
+    auto digest = cJSON_GetObjectItem(root, "iot_digest");
+    server_has_iot_descriptors_ = !iot_descriptors_digest_.empty() && cJSON_IsString(digest) &&
+        iot_descriptors_digest_ == digest->valuestring;
 }
 
 void Protocol::SendIotStates(const std::string& states) {
+    if (binary_control_) {
+        ControlRecord record(kControlMessageIot);
+        if (record.AddString(kControlFieldStates, states)) {
+            SendControl(record.data(), true, kOutboundAheadOfAudio);
+            return;
+        }
+        ESP_LOGW(TAG, "IoT states too large for a control record (%u bytes), sending JSON", states.size());
+    }
+
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"iot\",\"update\":true,\"states\":" + states + "}";
-    SendText(message);
+    SendControl(message, false, kOutboundAheadOfAudio);
+}
+
+bool Protocol::SendControlRecord(const std::string& record) {
+    ESP_LOGW(TAG, "Binary control messages are not supported by this transport");
+    return false;
 }
 
 bool Protocol::IsTimeout() const {
@@ -6,6 +6,27 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "link_quality.h"
+
+// 发送队列中最多缓存的音频帧数，超出后丢弃最旧的帧
+#define PROTOCOL_MAX_QUEUED_AUDIO_PACKETS 40
+// 发送 abort 时，排队超过该时长的音频帧被视为过期并丢弃
+#define PROTOCOL_STALE_AUDIO_MS 300
+
+// 控制消息相对于已排队音频的发送顺序
+enum OutboundPriority {
+    kOutboundInOrder,       // 按提交顺序，例如 listen stop 必须在最后一帧语音之后
+    kOutboundAheadOfAudio,  // 不等待已排队的音频，但仍在之前的控制消息之后，用于与音频无关的 IoT 消息
+    kOutboundUrgent,        // 排在所有消息之前，并丢弃过期的音频，仅用于 abort
+};
 
 struct AudioStreamPacket {
     uint32_t timestamp = 0;
@@ -28,6 +49,13 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+struct OutboundQueueStats {
+    uint32_t sent = 0;
+    uint32_t dropped = 0;
+    uint32_t max_wait_ms = 0;
+    uint64_t total_wait_ms = 0;
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -41,7 +69,8 @@ enum ListeningMode {
 
 class Protocol {
 public:
-    virtual ~Protocol() = default;
+    Protocol();
+    virtual ~Protocol();
 
     inline int server_sample_rate() const {
         return server_sample_rate_;
@@ -61,22 +90,35 @@ public:
 
     virtual bool Start() = 0;
     virtual bool OpenAudioChannel() = 0;
+    // 在独立任务中执行 OpenAudioChannel，完成后在该任务中回调结果，调用方不会被网络阻塞
+    void OpenAudioChannelAsync(std::function<void(bool success)> callback);
+    bool IsAudioChannelOpening();
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
     virtual bool IsAudioChannelBusy() const;
-    virtual void SendAudio(const AudioStreamPacket& packet) = 0;
+    // 音频和控制消息分别排队，发送任务按提交顺序发送，IoT 消息不等待音频，abort 插队
+    void SendAudio(AudioStreamPacket packet);
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
-    virtual void SendIotDescriptors(const std::string& descriptors);
+    // 每个描述符单独发送一条消息，服务器在 hello 中确认已有相同摘要的描述符时跳过
+    virtual void SendIotDescriptors(const std::vector<std::string>& descriptors);
     virtual void SendIotStates(const std::string& states);
 
-    // 新增：发送WebSocket心跳包
+    // 新增：发送WebSocket心跳包，服务器回复的 hello 同时作为 RTT 样本
     void SendPing() {
-        SendText("{\"type\":\"hello\"}");
+        StartRttProbe();
+        SendControl("{\"type\":\"hello\"}");
     }
 
+    // 在 hello 中告知服务器当前描述符的摘要
+    void SetIotDescriptorsDigest(const std::string& digest) { iot_descriptors_digest_ = digest; }
+
+    OutboundQueueStats control_queue_stats();
+    OutboundQueueStats audio_queue_stats();
+    LinkQuality link_quality();
+
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
     std::function<void(AudioStreamPacket&& packet)> on_incoming_audio_;
@@ -88,12 +130,70 @@ protected:
     int server_frame_duration_ = 60;
     bool error_occurred_ = false;
     bool busy_sending_audio_ = false;
+    // 服务器在 hello 中确认 v4 后，控制消息改用二进制记录发送
+    bool binary_control_ = false;
     std::string session_id_;
+    std::string iot_descriptors_digest_;
+    bool server_has_iot_descriptors_ = false;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    LinkQualityEstimator link_quality_;
+
+    std::mutex open_channel_mutex_;
+    bool opening_audio_channel_ = false;
+    std::vector<std::function<void(bool success)>> open_channel_callbacks_;
 
+    // 由发送任务调用，直接写入传输层
     virtual bool SendText(const std::string& text) = 0;
+    virtual void SendAudioPacket(const AudioStreamPacket& packet) = 0;
+    // 二进制控制消息 (Protocol v4)，不支持的传输层返回 false
+    virtual bool SendControlRecord(const std::string& record);
+    bool SendControl(const std::string& text, bool binary = false, OutboundPriority priority = kOutboundInOrder);
+    // 派生类析构时在释放传输层之前调用，等待发送任务退出，之后不再发送任何消息
+    void StopOutboundTask();
+    // 会话录制，供子类记录不经过发送队列和回调的消息（如 hello）
+    static void RecordIncomingJson(const cJSON* root);
+    static void RecordOutgoingText(const std::string& text);
+    // hello 中的 iot_digest 字段，服务器 hello 中返回相同摘要表示已有描述符
+    std::string GetIotDigestJson() const;
+    void ParseIotDigest(const cJSON* root);
+    void ClearOutboundQueues();
+    // 重新建立连接时调用，旧链路的估计值不再适用；复用会话时保留
+    void ResetLinkQuality();
+    // 发出 hello 时开始计时，收到服务器 hello 时得到一个 RTT 样本
+    void StartRttProbe();
+    void CompleteRttProbe();
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+
+private:
+    // sequence 为提交顺序，插队的控制消息为 0
+    struct OutboundControl {
+        std::chrono::steady_clock::time_point enqueue_time;
+        uint64_t sequence;
+        std::string text;
+        bool binary;
+        bool ahead_of_audio;
+    };
+    struct OutboundAudio {
+        std::chrono::steady_clock::time_point enqueue_time;
+        uint64_t sequence;
+        AudioStreamPacket packet;
+    };
+
+    std::mutex outbound_mutex_;
+    std::condition_variable outbound_cv_;
+    std::deque<OutboundControl> control_queue_;
+    std::deque<OutboundAudio> audio_queue_;
+    OutboundQueueStats control_queue_stats_;
+    OutboundQueueStats audio_queue_stats_;
+    uint64_t outbound_sequence_ = 0;
+    TaskHandle_t outbound_task_handle_ = nullptr;
+    bool outbound_stopping_ = false;
+    bool outbound_stopped_ = false;
+    std::atomic<int64_t> rtt_probe_time_us_ = 0;
+
+    void OutboundLoop();
+    void UpdateQueueStats(OutboundQueueStats& stats, std::chrono::steady_clock::time_point enqueue_time);
 };
 
 #endif // PROTOCOL_H
@@ -0,0 +1,164 @@
+#include "session_recorder.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/base64.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "SessionRecorder"
+
+// 没有 PSRAM 时使用较小的内部 RAM 缓冲区
+#define SESSION_RECORDER_INTERNAL_CAPACITY (32 * 1024)
+
+struct RecordHeader {
+    uint8_t direction;
+    uint8_t kind;
+    uint16_t length;
+    uint32_t sequence;
+    uint32_t time_us_high;
+    uint32_t time_us_low;
+    uint32_t audio_timestamp;
+} __attribute__((packed));
+
+bool SessionRecorder::Start(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (buffer_ != nullptr) {
+        return true;
+    }
+
+    buffer_ = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+    if (buffer_ == nullptr) {
+        capacity = SESSION_RECORDER_INTERNAL_CAPACITY;
+        buffer_ = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate capture buffer");
+        return false;
+    }
+    capacity_ = capacity;
+    ESP_LOGI(TAG, "Session recorder started, buffer size: %u", capacity_);
+    return true;
+}
+
+void SessionRecorder::Record(RecordDirection direction, RecordKind kind, const void* data, size_t size, uint32_t audio_timestamp) {
+    if (buffer_ == nullptr) {
+        return;
+    }
+    if (size > 0xFFFF) {
+        size = 0xFFFF;
+    }
+
+    auto now = (uint64_t)esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t sequence = ++sequence_;
+    size_t total = sizeof(RecordHeader) + size;
+    if (dumping_ || total > capacity_) {
+        dropped_++;
+        return;
+    }
+    while (capacity_ - used_ < total) {
+        EvictOldest();
+    }
+
+    RecordHeader header;
+    header.direction = direction;
+    header.kind = kind;
+    header.length = htons(size);
+    header.sequence = htonl(sequence);
+    header.time_us_high = htonl(now >> 32);
+    header.time_us_low = htonl(now & 0xFFFFFFFF);
+    header.audio_timestamp = htonl(audio_timestamp);
+    Write(&header, sizeof(header));
+    Write(data, size);
+    used_ += total;
+    record_count_++;
+}
+
+void SessionRecorder::Write(const void* data, size_t size) {
+    size_t first = std::min(size, capacity_ - head_);
+    memcpy(buffer_ + head_, data, first);
+    memcpy(buffer_, (const uint8_t*)data + first, size - first);
+    head_ = (head_ + size) % capacity_;
+}
+
+void SessionRecorder::Read(size_t offset, void* data, size_t size) const {
+    size_t first = std::min(size, capacity_ - offset);
+    memcpy(data, buffer_ + offset, first);
+    memcpy((uint8_t*)data + first, buffer_, size - first);
+}
+
+void SessionRecorder::EvictOldest() {
+    RecordHeader header;
+    Read(tail_, &header, sizeof(header));
+    size_t total = sizeof(RecordHeader) + ntohs(header.length);
+    tail_ = (tail_ + total) % capacity_;
+    used_ -= total;
+    record_count_--;
+    dropped_++;
+}
+
+void SessionRecorder::DumpAsync() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer_ == nullptr || dumping_) {
+            return;
+        }
+        dumping_ = true;
+    }
+
+    xTaskCreate([](void* arg) {
+        auto recorder = (SessionRecorder*)arg;
+        recorder->Dump();
+        vTaskDelete(NULL);
+    }, "dump_capture", 4096, this, 1, nullptr);
+}
+
+// 以 base64 文本按行输出，便于从串口日志中截取后用 scripts/stub_server/capture.py 解析
+void SessionRecorder::Dump() {
+    // dumping_ 置位后不再有写入，可以在不持锁的情况下读取缓冲区
+    uint8_t file_header[14];
+    memcpy(file_header, SESSION_RECORDER_MAGIC, 5);
+    file_header[5] = SESSION_RECORDER_VERSION;
+    uint32_t record_count = htonl(record_count_);
+    uint32_t dropped = htonl(dropped_);
+    memcpy(file_header + 6, &record_count, 4);
+    memcpy(file_header + 10, &dropped, 4);
+
+    ESP_LOGI(TAG, "Dumping %lu records (%u bytes), %lu dropped", record_count_, used_, dropped_);
+    printf("\n-----BEGIN XIAOZHI CAPTURE-----\n");
+
+    // 每行 57 字节原始数据，编码后为 76 个字符
+    const size_t line_size = 57;
+    uint8_t line[line_size];
+    unsigned char encoded[80];
+    size_t encoded_len = 0;
+    mbedtls_base64_encode(encoded, sizeof(encoded), &encoded_len, file_header, sizeof(file_header));
+    printf("%.*s\n", (int)encoded_len, encoded);
+
+    size_t offset = tail_;
+    size_t remaining = used_;
+    int lines = 0;
+    while (remaining > 0) {
+        size_t size = std::min(line_size, remaining);
+        Read(offset, line, size);
+        offset = (offset + size) % capacity_;
+        remaining -= size;
+        mbedtls_base64_encode(encoded, sizeof(encoded), &encoded_len, line, size);
+        printf("%.*s\n", (int)encoded_len, encoded);
+        // 定期让出 CPU，避免长时间占用导致看门狗复位
+        if (++lines % 16 == 0) {
+            vTaskDelay(1);
+        }
+    }
+    printf("-----END XIAOZHI CAPTURE-----\n");
+    fflush(stdout);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    dumping_ = false;
+}
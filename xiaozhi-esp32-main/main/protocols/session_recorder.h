@@ -0,0 +1,74 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * 协议会话录制，记录所有收发的控制消息和音频帧，用于离线分析卡顿等时序问题
+ * 记录保存在环形缓冲区中（优先使用 PSRAM），写满后覆盖最早的记录，通过串口以 base64 导出
+ *
+ * 导出文件格式：
+ * |magic "XZCAP" 5u|version 1u|record_count 4u|dropped 4u|{record}...|
+ * 记录格式（多字节整数为网络字节序）：
+ * |direction 1u|kind 1u|length 2u|sequence 4u|time_us 8u|audio_timestamp 4u|payload length|
+ */
+
+#define SESSION_RECORDER_MAGIC "XZCAP"
+#define SESSION_RECORDER_VERSION 1
+
+enum RecordDirection : uint8_t {
+    kRecordInbound = 0,
+    kRecordOutbound = 1,
+};
+
+enum RecordKind : uint8_t {
+    kRecordJson = 0,        // JSON 文本
+    kRecordAudio = 1,       // Opus 数据包
+    kRecordControl = 2,     // Protocol v4 二进制控制消息
+    kRecordEvent = 3,       // 本地事件，如音频通道打开、关闭
+};
+
+class SessionRecorder {
+public:
+    static SessionRecorder& GetInstance() {
+        static SessionRecorder instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    bool Start(size_t capacity);
+    bool IsEnabled() const { return buffer_ != nullptr; }
+    void Record(RecordDirection direction, RecordKind kind, const void* data, size_t size, uint32_t audio_timestamp = 0);
+    void RecordText(RecordDirection direction, RecordKind kind, const std::string& text) {
+        Record(direction, kind, text.data(), text.size());
+    }
+    // 在独立任务中通过串口导出全部记录，导出期间新的记录被丢弃
+    void DumpAsync();
+
+private:
+    SessionRecorder() = default;
+    ~SessionRecorder() = default;
+
+    std::mutex mutex_;
+    uint8_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    size_t head_ = 0;   // 下一条记录写入位置
+    size_t tail_ = 0;   // 最早一条记录的位置
+    size_t used_ = 0;
+    uint32_t record_count_ = 0;
+    uint32_t sequence_ = 0;
+    uint32_t dropped_ = 0;
+    bool dumping_ = false;
+
+    void Write(const void* data, size_t size);
+    void Read(size_t offset, void* data, size_t size) const;
+    void EvictOldest();
+    void Dump();
+};
+
+#endif // SESSION_RECORDER_H
@@ -3,10 +3,13 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "control_codec.h"
+#include "trace_recorder.h"
 
 #include <cstring>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -17,9 +20,9 @@ WebsocketProtocol::WebsocketProtocol() {
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
-    }
+    // 发送任务会使用 websocket_，先让它退出
+    StopOutboundTask();
+    websocket_.reset();
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -28,8 +31,15 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-void WebsocketProtocol::SendAudio(const AudioStreamPacket& packet) {
-    if (websocket_ == nullptr) {
+// 持锁只复制连接句柄，阻塞的 Send 不占用 channel_mutex_，避免 CloseAudioChannel 等被发送卡住
+std::shared_ptr<WebSocket> WebsocketProtocol::GetWebSocket() const {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    return websocket_;
+}
+
+void WebsocketProtocol::SendAudioPacket(const AudioStreamPacket& packet) {
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr) {
         return;
     }
 
@@ -45,33 +55,35 @@ void WebsocketProtocol::SendAudio(const AudioStreamPacket& packet) {
         memcpy(bp2->payload, packet.payload.data(), packet.payload.size());
 
         busy_sending_audio_ = true;
-        websocket_->Send(serialized.data(), serialized.size(), true);
+        websocket->Send(serialized.data(), serialized.size(), true);
         busy_sending_audio_ = false;
-    } else if (version_ == 3) {
+    } else if (version_ >= 3) {
+        // v4 与 v3 使用相同的帧格式
         std::string serialized;
         serialized.resize(sizeof(BinaryProtocol3) + packet.payload.size());
         auto bp3 = (BinaryProtocol3*)serialized.data();
-        bp3->type = 0;
+        bp3->type = BINARY_PROTOCOL_TYPE_AUDIO;
         bp3->reserved = 0;
         bp3->payload_size = htons(packet.payload.size());
         memcpy(bp3->payload, packet.payload.data(), packet.payload.size());
 
         busy_sending_audio_ = true;
-        websocket_->Send(serialized.data(), serialized.size(), true);
+        websocket->Send(serialized.data(), serialized.size(), true);
         busy_sending_audio_ = false;
     } else {
         busy_sending_audio_ = true;
-        websocket_->Send(packet.payload.data(), packet.payload.size(), true);
+        websocket->Send(packet.payload.data(), packet.payload.size(), true);
         busy_sending_audio_ = false;
     }
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
-    if (websocket_ == nullptr) {
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr) {
         return false;
     }
 
-    if (!websocket_->Send(text)) {
+    if (!websocket->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -80,20 +92,53 @@ bool WebsocketProtocol::SendText(const std::string& text) {
     return true;
 }
 
+bool WebsocketProtocol::SendControlRecord(const std::string& record) {
+    std::string serialized;
+    serialized.resize(sizeof(BinaryProtocol3) + record.size());
+    auto bp3 = (BinaryProtocol3*)serialized.data();
+    bp3->type = BINARY_PROTOCOL_TYPE_CONTROL;
+    bp3->reserved = 0;
+    bp3->payload_size = htons(record.size());
+    memcpy(bp3->payload, record.data(), record.size());
+
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr) {
+        return false;
+    }
+    if (!websocket->Send(serialized.data(), serialized.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send control record, type: %d", record.empty() ? 0 : record[0]);
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    return true;
+}
+
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    // 打开通道的任务会替换 websocket_，复制后再使用
+    auto websocket = GetWebSocket();
+    return websocket != nullptr && websocket->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
-        websocket_ = nullptr;
-    }
+    ClearOutboundQueues();
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    websocket_.reset();
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
+    TRACE_SCOPE("websocket_open_channel");
+    // 会话仍然有效时直接复用，新一轮对话只需发送 listen start
+    if (ResumeSession()) {
+        return true;
+    }
+
+    auto start_time = esp_timer_get_time();
+    // 旧会话中尚未发出的消息已经没有意义
+    ClearOutboundQueues();
+    ResetLinkQuality();
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_.reset();
     }
 
     Settings settings("websocket", false);
@@ -106,21 +151,27 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     busy_sending_audio_ = false;
     error_occurred_ = false;
+    session_id_ = "";
+    session_established_ = false;
+    binary_control_ = false;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+
+    // 发送任务可能仍持有旧连接的句柄，由最后一个持有者释放
+    std::shared_ptr<WebSocket> websocket(Board::GetInstance().CreateWebSocket());
 
-    websocket_ = Board::GetInstance().CreateWebSocket();
-    
     if (!token.empty()) {
         // If token not has a space, add "Bearer " prefix
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        websocket->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    websocket->SetHeader("Protocol-Version", std::to_string(version_).c_str());
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    websocket->OnData([this](const char* data, size_t len, bool binary) {
+        link_quality_.OnBytesReceived(esp_timer_get_time(), len);
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
@@ -134,15 +185,30 @@ bool WebsocketProtocol::OpenAudioChannel() {
                         .timestamp = bp2->timestamp,
                         .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
                     });
-                } else if (version_ == 3) {
+                } else if (version_ >= 3) {
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
+                    if (len < sizeof(BinaryProtocol3) || sizeof(BinaryProtocol3) + ntohs(bp3->payload_size) > len) {
+                        ESP_LOGE(TAG, "Invalid binary frame, size: %u", len);
+                        return;
+                    }
                     bp3->payload_size = ntohs(bp3->payload_size);
                     auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    });
+                    if (bp3->type == BINARY_PROTOCOL_TYPE_CONTROL) {
+                        auto root = DecodeControlRecord(payload, bp3->payload_size);
+                        if (root == nullptr) {
+                            ESP_LOGE(TAG, "Invalid control record, size: %u", bp3->payload_size);
+                        } else {
+                            if (on_incoming_json_ != nullptr) {
+                                on_incoming_json_(root);
+                            }
+                            cJSON_Delete(root);
+                        }
+                    } else {
+                        on_incoming_audio_(AudioStreamPacket{
+                            .timestamp = 0,
+                            .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
+                        });
+                    }
                 } else {
                     on_incoming_audio_(AudioStreamPacket{
                         .timestamp = 0,
@@ -170,7 +236,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
         
         // 新增：WebSocket断开时自动重连
@@ -180,7 +246,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
             // 延迟一点时间再重连，避免立即重连可能的问题
             app.Schedule([this]() {
                 if (Application::GetInstance().GetDeviceState() == kDeviceStateIdle) {
-                    OpenAudioChannel();
+                    OpenAudioChannelAsync(nullptr);
                 }
             });
         }
@@ -191,16 +257,21 @@ bool WebsocketProtocol::OpenAudioChannel() {
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
+    if (!websocket->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
         SetError(Lang::Strings::SERVER_NOT_FOUND);
         return false;
     }
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_ = websocket;
+    }
 
     // Send hello message to describe the client
     // keys: message type, version, audio_params (format, sample_rate, channels)
     std::string message = "{";
     message += "\"type\":\"hello\",";
+    message += GetIotDigestJson();
     message += "\"version\": " + std::to_string(version_) + ",";
 #if CONFIG_USE_SERVER_AEC
     message += "\"features\":{\"aec\":true},";
@@ -209,6 +280,9 @@ bool WebsocketProtocol::OpenAudioChannel() {
     message += "\"audio_params\":{";
     message += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(OPUS_FRAME_DURATION_MS);
     message += "}}";
+    RecordOutgoingText(message);
+    StartRttProbe();
+    awaiting_hello_ = true;
     if (!SendText(message)) {
         return false;
     }
@@ -221,6 +295,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
         return false;
     }
 
+    ESP_LOGI(TAG, "Audio channel opened with full handshake in %lld ms", (esp_timer_get_time() - start_time) / 1000);
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -228,7 +303,26 @@ bool WebsocketProtocol::OpenAudioChannel() {
     return true;
 }
 
+bool WebsocketProtocol::ResumeSession() {
+    if (!session_established_ || !IsAudioChannelOpened()) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Reusing session %s, skip websocket reconnect and hello", session_id_.c_str());
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
 void WebsocketProtocol::ParseServerHello(const cJSON* root) {
+    RecordIncomingJson(root);
+    CompleteRttProbe();
+    bool opening = awaiting_hello_.exchange(false);
+    if (opening) {
+        ParseIotDigest(root);
+    }
+
     auto transport = cJSON_GetObjectItem(root, "transport");
     if (transport == nullptr || strcmp(transport->valuestring, "websocket") != 0) {
         ESP_LOGE(TAG, "Unsupported transport: %s", transport->valuestring);
@@ -253,5 +347,13 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         }
     }
 
+    // 只有服务器确认 v4 时才使用二进制控制消息，否则保持 JSON；心跳的回复可能不带 version，不能中途切换编码
+    if (opening) {
+        auto version = cJSON_GetObjectItem(root, "version");
+        binary_control_ = version_ >= 4 && version != nullptr && version->valueint >= 4;
+        ESP_LOGI(TAG, "Control messages encoding: %s", binary_control_ ? "binary" : "json");
+    }
+
+    session_established_ = true;
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
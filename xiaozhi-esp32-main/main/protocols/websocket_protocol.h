@@ -5,6 +5,9 @@
 #include "protocol.h"
 
 #include <web_socket.h>
+#include <mutex>
+#include <memory>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
@@ -16,18 +19,25 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    void SendAudio(const AudioStreamPacket& packet) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
 
 private:
     EventGroupHandle_t event_group_handle_;
-    WebSocket* websocket_ = nullptr;
+    mutable std::mutex channel_mutex_;
+    std::shared_ptr<WebSocket> websocket_;
     int version_ = 1;
+    bool session_established_ = false;
+    // 打开通道时发出的 hello 尚未收到回复；心跳的回复同样是 hello，不重新协商编码
+    std::atomic<bool> awaiting_hello_ = false;
 
+    std::shared_ptr<WebSocket> GetWebSocket() const;
+    bool ResumeSession();
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
+    void SendAudioPacket(const AudioStreamPacket& packet) override;
+    bool SendControlRecord(const std::string& record) override;
 };
 
 #endif
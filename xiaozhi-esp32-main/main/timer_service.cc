@@ -0,0 +1,359 @@
+#include "timer_service.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "TimerService"
+
+#define TIMER_WHEEL_TICK_US (TIMER_WHEEL_TICK_MS * 1000LL)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_MAX_TICKS (1LL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+TimerService::TimerService() {
+    current_tick_ = esp_timer_get_time() / TIMER_WHEEL_TICK_US;
+    esp_timer_create_args_t wheel_timer_args = {
+        .callback = [](void* arg) {
+            auto self = static_cast<TimerService*>(arg);
+            self->OnWheelTimer();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "timer_wheel",
+        .skip_unhandled_events = false,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&wheel_timer_args, &wheel_timer_));
+}
+
+TimerService::~TimerService() {
+    if (wheel_timer_ != nullptr) {
+        esp_timer_stop(wheel_timer_);
+        esp_timer_delete(wheel_timer_);
+    }
+}
+
+int TimerService::Create(const char* name, TimerDispatch dispatch, std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int id = 0;
+    while (id < (int)timers_.size() && timers_[id].in_use) {
+        id++;
+    }
+    if (id == (int)timers_.size()) {
+        timers_.emplace_back();
+    }
+    auto& timer = timers_[id];
+    timer.name = name;
+    timer.dispatch = dispatch;
+    timer.callback = std::move(callback);
+    timer.in_use = true;
+    timer.active = false;
+    return id;
+}
+
+void TimerService::StartPeriodic(int id, uint32_t period_ms, uint32_t slack_ms) {
+    Start(id, period_ms, period_ms, slack_ms);
+}
+
+void TimerService::StartOnce(int id, uint32_t delay_ms, uint32_t slack_ms) {
+    Start(id, delay_ms, 0, slack_ms);
+}
+
+void TimerService::Start(int id, uint32_t delay_ms, uint32_t period_ms, uint32_t slack_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& timer = timers_[id];
+    if (!timer.in_use) {
+        ESP_LOGW(TAG, "Timer %d is not created", id);
+        return;
+    }
+    if (timer.active) {
+        Unlink(&timer);
+    }
+    timer.deadline_us = esp_timer_get_time() + delay_ms * 1000LL;
+    timer.period_us = period_ms * 1000LL;
+    timer.slack_ticks = slack_ms / TIMER_WHEEL_TICK_MS;
+    timer.expires = GetExpires(timer.deadline_us, timer.slack_ticks);
+    // 周期定时器以实际的第一次到期为相位，与合并到的定时器保持同步，之后每次都能落在同一次唤醒上
+    timer.deadline_us = std::max<int64_t>(timer.deadline_us, timer.expires * TIMER_WHEEL_TICK_US);
+    timer.active = true;
+    Link(&timer);
+    if (armed_tick_ < 0 || timer.expires < armed_tick_) {
+        Rearm();
+    }
+}
+
+void TimerService::Stop(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& timer = timers_[id];
+    if (timer.active) {
+        Unlink(&timer);
+        timer.active = false;
+        Rearm();
+    }
+    // 单次定时器到期后 active 已清除，但回调可能还在主循环队列中，同样需要丢弃
+    timer.generation++;
+}
+
+void TimerService::Delete(int id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& timer = timers_[id];
+    if (timer.active) {
+        Unlink(&timer);
+        timer.active = false;
+        Rearm();
+    }
+    timer.in_use = false;
+    timer.generation++;
+    timer.callback = nullptr;
+    // 回调中删除自身时不能等待
+    idle_cv_.wait(lock, [this, &timer]() {
+        return running_ != &timer || running_task_ == xTaskGetCurrentTaskHandle();
+    });
+}
+
+bool TimerService::IsActive(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return timers_[id].active;
+}
+
+void TimerService::SetMainLoopDispatcher(std::function<void(std::function<void()>)> dispatcher) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    main_loop_dispatcher_ = std::move(dispatcher);
+}
+
+TimerServiceStats TimerService::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.active = 0;
+    for (auto& timer : timers_) {
+        stats.active += timer.active;
+    }
+    stats_ = TimerServiceStats();
+    return stats;
+}
+
+// 调用方需持有 mutex_，到期时间向上取整到 tick，保证不早于要求的时间
+// 允许延后时，优先合并到窗口内已有的唤醒上，否则在窗口中取低位 0 最多的 tick，便于之后的定时器对齐
+int64_t TimerService::GetExpires(int64_t deadline_us, int64_t slack_ticks) {
+    int64_t deadline = (deadline_us + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US;
+    if (slack_ticks <= 0) {
+        return deadline;
+    }
+    int64_t limit = deadline + slack_ticks;
+    int64_t joined = FindExpires(std::max(deadline, current_tick_), limit);
+    if (joined >= 0) {
+        return joined;
+    }
+    int bit = 63 - __builtin_clzll((uint64_t)(deadline ^ limit));
+    return limit & ~((1LL << bit) - 1);
+}
+
+// 调用方需持有 mutex_，返回 [from, to] 内最早的已有唤醒 tick，没有时返回 -1
+// 周期定时器还未放入时间轮的后续到期也算在内，新启动的定时器才能跟上已有定时器的相位
+// 定时器数量很少，直接遍历
+int64_t TimerService::FindExpires(int64_t from, int64_t to) {
+    int64_t found = -1;
+    for (auto& timer : timers_) {
+        if (!timer.active) {
+            continue;
+        }
+        int64_t expires = timer.expires;
+        if (expires < from && timer.period_us > 0) {
+            int64_t from_us = from * TIMER_WHEEL_TICK_US;
+            int64_t periods = std::max<int64_t>(1, (from_us - timer.deadline_us + timer.period_us - 1) / timer.period_us);
+            expires = (timer.deadline_us + periods * timer.period_us + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US;
+        }
+        if (expires >= from && expires <= to && (found < 0 || expires < found)) {
+            found = expires;
+        }
+    }
+    return found;
+}
+
+// 调用方需持有 mutex_
+void TimerService::Link(Timer* timer) {
+    int64_t expires = std::max(timer->expires, current_tick_);
+    int64_t delta = expires - current_tick_;
+    if (delta >= TIMER_WHEEL_MAX_TICKS) {
+        // 超出时间轮范围的先放在最高层末尾，级联时按真实到期时间重新放置
+        expires = current_tick_ + TIMER_WHEEL_MAX_TICKS - 1;
+        delta = TIMER_WHEEL_MAX_TICKS - 1;
+    }
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1LL << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (expires >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = nullptr;
+    timer->next = slots_[level][slot];
+    if (timer->next != nullptr) {
+        timer->next->prev = timer;
+    }
+    slots_[level][slot] = timer;
+    occupied_[level] |= 1ULL << slot;
+}
+
+// 调用方需持有 mutex_
+void TimerService::Unlink(Timer* timer) {
+    if (timer->prev != nullptr) {
+        timer->prev->next = timer->next;
+    } else {
+        slots_[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next != nullptr) {
+        timer->next->prev = timer->prev;
+    }
+    if (slots_[timer->level][timer->slot] == nullptr) {
+        occupied_[timer->level] &= ~(1ULL << timer->slot);
+    }
+    timer->next = nullptr;
+    timer->prev = nullptr;
+}
+
+// 调用方需持有 mutex_，current_tick_ 到达某层的槽边界时，把上层对应槽中的定时器重新放入下层
+// 级联在到达边界时立即进行，保证各层当前槽都已处理过，NextExpiry 可以直接从下一个槽开始找
+void TimerService::Cascade() {
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if ((current_tick_ & ((1LL << (TIMER_WHEEL_SLOT_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        int slot = (current_tick_ >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+        Timer* timer = slots_[level][slot];
+        slots_[level][slot] = nullptr;
+        occupied_[level] &= ~(1ULL << slot);
+        while (timer != nullptr) {
+            Timer* next = timer->next;
+            Link(timer);
+            timer = next;
+        }
+    }
+}
+
+// 调用方需持有 mutex_，处理到 now_us 为止的全部 tick，到期的回调放入 fired_
+void TimerService::Advance(int64_t now_us) {
+    int64_t now_tick = now_us / TIMER_WHEEL_TICK_US;
+    while (current_tick_ <= now_tick) {
+        int index = current_tick_ & TIMER_WHEEL_SLOT_MASK;
+        Timer* timer = slots_[0][index];
+        slots_[0][index] = nullptr;
+        occupied_[0] &= ~(1ULL << index);
+        while (timer != nullptr) {
+            Timer* next = timer->next;
+            timer->next = nullptr;
+            timer->prev = nullptr;
+            if (timer->expires > current_tick_) {
+                Link(timer);
+            } else {
+                fired_.push_back(Fired{timer->dispatch, timer, timer->generation, timer->callback});
+                stats_.fired++;
+                if (timer->period_us > 0) {
+                    // 错过的周期直接跳过，与 esp_timer 的 skip_unhandled_events 一致
+                    timer->deadline_us += timer->period_us;
+                    if (timer->deadline_us <= now_us) {
+                        timer->deadline_us += ((now_us - timer->deadline_us) / timer->period_us + 1) * timer->period_us;
+                    }
+                    timer->expires = std::max(GetExpires(timer->deadline_us, timer->slack_ticks), current_tick_ + 1);
+                    Link(timer);
+                } else {
+                    timer->active = false;
+                }
+            }
+            timer = next;
+        }
+
+        // 跳过空槽，直到下一个有定时器的槽或下一次级联
+        uint64_t rest = index == TIMER_WHEEL_SLOT_MASK ? 0 : occupied_[0] & (~0ULL << (index + 1));
+        int64_t next_tick = rest != 0 ? current_tick_ - index + __builtin_ctzll(rest) : (current_tick_ | TIMER_WHEEL_SLOT_MASK) + 1;
+        current_tick_ = std::min(next_tick, now_tick + 1);
+        Cascade();
+    }
+}
+
+// 调用方需持有 mutex_，返回最早的到期 tick，没有定时器时返回 -1
+int64_t TimerService::NextExpiry() {
+    int index = current_tick_ & TIMER_WHEEL_SLOT_MASK;
+    uint64_t ahead = occupied_[0] & (~0ULL << index);
+    if (ahead != 0) {
+        return current_tick_ - index + __builtin_ctzll(ahead);
+    }
+    int64_t next = -1;
+    if (occupied_[0] != 0) {
+        next = current_tick_ - index + TIMER_WHEEL_SLOTS + __builtin_ctzll(occupied_[0]);
+    }
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t bits = occupied_[level];
+        if (bits == 0) {
+            continue;
+        }
+        // 当前槽已经级联过，其中的定时器属于下一轮，从下一个槽开始找
+        int start = (((current_tick_ >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK) + 1) & TIMER_WHEEL_SLOT_MASK;
+        uint64_t rotated = start == 0 ? bits : (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start));
+        int slot = (start + __builtin_ctzll(rotated)) & TIMER_WHEEL_SLOT_MASK;
+        for (Timer* timer = slots_[level][slot]; timer != nullptr; timer = timer->next) {
+            if (next < 0 || timer->expires < next) {
+                next = timer->expires;
+            }
+        }
+    }
+    return next;
+}
+
+// 调用方需持有 mutex_
+void TimerService::Rearm() {
+    int64_t next = NextExpiry();
+    if (next == armed_tick_) {
+        return;
+    }
+    if (armed_tick_ >= 0) {
+        esp_timer_stop(wheel_timer_);
+    }
+    armed_tick_ = next;
+    if (next < 0) {
+        return;
+    }
+    int64_t delay_us = std::max<int64_t>(0, next * TIMER_WHEEL_TICK_US - esp_timer_get_time());
+    esp_timer_start_once(wheel_timer_, delay_us);
+}
+
+void TimerService::OnWheelTimer() {
+    std::function<void(std::function<void()>)> dispatcher;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        armed_tick_ = -1;
+        stats_.wakeups++;
+        Advance(esp_timer_get_time());
+        Rearm();
+        running_task_ = xTaskGetCurrentTaskHandle();
+        dispatcher = main_loop_dispatcher_;
+    }
+
+    // fired_ 只在本任务中读写
+    for (auto& fired : fired_) {
+        if (fired.dispatch == kTimerDispatchMainLoop && dispatcher) {
+            // 投递后到主循环执行前被删除的定时器同样不再执行
+            dispatcher([this, timer = fired.timer, generation = fired.generation, callback = std::move(fired.callback)]() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (timer->generation != generation) {
+                        return;
+                    }
+                }
+                callback();
+            });
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // 收集之后被删除的定时器不再执行
+            if (fired.timer->generation != fired.generation) {
+                continue;
+            }
+            running_ = fired.timer;
+        }
+        fired.callback();
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = nullptr;
+        idle_cv_.notify_all();
+    }
+    fired_.clear();
+}
@@ -0,0 +1,114 @@
+#ifndef TIMER_SERVICE_H
+#define TIMER_SERVICE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+// 时间轮精度，定时器的触发时间向上取整到该粒度
+#define TIMER_WHEEL_TICK_MS 10
+// 4 层，每层 64 个槽，最长可覆盖 10 ms * 64^4 ≈ 46 小时
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+enum TimerDispatch {
+    kTimerDispatchTimerTask,    // 在 esp_timer 任务中执行，回调需要短小且不能阻塞
+    kTimerDispatchMainLoop,     // 投递到主循环执行
+};
+
+struct TimerServiceStats {
+    uint32_t wakeups = 0;       // 底层 esp_timer 唤醒次数
+    uint32_t fired = 0;         // 触发的回调次数，大于 wakeups 的部分来自合并唤醒
+    uint32_t active = 0;
+};
+
+/*
+ * 集中管理周期性任务的分层时间轮，全部定时器共用一个单次 esp_timer，只在最近的到期时间唤醒
+ * 每个定时器可以设置允许延后的时间 (slack)，slack 范围内已有其它定时器到期时合并到同一次唤醒，
+ * 否则对齐到 2 的幂个 tick，减少空闲时的唤醒次数，light sleep 可以持续更久
+ */
+class TimerService {
+public:
+    static TimerService& GetInstance() {
+        static TimerService instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    // 返回定时器 id，创建后需调用 StartPeriodic 或 StartOnce 才会运行
+    int Create(const char* name, TimerDispatch dispatch, std::function<void()> callback);
+    // 重新启动已在运行的定时器时，以本次调用时间为起点
+    void StartPeriodic(int id, uint32_t period_ms, uint32_t slack_ms = 0);
+    void StartOnce(int id, uint32_t delay_ms, uint32_t slack_ms = 0);
+    // 已投递到主循环尚未执行的回调被丢弃
+    void Stop(int id);
+    // 回调正在定时器任务中执行时，等待其结束后返回；已投递到主循环尚未执行的回调被丢弃
+    void Delete(int id);
+    bool IsActive(int id);
+    // 主循环由 Application 提供，未设置时 kTimerDispatchMainLoop 的回调在定时器任务中执行
+    void SetMainLoopDispatcher(std::function<void(std::function<void()>)> dispatcher);
+    // 返回统计并清零计数
+    TimerServiceStats GetStats();
+
+private:
+    TimerService();
+    ~TimerService();
+
+    struct Timer {
+        const char* name = nullptr;
+        TimerDispatch dispatch = kTimerDispatchTimerTask;
+        std::function<void()> callback;
+        int64_t period_us = 0;      // 0 表示单次
+        int64_t slack_ticks = 0;
+        int64_t deadline_us = 0;    // 不含 slack 的到期时间，周期定时器以此累加，避免取整和对齐造成漂移
+        int64_t expires = 0;        // 对齐后实际触发的 tick
+        bool in_use = false;
+        bool active = false;
+        uint32_t generation = 0;    // 停止或删除时递增，丢弃此前已收集或已投递到主循环的回调
+        Timer* next = nullptr;
+        Timer* prev = nullptr;
+        int level = 0;
+        int slot = 0;
+    };
+    struct Fired {
+        TimerDispatch dispatch;
+        Timer* timer;
+        uint32_t generation;
+        std::function<void()> callback;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    esp_timer_handle_t wheel_timer_ = nullptr;
+    std::deque<Timer> timers_;      // deque 扩容时不移动已有元素，id 即下标
+    Timer* slots_[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS] = {};
+    uint64_t occupied_[TIMER_WHEEL_LEVELS] = {};
+    int64_t current_tick_ = 0;      // 下一个待处理的 tick
+    int64_t armed_tick_ = -1;       // 底层 esp_timer 当前的唤醒 tick，-1 表示未启动
+    std::vector<Fired> fired_;
+    Timer* running_ = nullptr;
+    TaskHandle_t running_task_ = nullptr;
+    std::function<void(std::function<void()>)> main_loop_dispatcher_;
+    TimerServiceStats stats_;
+
+    int64_t GetExpires(int64_t deadline_us, int64_t slack_ticks);
+    int64_t FindExpires(int64_t from, int64_t to);
+    void Start(int id, uint32_t delay_ms, uint32_t period_ms, uint32_t slack_ms);
+    void Link(Timer* timer);
+    void Unlink(Timer* timer);
+    void Cascade();
+    void Advance(int64_t now_us);
+    int64_t NextExpiry();
+    void Rearm();
+    void OnWheelTimer();
+};
+
+#endif // TIMER_SERVICE_H
@@ -0,0 +1,226 @@
+#include "trace_recorder.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/base64.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#define TAG "TraceRecorder"
+
+// 没有 PSRAM 时每个核心使用较小的内部 RAM 缓冲区
+#define TRACE_INTERNAL_CAPACITY (8 * 1024)
+
+bool TraceRecorder::Start(size_t capacity) {
+    if (enabled_.load()) {
+        return true;
+    }
+
+    for (auto& ring : rings_) {
+        // 容量取 2 的幂，写入位置直接取模
+        size_t count = EventCount(capacity / portNUM_PROCESSORS);
+        ring.events = (Event*)heap_caps_malloc(count * sizeof(Event), MALLOC_CAP_SPIRAM);
+        if (ring.events == nullptr) {
+            count = EventCount(TRACE_INTERNAL_CAPACITY);
+            ring.events = (Event*)heap_caps_malloc(count * sizeof(Event), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (ring.events == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate trace buffer");
+            return false;
+        }
+        ring.mask = count - 1;
+    }
+    ESP_LOGI(TAG, "Trace recorder started, %lu events per core", rings_[0].mask + 1);
+    enabled_.store(true);
+    return true;
+}
+
+size_t TraceRecorder::EventCount(size_t size) {
+    size_t count = 1;
+    while (count * 2 * sizeof(Event) <= size) {
+        count *= 2;
+    }
+    return count;
+}
+
+void TraceRecorder::Record(TraceType type, const char* name, uint32_t arg, int64_t time_us) {
+    if (!enabled_.load(std::memory_order_relaxed) || dumping_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // 任务可能在取得核心号之后被迁移，原子加法保证多个写入者也不会写入同一位置
+    auto& ring = rings_[xPortGetCoreID()];
+    uint32_t position = ring.head.fetch_add(1, std::memory_order_relaxed);
+    auto& event = ring.events[position & ring.mask];
+    event.time_us = time_us;
+    event.name = name;
+    event.arg = arg;
+    event.type = type;
+    event.task = GetTaskIndex();
+}
+
+// 序号加 1 后存入线程局部存储，0 表示本任务尚未登记；新任务的线程局部存储为空，不受句柄复用影响
+uint8_t TraceRecorder::GetTaskIndex() {
+#if configNUM_THREAD_LOCAL_STORAGE_POINTERS > TRACE_TLS_INDEX
+    auto cached = (uintptr_t)pvTaskGetThreadLocalStoragePointer(NULL, TRACE_TLS_INDEX);
+    if (cached != 0) {
+        return cached - 1;
+    }
+    uint8_t index = RegisterTask();
+    // 登记已满时同样缓存，之后不再查找
+    vTaskSetThreadLocalStoragePointer(NULL, TRACE_TLS_INDEX, (void*)((uintptr_t)index + 1));
+    return index;
+#else
+    return RegisterTask();
+#endif
+}
+
+// 任务第一次记录事件时登记名称，任务删除后名称仍然保留
+// 任务删除后句柄可能被新任务复用，句柄相同但名称不同时另行登记
+uint8_t TraceRecorder::RegisterTask() {
+    auto handle = xTaskGetCurrentTaskHandle();
+    const char* name = pcTaskGetName(handle);
+    for (int i = 0; i < TRACE_MAX_TASKS; i++) {
+        auto current = tasks_[i].handle.load(std::memory_order_acquire);
+        if (current == nullptr) {
+            if (!tasks_[i].handle.compare_exchange_strong(current, handle)) {
+                // 被其它任务抢先登记，继续向后查找
+                continue;
+            }
+            strncpy(tasks_[i].name, name, TRACE_TASK_NAME_LENGTH - 1);
+            tasks_[i].registered.store(true, std::memory_order_release);
+            return i;
+        }
+        // 同一句柄只可能是本任务或已删除的任务，名称在登记它的任务中写入，读取前等待其完成
+        if (current == handle && tasks_[i].registered.load(std::memory_order_acquire) &&
+            strncmp(tasks_[i].name, name, TRACE_TASK_NAME_LENGTH - 1) == 0) {
+            return i;
+        }
+    }
+    return TRACE_UNKNOWN_TASK;
+}
+
+void TraceRecorder::DumpAsync() {
+    if (!enabled_.load() || dumping_.exchange(true)) {
+        return;
+    }
+
+    xTaskCreate([](void* arg) {
+        auto recorder = (TraceRecorder*)arg;
+        recorder->Dump();
+        vTaskDelete(NULL);
+    }, "dump_trace", 4096, this, 1, nullptr);
+}
+
+// 以 base64 文本按行输出，与会话录制的导出方式相同
+void TraceRecorder::Dump() {
+    // 等待已开始的写入完成
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    // 事件中的名称指针映射为名称表的序号
+    std::vector<const char*> names;
+    uint32_t event_count = 0;
+    uint32_t dropped = 0;
+    for (auto& ring : rings_) {
+        uint32_t head = ring.head.load();
+        uint32_t count = std::min(head, ring.mask + 1);
+        dropped += head - count;
+        event_count += count;
+        for (uint32_t i = head - count; i != head; i++) {
+            auto name = ring.events[i & ring.mask].name;
+            if (std::find(names.begin(), names.end(), name) == names.end()) {
+                names.push_back(name);
+            }
+        }
+    }
+    uint8_t task_count = 0;
+    while (task_count < TRACE_MAX_TASKS && tasks_[task_count].handle.load() != nullptr) {
+        task_count++;
+    }
+
+    ESP_LOGI(TAG, "Dumping %lu events, %u names, %lu dropped", event_count, names.size(), dropped);
+    printf("\n-----BEGIN XIAOZHI TRACE-----\n");
+
+    // 每行 57 字节原始数据，编码后为 76 个字符
+    const size_t line_size = 57;
+    uint8_t line[line_size];
+    size_t line_used = 0;
+    int lines = 0;
+    auto flush_line = [&]() {
+        unsigned char encoded[80];
+        size_t encoded_len = 0;
+        mbedtls_base64_encode(encoded, sizeof(encoded), &encoded_len, line, line_used);
+        printf("%.*s\n", (int)encoded_len, encoded);
+        line_used = 0;
+        // 定期让出 CPU，避免长时间占用导致看门狗复位
+        if (++lines % 16 == 0) {
+            vTaskDelay(1);
+        }
+    };
+    auto write = [&](const void* data, size_t size) {
+        auto p = (const uint8_t*)data;
+        while (size > 0) {
+            size_t n = std::min(size, line_size - line_used);
+            memcpy(line + line_used, p, n);
+            line_used += n;
+            p += n;
+            size -= n;
+            if (line_used == line_size) {
+                flush_line();
+            }
+        }
+    };
+
+    uint8_t header[18];
+    memcpy(header, TRACE_MAGIC, 5);
+    header[5] = TRACE_VERSION;
+    header[6] = portNUM_PROCESSORS;
+    header[7] = task_count;
+    uint16_t name_count = htons(names.size());
+    uint32_t events = htonl(event_count);
+    uint32_t dropped_events = htonl(dropped);
+    memcpy(header + 8, &name_count, 2);
+    memcpy(header + 10, &events, 4);
+    memcpy(header + 14, &dropped_events, 4);
+    write(header, sizeof(header));
+
+    for (int i = 0; i < task_count; i++) {
+        write(tasks_[i].name, TRACE_TASK_NAME_LENGTH);
+    }
+    for (auto name : names) {
+        uint8_t length = std::min<size_t>(strlen(name), 255);
+        write(&length, 1);
+        write(name, length);
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        auto& ring = rings_[core];
+        uint32_t head = ring.head.load();
+        uint32_t count = std::min(head, ring.mask + 1);
+        for (uint32_t i = head - count; i != head; i++) {
+            auto& event = ring.events[i & ring.mask];
+            uint8_t record[17];
+            uint32_t time_high = htonl((uint64_t)event.time_us >> 32);
+            uint32_t time_low = htonl((uint64_t)event.time_us & 0xFFFFFFFF);
+            uint16_t name = htons(std::find(names.begin(), names.end(), event.name) - names.begin());
+            uint32_t arg = htonl(event.arg);
+            memcpy(record, &time_high, 4);
+            memcpy(record + 4, &time_low, 4);
+            record[8] = event.type;
+            record[9] = core;
+            record[10] = event.task;
+            memcpy(record + 11, &name, 2);
+            memcpy(record + 13, &arg, 4);
+            write(record, sizeof(record));
+        }
+    }
+    if (line_used > 0) {
+        flush_line();
+    }
+    printf("-----END XIAOZHI TRACE-----\n");
+    fflush(stdout);
+
+    dumping_.store(false);
+}
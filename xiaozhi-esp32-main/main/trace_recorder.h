@@ -0,0 +1,124 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * 时间线剖析，记录区间 (begin/end)、带耗时的完整区间和瞬时事件，用于查看启动和运行时各环节的耗时
+ * 每个核心一个环形缓冲区（优先使用 PSRAM），写入只有一次原子加法，不加锁；写满后覆盖最早的事件
+ * （写入中途被抢占超过整整一圈时该事件可能被覆盖为其它事件的内容）
+ * 通过串口以 base64 导出，用 scripts/stub_server/trace_export.py 转为 Chrome trace JSON，可在 Perfetto 中查看
+ *
+ * 事件名称只保存指针，必须是字符串常量或生命周期足够长的静态字符串
+ * 未启用 CONFIG_USE_TRACE_PROFILER 时所有 TRACE_ 宏展开为空，不产生任何代码
+ *
+ * 导出文件格式（多字节整数为网络字节序）：
+ * |magic "XZTRC" 5u|version 1u|core_count 1u|task_count 1u|name_count 2u|event_count 4u|dropped 4u|
+ * |{task: name 16u}...|{name: length 1u|text}...|{event}...|
+ * 事件格式：
+ * |time_us 8u|type 1u|core 1u|task 1u|name 2u|arg 4u|
+ */
+
+#define TRACE_MAGIC "XZTRC"
+#define TRACE_VERSION 1
+// 记录名称的任务数量上限，超出的任务记为 TRACE_UNKNOWN_TASK
+#define TRACE_MAX_TASKS 32
+#define TRACE_UNKNOWN_TASK 0xFF
+#define TRACE_TASK_NAME_LENGTH 16
+// 在 FreeRTOS 线程局部存储中缓存任务序号，0 号由 pthread 使用
+// 需要 CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS >= 2，否则每次记录都按句柄查找
+#define TRACE_TLS_INDEX 1
+
+enum TraceType : uint8_t {
+    kTraceBegin = 0,
+    kTraceEnd = 1,
+    kTraceInstant = 2,      // arg 为附带的数值
+    kTraceComplete = 3,     // time_us 为开始时间，arg 为耗时 (us)
+};
+
+class TraceRecorder {
+public:
+    static TraceRecorder& GetInstance() {
+        static TraceRecorder instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // capacity 为所有核心的总字节数
+    bool Start(size_t capacity);
+    void Record(TraceType type, const char* name, uint32_t arg = 0, int64_t time_us = esp_timer_get_time());
+    // 在独立任务中通过串口导出全部事件，导出期间新的事件被丢弃
+    void DumpAsync();
+
+private:
+    TraceRecorder() = default;
+    ~TraceRecorder() = default;
+
+    struct Event {
+        int64_t time_us;
+        const char* name;
+        uint32_t arg;
+        TraceType type;
+        uint8_t task;
+    };
+    struct Ring {
+        Event* events = nullptr;
+        uint32_t mask = 0;
+        std::atomic<uint32_t> head{0};
+    };
+    struct Task {
+        std::atomic<TaskHandle_t> handle{nullptr};
+        std::atomic<bool> registered{false};
+        char name[TRACE_TASK_NAME_LENGTH] = {};
+    };
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<bool> dumping_{false};
+    Ring rings_[portNUM_PROCESSORS];
+    Task tasks_[TRACE_MAX_TASKS];
+
+    static size_t EventCount(size_t size);
+    uint8_t GetTaskIndex();
+    uint8_t RegisterTask();
+    void Dump();
+};
+
+// 在作用域结束时记录 end
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(name) { TraceRecorder::GetInstance().Record(kTraceBegin, name_); }
+    ~TraceScope() { TraceRecorder::GetInstance().Record(kTraceEnd, name_); }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if CONFIG_USE_TRACE_PROFILER
+#define TRACE_BEGIN(name) TraceRecorder::GetInstance().Record(kTraceBegin, name)
+#define TRACE_END(name) TraceRecorder::GetInstance().Record(kTraceEnd, name)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name, arg) TraceRecorder::GetInstance().Record(kTraceInstant, name, arg)
+// 已知开始时间的区间，例如排队等待后才执行的任务
+#define TRACE_COMPLETE(name, start_us, end_us) \
+    TraceRecorder::GetInstance().Record(kTraceComplete, name, (uint32_t)((end_us) - (start_us)), start_us)
+#else
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name) do {} while (0)
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_INSTANT(name, arg) do {} while (0)
+#define TRACE_COMPLETE(name, start_us, end_us) do {} while (0)
+#endif
+
+#endif // TRACE_RECORDER_H
@@ -0,0 +1,170 @@
+# 端到端对话延迟基准测试
+# 在同一进程中运行替身服务器并读取设备串口日志，所有事件使用同一个主机时钟 (time.monotonic)
+import argparse
+import asyncio
+import json
+import re
+import sys
+import threading
+import time
+
+import stub_server
+
+# 设备端日志中作为测量边界的行 (main/application.cc)
+DEFAULT_WAKE_PATTERN = r"Wake word triggered|触发对话"
+DEFAULT_SPEAKING_PATTERN = r"Device state changed from \w+ to speaking"
+DEFAULT_ABORT_PATTERN = r"Abort speaking"
+DEFAULT_LEAVE_SPEAKING_PATTERN = r"Device state changed from speaking to \w+"
+
+
+def percentile(values, p):
+    values = sorted(values)
+    if not values:
+        return None
+    k = (len(values) - 1) * p / 100
+    lower = int(k)
+    upper = min(lower + 1, len(values) - 1)
+    return values[lower] + (values[upper] - values[lower]) * (k - lower)
+
+
+class LatencyTracker:
+    """
+    将设备日志和服务器事件匹配成一次次对话，计算:
+    wake_to_first_audio: 设备唤醒 -> 设备开始播放 TTS
+    speech_end_to_first_tts: 服务器判定用户说完 -> 设备开始播放 TTS
+    abort_to_server: 设备打断 -> 服务器收到 abort
+    abort_to_stop: 设备打断 -> 设备退出 speaking 状态
+    """
+
+    def __init__(self, args):
+        self.wake_re = re.compile(args.wake_pattern)
+        self.speaking_re = re.compile(args.speaking_pattern)
+        self.abort_re = re.compile(args.abort_pattern)
+        self.leave_speaking_re = re.compile(args.leave_speaking_pattern)
+        self.samples = {
+            "wake_to_first_audio": [],
+            "speech_end_to_first_tts": [],
+            "abort_to_server": [],
+            "abort_to_stop": [],
+        }
+        self.wake_time = None
+        self.speech_end_time = None
+        self.abort_time = None
+        self.turns = 0
+
+    def add(self, name, start, end):
+        ms = (end - start) * 1000
+        self.samples[name].append(ms)
+        print(f"[bench] {name}: {ms:.1f} ms")
+
+    def on_device_line(self, t, line):
+        if self.wake_re.search(line):
+            if self.wake_time is None:
+                self.wake_time = t
+        elif self.speaking_re.search(line):
+            if self.wake_time is not None:
+                self.add("wake_to_first_audio", self.wake_time, t)
+            if self.speech_end_time is not None:
+                self.add("speech_end_to_first_tts", self.speech_end_time, t)
+                self.turns += 1
+            self.wake_time = None
+            self.speech_end_time = None
+        elif self.abort_re.search(line):
+            self.abort_time = t
+        elif self.leave_speaking_re.search(line):
+            if self.abort_time is not None:
+                self.add("abort_to_stop", self.abort_time, t)
+            self.abort_time = None
+
+    def on_server_event(self, entry):
+        if entry["event"] == "speech_end":
+            self.speech_end_time = entry["t"]
+        elif entry["event"] == "abort_in" and self.abort_time is not None:
+            self.add("abort_to_server", self.abort_time, entry["t"])
+
+    def report(self):
+        result = {}
+        for name, values in self.samples.items():
+            if not values:
+                result[name] = {"count": 0}
+                continue
+            result[name] = {
+                "count": len(values),
+                "min": round(min(values), 1),
+                "p50": round(percentile(values, 50), 1),
+                "p90": round(percentile(values, 90), 1),
+                "max": round(max(values), 1),
+            }
+        return result
+
+
+def read_device_log(args, loop, tracker, stop_event):
+    """在线程中读取设备日志，每行到达时立即打上主机时间戳"""
+    if args.serial:
+        import serial
+        port = serial.Serial(args.serial, args.baudrate, timeout=0.5)
+        readline = lambda: port.readline().decode("utf-8", errors="replace")
+    else:
+        readline = sys.stdin.readline
+
+    ansi = re.compile(r"\x1b\[[0-9;]*m")
+    while not stop_event.is_set():
+        line = readline()
+        if not line:
+            if not args.serial:
+                break
+            continue
+        t = time.monotonic()
+        line = ansi.sub("", line.rstrip())
+        if args.echo:
+            print(line)
+        loop.call_soon_threadsafe(tracker.on_device_line, t, line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="端到端对话延迟基准测试")
+    stub_server.add_arguments(parser)
+    parser.add_argument("--serial", default=None, help="设备串口，如 /dev/ttyUSB0；为空则从标准输入读取日志 (idf.py monitor | bench.py)")
+    parser.add_argument("--baudrate", type=int, default=115200, help="串口波特率")
+    parser.add_argument("--turns", type=int, default=10, help="完成多少轮对话后结束")
+    parser.add_argument("--report", default=None, help="将统计结果写入 JSON 文件")
+    parser.add_argument("--echo", action="store_true", help="同时打印设备日志")
+    parser.add_argument("--wake-pattern", default=DEFAULT_WAKE_PATTERN)
+    parser.add_argument("--speaking-pattern", default=DEFAULT_SPEAKING_PATTERN)
+    parser.add_argument("--abort-pattern", default=DEFAULT_ABORT_PATTERN)
+    parser.add_argument("--leave-speaking-pattern", default=DEFAULT_LEAVE_SPEAKING_PATTERN)
+    args = parser.parse_args()
+
+    log = stub_server.EventLog(args.events)
+    tracker = LatencyTracker(args)
+    log.listeners.append(tracker.on_server_event)
+    server = stub_server.make_server(args, log)
+    stop_event = threading.Event()
+
+    async def run():
+        await server.start()
+        loop = asyncio.get_running_loop()
+        reader = threading.Thread(target=read_device_log, args=(args, loop, tracker, stop_event), daemon=True)
+        reader.start()
+        print(f"[bench] 等待 {args.turns} 轮对话，请唤醒设备并与之对话 (Ctrl+C 提前结束)")
+        while tracker.turns < args.turns and (reader.is_alive() or args.serial):
+            await asyncio.sleep(0.2)
+
+    try:
+        asyncio.run(run())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stop_event.set()
+        log.close()
+
+    result = tracker.report()
+    result["network"] = server.impairment.report()
+    print(json.dumps(result, indent=2, ensure_ascii=False))
+    if args.report:
+        with open(args.report, "w", encoding="utf-8") as f:
+            json.dump(result, f, indent=2, ensure_ascii=False)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,238 @@
+# 解析、分析、导出和回放设备端会话录制 (main/protocols/session_recorder.h)
+import argparse
+import asyncio
+import base64
+import json
+import struct
+import sys
+
+from bench import percentile
+
+MAGIC = b"XZCAP"
+BEGIN_MARKER = "-----BEGIN XIAOZHI CAPTURE-----"
+END_MARKER = "-----END XIAOZHI CAPTURE-----"
+RECORD_HEADER = struct.Struct(">BBHIQI")
+
+DIRECTIONS = ["in", "out"]
+KINDS = ["json", "audio", "control", "event"]
+
+
+def read_capture(path):
+    """读取录制文件，可以是串口日志 (base64 文本) 或已解码的二进制文件"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data.startswith(MAGIC):
+        return data
+
+    text = data.decode("utf-8", errors="replace")
+    begin = text.rfind(BEGIN_MARKER)
+    end = text.find(END_MARKER, begin)
+    if begin < 0 or end < 0:
+        raise ValueError("capture markers not found")
+    # 每行单独编码，逐行解码
+    lines = text[begin + len(BEGIN_MARKER):end].split()
+    return b"".join(base64.b64decode(line) for line in lines)
+
+
+def parse_capture(data):
+    if not data.startswith(MAGIC):
+        raise ValueError("invalid capture magic")
+    version = data[5]
+    record_count, dropped = struct.unpack_from(">II", data, 6)
+    records = []
+    offset = 14
+    while offset + RECORD_HEADER.size <= len(data):
+        direction, kind, length, sequence, time_us, audio_timestamp = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        payload = data[offset:offset + length]
+        offset += length
+        records.append({
+            "direction": DIRECTIONS[direction],
+            "kind": KINDS[kind] if kind < len(KINDS) else str(kind),
+            "sequence": sequence,
+            "time_us": time_us,
+            "audio_timestamp": audio_timestamp,
+            "payload": payload,
+        })
+    if len(records) != record_count:
+        print(f"warning: header says {record_count} records, parsed {len(records)}", file=sys.stderr)
+    return {"version": version, "dropped": dropped, "records": records}
+
+
+def load(path):
+    return parse_capture(read_capture(path))
+
+
+def describe(record):
+    if record["kind"] in ("json", "event"):
+        return record["payload"].decode("utf-8", errors="replace")
+    if record["kind"] == "control":
+        import control_codec
+        try:
+            return json.dumps(control_codec.decode(record["payload"]), ensure_ascii=False)
+        except ValueError:
+            return record["payload"].hex()
+    return f"{len(record['payload'])} bytes"
+
+
+def gaps(records, direction):
+    """同一方向上相邻音频帧的间隔 (ms)，返回 [(gap_ms, record)]"""
+    audio = [r for r in records if r["kind"] == "audio" and r["direction"] == direction]
+    return [((b["time_us"] - a["time_us"]) / 1000, b) for a, b in zip(audio, audio[1:])]
+
+
+def cmd_info(capture, args):
+    records = capture["records"]
+    if not records:
+        print("empty capture")
+        return
+    start = records[0]["time_us"]
+    duration = (records[-1]["time_us"] - start) / 1e6
+    missing = sum(b["sequence"] - a["sequence"] - 1 for a, b in zip(records, records[1:]))
+    print(f"records: {len(records)}, duration: {duration:.1f} s, dropped: {capture['dropped']}, "
+          f"sequence gaps: {missing}")
+
+    counts = {}
+    for r in records:
+        key = f"{r['direction']}/{r['kind']}"
+        counts[key] = counts.get(key, 0) + 1
+    for key, count in sorted(counts.items()):
+        print(f"  {key}: {count}")
+
+    # 下行音频的到达间隔过大意味着播放可能卡顿，上行间隔过大意味着录音或发送被阻塞
+    for direction in ("in", "out"):
+        values = gaps(records, direction)
+        if not values:
+            continue
+        ms = [g for g, _ in values]
+        print(f"{direction} audio interval: p50 {percentile(ms, 50):.1f} ms, p99 {percentile(ms, 99):.1f} ms, "
+              f"max {max(ms):.1f} ms")
+        # 对话之间的空闲不算卡顿
+        stalls = sorted((v for v in values if args.min_gap <= v[0] <= args.max_gap), key=lambda v: -v[0])
+        for gap, record in stalls[:args.top]:
+            print(f"  gap {gap:.1f} ms before seq {record['sequence']} at {(record['time_us'] - start) / 1e6:.3f} s")
+
+
+def cmd_dump(capture, args):
+    records = capture["records"]
+    start = records[0]["time_us"] if records else 0
+    for r in records:
+        if args.kind and r["kind"] != args.kind:
+            continue
+        print(f"{(r['time_us'] - start) / 1e6:10.3f} #{r['sequence']:<7} {r['direction']:3} {r['kind']:7} {describe(r)}")
+
+
+def cmd_export(capture, args):
+    records = capture["records"]
+    if args.jsonl:
+        with open(args.jsonl, "w", encoding="utf-8") as f:
+            start = records[0]["time_us"] if records else 0
+            for r in records:
+                if r["kind"] == "audio":
+                    continue
+                entry = {"t": (r["time_us"] - start) / 1e6, "sequence": r["sequence"],
+                         "direction": r["direction"], "kind": r["kind"], "message": describe(r)}
+                f.write(json.dumps(entry, ensure_ascii=False) + "\n")
+    # p3 格式与 scripts/p3_tools 相同，可直接播放或转换
+    for path, direction in ((args.p3_in, "in"), (args.p3_out, "out")):
+        if not path:
+            continue
+        with open(path, "wb") as f:
+            for r in records:
+                if r["kind"] == "audio" and r["direction"] == direction:
+                    f.write(struct.pack(">BBH", 0, 0, len(r["payload"])) + r["payload"])
+
+
+def replay_records(capture, args):
+    """选出需要回放给设备的下行记录，跳过 hello 和本地事件"""
+    selected = []
+    for r in capture["records"]:
+        if r["direction"] != "in" or r["sequence"] < args.from_seq:
+            continue
+        if r["kind"] == "json":
+            message = json.loads(r["payload"])
+            if message.get("type") in ("hello", "goodbye"):
+                continue
+            message.pop("session_id", None)
+            selected.append((r["time_us"], message, None))
+        elif r["kind"] == "audio":
+            selected.append((r["time_us"], None, r))
+    return selected
+
+
+async def replay_session(session, records, speed):
+    """按录制时的时间间隔把下行消息和音频重新发送给设备"""
+    loop = asyncio.get_running_loop()
+    start = loop.time()
+    first = records[0][0]
+    for time_us, message, audio in records:
+        delay = start + (time_us - first) / 1e6 / speed - loop.time()
+        if delay > 0:
+            await asyncio.sleep(delay)
+        if message is not None:
+            await session.send_json(message)
+        else:
+            await session.send_audio(audio["payload"], timestamp=audio["audio_timestamp"])
+    session.log.record(session.name, "replay_done", records=len(records))
+    print(f"replay finished: {len(records)} records")
+
+
+def cmd_replay(capture, args):
+    import stub_server
+
+    records = replay_records(capture, args)
+    if not records:
+        print("nothing to replay")
+        return
+    log = stub_server.EventLog(args.events)
+    server = stub_server.make_server(args, log)
+    server.auto_reply = False
+    server.on_session_ready = lambda session: asyncio.ensure_future(replay_session(session, records, args.replay_speed))
+
+    async def run():
+        await server.start()
+        print(f"waiting for device to connect, {len(records)} records to replay")
+        await asyncio.Future()
+
+    try:
+        asyncio.run(run())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        log.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="设备端会话录制工具")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    info = sub.add_parser("info", help="统计信息和音频间隔分析")
+    info.add_argument("capture")
+    info.add_argument("--min-gap", type=float, default=120, help="视为卡顿的最小帧间隔 (ms)")
+    info.add_argument("--max-gap", type=float, default=5000, help="超过该间隔视为对话之间的空闲 (ms)")
+    info.add_argument("--top", type=int, default=10, help="列出最大的若干个间隔")
+
+    dump = sub.add_parser("dump", help="按时间顺序打印全部记录")
+    dump.add_argument("capture")
+    dump.add_argument("--kind", choices=KINDS, default=None)
+
+    export = sub.add_parser("export", help="导出消息和音频")
+    export.add_argument("capture")
+    export.add_argument("--jsonl", default=None, help="导出控制消息")
+    export.add_argument("--p3-in", default=None, help="导出下行 (TTS) 音频为 p3 文件")
+    export.add_argument("--p3-out", default=None, help="导出上行 (麦克风) 音频为 p3 文件")
+
+    import stub_server
+    replay = sub.add_parser("replay", help="以替身服务器的身份把录制的下行消息和音频按原时序回放给设备")
+    replay.add_argument("capture")
+    replay.add_argument("--from-seq", type=int, default=0, help="从该序号开始回放")
+    replay.add_argument("--replay-speed", type=float, default=1.0, help="回放速度倍率")
+    stub_server.add_arguments(replay)
+
+    args = parser.parse_args()
+    capture = load(args.capture)
+    {"info": cmd_info, "dump": cmd_dump, "export": cmd_export, "replay": cmd_replay}[args.command](capture, args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+# Protocol v4 二进制控制消息编解码，与 main/protocols/control_codec.cc 保持一致
+# 负载格式: |msg_type 1u|field_count 1u|{field_tag 1u|field_len 2u|field_value}...|
+import argparse
+import json
+import struct
+import time
+
+BINARY_PROTOCOL_TYPE_AUDIO = 0
+BINARY_PROTOCOL_TYPE_CONTROL = 1
+
+MESSAGE_TYPES = [None, "listen", "abort", "iot", "tts", "stt", "llm"]
+FIELDS = [None, "state", "mode", "reason", "text", "emotion", "states", "descriptors", "commands"]
+ENUM_VALUES = {
+    "state": ["start", "stop", "detect", "sentence_start", "sentence_end"],
+    "mode": ["auto", "manual", "realtime"],
+    "reason": ["none", "wake_word_detected"],
+}
+STRING_FIELDS = ("text", "emotion")
+JSON_FIELDS = ("states", "descriptors", "commands")
+# BinaryProtocol3 的 payload_size 为 16 位
+MAX_RECORD_SIZE = 0xFFFF
+MAX_FIELDS = 0xFF
+
+
+def encode(message):
+    """
+    将 JSON 控制消息 (dict) 编码为二进制记录，无法表示或超出长度限制的消息返回 None
+    session_id 与 iot 的 update 字段在 v4 中是隐含的，直接忽略
+    """
+    msg_type = message.get("type")
+    if msg_type not in MESSAGE_TYPES[1:]:
+        return None
+
+    fields = []
+    for name, value in message.items():
+        if name in ("type", "session_id", "update"):
+            continue
+        if name not in FIELDS:
+            return None
+        tag = FIELDS.index(name)
+        if name in ENUM_VALUES:
+            if value not in ENUM_VALUES[name]:
+                return None
+            data = bytes([ENUM_VALUES[name].index(value)])
+        elif name in STRING_FIELDS:
+            data = str(value).encode("utf-8")
+        else:
+            data = json.dumps(value, ensure_ascii=False, separators=(",", ":")).encode("utf-8")
+        if len(data) > MAX_RECORD_SIZE:
+            return None
+        fields.append(struct.pack(">BH", tag, len(data)) + data)
+
+    record = bytes([MESSAGE_TYPES.index(msg_type), len(fields)]) + b"".join(fields)
+    if len(fields) > MAX_FIELDS or len(record) > MAX_RECORD_SIZE:
+        return None
+    return record
+
+
+def decode(data):
+    """解码二进制记录为 dict，格式错误时抛出 ValueError，未知字段被忽略"""
+    if len(data) < 2 or data[0] == 0 or data[0] >= len(MESSAGE_TYPES):
+        raise ValueError("invalid control record")
+
+    message = {"type": MESSAGE_TYPES[data[0]]}
+    offset = 2
+    for _ in range(data[1]):
+        if offset + 3 > len(data):
+            raise ValueError("truncated control record")
+        tag, length = struct.unpack_from(">BH", data, offset)
+        offset += 3
+        value = data[offset:offset + length]
+        if len(value) != length:
+            raise ValueError("truncated control field")
+        offset += length
+
+        if tag == 0 or tag >= len(FIELDS):
+            continue
+        name = FIELDS[tag]
+        if name in ENUM_VALUES:
+            if length != 1 or value[0] >= len(ENUM_VALUES[name]):
+                raise ValueError(f"invalid {name} value")
+            message[name] = ENUM_VALUES[name][value[0]]
+        elif name in STRING_FIELDS:
+            message[name] = value.decode("utf-8")
+        else:
+            message[name] = json.loads(value.decode("utf-8"))
+    return message
+
+
+# 设备端常见的控制消息，用于对比 JSON 与二进制记录
+BENCH_MESSAGES = [
+    {"session_id": "a1b2c3d4", "type": "listen", "state": "detect", "text": "你好小智"},
+    {"session_id": "a1b2c3d4", "type": "listen", "state": "start", "mode": "auto"},
+    {"session_id": "a1b2c3d4", "type": "listen", "state": "stop"},
+    {"session_id": "a1b2c3d4", "type": "abort", "reason": "wake_word_detected"},
+    {"session_id": "a1b2c3d4", "type": "tts", "state": "sentence_start", "text": "今天天气晴，最高气温二十五度。"},
+    {"session_id": "a1b2c3d4", "type": "iot", "update": True,
+     "states": [{"name": "Speaker", "state": {"volume": 70}}, {"name": "Screen", "state": {"theme": "light", "brightness": 80}}]},
+]
+
+
+def bench(iterations):
+    """
+    对比线上字节数和编解码耗时，JSON 一侧与设备端一致：手工拼接字符串发送，cJSON_Parse 接收
+    主机上的耗时只用于比较两种格式的相对开销
+    """
+    print(f"{'type':<8}{'json bytes':>12}{'v4 bytes':>10}{'json enc us':>13}{'v4 enc us':>11}{'json dec us':>13}{'v4 dec us':>11}")
+    for message in BENCH_MESSAGES:
+        text = json.dumps(message, ensure_ascii=False, separators=(",", ":")).encode("utf-8")
+        record = encode(message)
+        timings = []
+        for func, arg in ((lambda m: json.dumps(m, ensure_ascii=False, separators=(",", ":")).encode("utf-8"), message),
+                          (encode, message),
+                          (lambda t: json.loads(t.decode("utf-8")), text),
+                          (decode, record)):
+            start = time.perf_counter()
+            for _ in range(iterations):
+                func(arg)
+            timings.append((time.perf_counter() - start) * 1e6 / iterations)
+        # 二进制记录另有 4 字节 BinaryProtocol3 帧头，JSON 以文本帧发送
+        print(f"{message['type']:<8}{len(text):>12}{len(record) + 4:>10}"
+              f"{timings[0]:>13.2f}{timings[1]:>11.2f}{timings[2]:>13.2f}{timings[3]:>11.2f}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Protocol v4 控制消息编解码基准测试")
+    parser.add_argument("--iterations", type=int, default=20000)
+    bench(parser.parse_args().iterations)
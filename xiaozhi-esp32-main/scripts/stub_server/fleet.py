@@ -0,0 +1,306 @@
+# 设备群负载生成器：模拟大量设备同时连接服务器，用于容量规划
+# 每个 CPU 核心一个进程，每个进程一个 asyncio 事件循环承载多个设备会话
+import argparse
+import asyncio
+import json
+import multiprocessing
+import os
+import random
+import struct
+import time
+import uuid
+
+import control_codec
+from bench import percentile
+from stub_server import FRAME_DURATION_MS, SAMPLE_RATE, load_p3
+
+# Opus 静音帧，用于在服务器判定说完之前持续上传
+SILENCE_FRAME = b"\xf8\xff\xfe"
+METRICS = ("hello_ms", "first_tts_ms", "first_audio_ms", "abort_ms")
+
+
+class SessionError(Exception):
+    def __init__(self, kind):
+        super().__init__(kind)
+        self.kind = kind
+
+
+class DeviceSession:
+    """
+    一个模拟设备，流程与 WebsocketProtocol + Application 一致:
+    hello -> listen start -> 上传语音 (之后上传静音直到 tts start) -> 接收 TTS -> tts stop -> 下一轮
+    """
+
+    def __init__(self, args, index, utterance):
+        self.args = args
+        self.index = index
+        self.utterance = utterance
+        self.rng = random.Random(f"{args.seed}:{index}")
+        self.device_id = "02:%02x:%02x:%02x:%02x:%02x" % tuple((index >> s) & 0xFF for s in (32, 24, 16, 8, 0))
+        self.client_id = str(uuid.UUID(int=self.rng.getrandbits(128)))
+        self.version = args.version
+        self.binary_control = False
+        self.session_id = ""
+        self.websocket = None
+        self.incoming = asyncio.Queue()
+        self.samples = {name: [] for name in METRICS}
+        self.errors = {}
+        self.turns = 0
+        self.bytes_up = 0
+        self.bytes_down = 0
+
+    async def send_json(self, message):
+        if self.binary_control:
+            record = control_codec.encode(message)
+        else:
+            record = None
+        if record is not None:
+            data = struct.pack(">BBH", control_codec.BINARY_PROTOCOL_TYPE_CONTROL, 0, len(record)) + record
+        else:
+            data = json.dumps(dict(message, session_id=self.session_id))
+        self.bytes_up += len(data)
+        await self.websocket.send(data)
+
+    async def send_audio(self, payload):
+        if self.version == 2:
+            data = struct.pack(">HHIII", 2, 0, 0, 0, len(payload)) + payload
+        elif self.version >= 3:
+            data = struct.pack(">BBH", control_codec.BINARY_PROTOCOL_TYPE_AUDIO, 0, len(payload)) + payload
+        else:
+            data = payload
+        self.bytes_up += len(data)
+        await self.websocket.send(data)
+
+    async def receive_loop(self):
+        try:
+            async for data in self.websocket:
+                self.bytes_down += len(data)
+                now = time.monotonic()
+                if isinstance(data, str):
+                    await self.incoming.put((now, json.loads(data)))
+                    continue
+                if self.version >= 3 and data[0] == control_codec.BINARY_PROTOCOL_TYPE_CONTROL:
+                    await self.incoming.put((now, control_codec.decode(data[4:])))
+                else:
+                    await self.incoming.put((now, {"type": "audio"}))
+        finally:
+            await self.incoming.put((time.monotonic(), {"type": "closed"}))
+
+    async def wait_for(self, predicate, timeout):
+        """等待满足条件的消息，返回其到达时间和消息"""
+        deadline = time.monotonic() + timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise SessionError("timeout")
+            try:
+                t, message = await asyncio.wait_for(self.incoming.get(), remaining)
+            except asyncio.TimeoutError:
+                raise SessionError("timeout")
+            if message["type"] == "closed":
+                raise SessionError("disconnected")
+            if predicate(message):
+                return t, message
+
+    async def connect(self):
+        import websockets
+        headers = {
+            "Protocol-Version": str(self.version),
+            "Device-Id": self.device_id,
+            "Client-Id": self.client_id,
+        }
+        if self.args.token:
+            headers["Authorization"] = "Bearer " + self.args.token
+        try:
+            self.websocket = await websockets.connect(self.args.url, additional_headers=headers,
+                                                      open_timeout=10, max_size=None)
+        except Exception:
+            raise SessionError("connect_failed")
+        asyncio.ensure_future(self.receive_loop())
+
+        start = time.monotonic()
+        await self.websocket.send(json.dumps({
+            "type": "hello",
+            "version": self.version,
+            "transport": "websocket",
+            "audio_params": {"format": "opus", "sample_rate": SAMPLE_RATE, "channels": 1,
+                             "frame_duration": FRAME_DURATION_MS},
+        }))
+        t, hello = await self.wait_for(lambda m: m["type"] == "hello", 10)
+        self.samples["hello_ms"].append((t - start) * 1000)
+        self.session_id = hello.get("session_id", "")
+        self.binary_control = self.version >= 4 and hello.get("version", 0) >= 4
+
+    async def stream_until_tts(self):
+        """按实时节奏上传语音，语音结束后上传静音，直到收到 tts start；返回语音结束时间"""
+        speech_end = None
+        frame_interval = FRAME_DURATION_MS / 1000
+        start = time.monotonic()
+        i = 0
+        while True:
+            if i < len(self.utterance):
+                await self.send_audio(self.utterance[i])
+            else:
+                if speech_end is None:
+                    speech_end = time.monotonic()
+                await self.send_audio(SILENCE_FRAME)
+            i += 1
+            while not self.incoming.empty():
+                t, message = self.incoming.get_nowait()
+                if message["type"] == "closed":
+                    raise SessionError("disconnected")
+                if message["type"] == "tts" and message.get("state") == "start":
+                    return speech_end or t, t
+            if speech_end is not None and time.monotonic() - speech_end > self.args.response_timeout:
+                raise SessionError("timeout")
+            await asyncio.sleep(max(0, start + i * frame_interval - time.monotonic()))
+
+    async def turn(self):
+        await self.send_json({"type": "listen", "state": "start", "mode": "auto"})
+        speech_end, tts_start = await self.stream_until_tts()
+        self.samples["first_tts_ms"].append((tts_start - speech_end) * 1000)
+
+        t, _ = await self.wait_for(lambda m: m["type"] == "audio", self.args.response_timeout)
+        self.samples["first_audio_ms"].append((t - speech_end) * 1000)
+
+        is_tts_stop = lambda m: m["type"] == "tts" and m.get("state") == "stop"
+        if self.rng.random() < self.args.abort_ratio:
+            # 播放一小段后打断，TTS 在此之前已经结束则不算打断
+            try:
+                await self.wait_for(is_tts_stop, self.rng.uniform(0.2, 1.5))
+            except SessionError as e:
+                if e.kind != "timeout":
+                    raise
+                abort_time = time.monotonic()
+                await self.send_json({"type": "abort"})
+                t, _ = await self.wait_for(is_tts_stop, self.args.response_timeout)
+                self.samples["abort_ms"].append((t - abort_time) * 1000)
+        else:
+            await self.wait_for(is_tts_stop, 120)
+        self.turns += 1
+
+    async def run(self, deadline):
+        while time.monotonic() < deadline:
+            try:
+                if self.websocket is None:
+                    await self.connect()
+                await self.turn()
+                await asyncio.sleep(self.rng.uniform(0.5, 1.5) * self.args.turn_gap)
+            except SessionError as e:
+                self.errors[e.kind] = self.errors.get(e.kind, 0) + 1
+                await self.close()
+                await asyncio.sleep(self.rng.uniform(1, 3))
+        await self.close()
+
+    async def close(self):
+        if self.websocket is not None:
+            try:
+                await self.websocket.close()
+            except Exception:
+                pass
+            self.websocket = None
+        self.incoming = asyncio.Queue()
+
+    def summary(self):
+        return {
+            "index": self.index,
+            "turns": self.turns,
+            "errors": self.errors,
+            "bytes_up": self.bytes_up,
+            "bytes_down": self.bytes_down,
+            "samples": self.samples,
+        }
+
+
+def run_worker(args, indexes):
+    """一个进程中的事件循环，承载 indexes 对应的会话"""
+    utterance = load_p3(args.utterance)
+
+    async def main():
+        sessions = [DeviceSession(args, i, utterance) for i in indexes]
+        deadline = time.monotonic() + args.ramp + args.duration
+
+        async def start(session):
+            # 在 ramp 时间内均匀地启动会话，避免同时握手
+            await asyncio.sleep(args.ramp * session.index / max(1, args.devices))
+            await session.run(deadline)
+
+        await asyncio.gather(*(start(s) for s in sessions))
+        return [s.summary() for s in sessions]
+
+    return asyncio.run(main())
+
+
+def aggregate(summaries, elapsed):
+    result = {"devices": len(summaries), "turns": 0, "errors": {}, "metrics": {}}
+    samples = {name: [] for name in METRICS}
+    bytes_up = bytes_down = 0
+    for s in summaries:
+        result["turns"] += s["turns"]
+        bytes_up += s["bytes_up"]
+        bytes_down += s["bytes_down"]
+        for kind, count in s["errors"].items():
+            result["errors"][kind] = result["errors"].get(kind, 0) + count
+        for name in METRICS:
+            samples[name].extend(s["samples"][name])
+
+    attempts = result["turns"] + sum(result["errors"].values())
+    result["error_rate"] = round(sum(result["errors"].values()) / attempts, 4) if attempts else 0
+    result["throughput_kbps"] = {
+        "up": round(bytes_up * 8 / 1000 / elapsed, 1),
+        "down": round(bytes_down * 8 / 1000 / elapsed, 1),
+    }
+    for name, values in samples.items():
+        if not values:
+            result["metrics"][name] = {"count": 0}
+            continue
+        result["metrics"][name] = {
+            "count": len(values),
+            "p50": round(percentile(values, 50), 1),
+            "p90": round(percentile(values, 90), 1),
+            "p99": round(percentile(values, 99), 1),
+            "max": round(max(values), 1),
+        }
+    return result
+
+
+def main():
+    default_utterance = os.path.join(os.path.dirname(__file__), "..", "..", "main", "assets", "zh-CN", "welcome.p3")
+    parser = argparse.ArgumentParser(description="模拟大量设备对服务器施加负载")
+    parser.add_argument("--url", default="ws://127.0.0.1:8000/xiaozhi/v1/", help="WebSocket 服务器地址")
+    parser.add_argument("--token", default="", help="访问令牌")
+    parser.add_argument("--version", type=int, default=3, help="协议版本 (1/2/3/4)")
+    parser.add_argument("-n", "--devices", type=int, default=100, help="模拟的设备数量")
+    parser.add_argument("-j", "--processes", type=int, default=os.cpu_count(), help="进程数，每个进程一个事件循环")
+    parser.add_argument("--duration", type=float, default=60, help="全部设备启动后的持续时间 (秒)")
+    parser.add_argument("--ramp", type=float, default=10, help="逐步启动全部设备所用的时间 (秒)")
+    parser.add_argument("--utterance", default=default_utterance, help="作为用户语音上传的 p3 文件")
+    parser.add_argument("--turn-gap", type=float, default=2, help="两轮对话之间的平均间隔 (秒)")
+    parser.add_argument("--abort-ratio", type=float, default=0.1, help="打断 TTS 的对话比例")
+    parser.add_argument("--response-timeout", type=float, default=15, help="等待服务器响应的超时 (秒)")
+    parser.add_argument("--seed", type=int, default=0, help="随机种子")
+    parser.add_argument("--report", default=None, help="将统计结果写入 JSON 文件")
+    parser.add_argument("--per-session", action="store_true", help="报告中包含每个会话的统计")
+    args = parser.parse_args()
+
+    processes = max(1, min(args.processes, args.devices))
+    groups = [list(range(i, args.devices, processes)) for i in range(processes)]
+    print(f"{args.devices} 台设备，{processes} 个进程，目标 {args.url}")
+
+    start = time.monotonic()
+    with multiprocessing.Pool(processes) as pool:
+        results = pool.starmap(run_worker, [(args, group) for group in groups])
+    elapsed = time.monotonic() - start
+
+    summaries = [s for group in results for s in group]
+    report = aggregate(summaries, elapsed)
+    if args.per_session:
+        report["sessions"] = [{k: v for k, v in s.items() if k != "samples"} for s in summaries]
+    print(json.dumps(report, indent=2, ensure_ascii=False))
+    if args.report:
+        with open(args.report, "w", encoding="utf-8") as f:
+            json.dump(report, f, indent=2, ensure_ascii=False)
+
+
+if __name__ == "__main__":
+    main()
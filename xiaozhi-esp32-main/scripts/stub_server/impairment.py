@@ -0,0 +1,227 @@
+# 网络损伤模拟层，作用于替身服务器与设备之间的每一条链路
+# 支持延迟、抖动、带宽限制、突发丢包 (Gilbert-Elliott 模型)、乱序和断线，参数来自场景文件
+import asyncio
+import csv
+import json
+import os
+import random
+import time
+
+DEFAULT_PARAMS = {
+    "latency_ms": 0,        # 单向固定延迟
+    "jitter_ms": 0,         # 额外延迟的均匀分布上限
+    "bandwidth_kbps": 0,    # 带宽上限，0 表示不限制
+    "loss": 0.0,            # 良好状态下的丢包率
+    "burst_enter": 0.0,     # 每个包从良好状态进入突发丢包状态的概率
+    "burst_exit": 1.0,      # 每个包离开突发丢包状态的概率
+    "burst_loss": 1.0,      # 突发丢包状态下的丢包率
+    "reorder": 0.0,         # 额外延迟一个包使其乱序的概率 (仅 UDP)
+    "rto_ms": 200,          # 可靠链路 (TCP) 上丢包表现为重传延迟
+}
+
+
+def load_trace(path):
+    """读取 CSV 轨迹，列: time_s,latency_ms,jitter_ms,loss,bandwidth_kbps，缺失的列沿用场景参数"""
+    rows = []
+    with open(path, newline="", encoding="utf-8") as f:
+        for row in csv.DictReader(f):
+            entry = {k: float(v) for k, v in row.items() if v not in (None, "")}
+            rows.append(entry)
+    rows.sort(key=lambda r: r["time_s"])
+    return rows
+
+
+class Link:
+    """
+    单方向的一条链路。可靠链路 (WebSocket/TCP) 按顺序投递，丢包转化为重传延迟；
+    不可靠链路 (UDP) 会真正丢包，抖动和 reorder 会导致乱序
+    """
+
+    def __init__(self, impairment, name, params, reliable):
+        self.impairment = impairment
+        self.name = name
+        self.params = params
+        self.reliable = reliable
+        self.rng = random.Random(f"{impairment.seed}:{name}")
+        self.start_time = time.monotonic()
+        self.in_burst = False
+        self.link_free_time = 0.0
+        self.last_due = 0.0
+        self.blackout_until = 0.0
+        self.queue = asyncio.Queue() if reliable else None
+        self.worker = None
+        self.stats = {"packets": 0, "bytes": 0, "dropped": 0, "retransmitted": 0,
+                      "reordered": 0, "max_delay_ms": 0.0, "total_delay_ms": 0.0}
+
+    def current_params(self, now):
+        trace = self.impairment.trace
+        if not trace:
+            return self.params
+        # 轨迹循环播放，取不晚于当前时刻的最后一行
+        offset = (now - self.start_time) % (trace[-1]["time_s"] + 1)
+        row = trace[0]
+        for entry in trace:
+            if entry["time_s"] > offset:
+                break
+            row = entry
+        params = dict(self.params)
+        params.update({k: v for k, v in row.items() if k != "time_s"})
+        return params
+
+    def lost(self, p):
+        if self.in_burst:
+            if self.rng.random() < p["burst_exit"]:
+                self.in_burst = False
+        elif self.rng.random() < p["burst_enter"]:
+            self.in_burst = True
+        loss = p["burst_loss"] if self.in_burst else p["loss"]
+        return self.rng.random() < loss
+
+    def schedule(self, size):
+        """计算一个包的投递时间，返回 None 表示丢弃"""
+        now = time.monotonic()
+        p = self.current_params(now)
+        self.stats["packets"] += 1
+        self.stats["bytes"] += size
+
+        if now < self.blackout_until:
+            self.stats["dropped"] += 1
+            return None
+
+        delay = p["latency_ms"] / 1000
+        if p["jitter_ms"] > 0:
+            delay += self.rng.uniform(0, p["jitter_ms"] / 1000)
+        if self.lost(p):
+            if not self.reliable:
+                self.stats["dropped"] += 1
+                return None
+            self.stats["retransmitted"] += 1
+            delay += p["rto_ms"] / 1000
+        if not self.reliable and p["reorder"] > 0 and self.rng.random() < p["reorder"]:
+            self.stats["reordered"] += 1
+            delay += max(p["jitter_ms"], 20) / 1000
+
+        # 带宽限制：包在链路空闲后才能开始发送
+        depart = now
+        if p["bandwidth_kbps"] > 0:
+            depart = max(now, self.link_free_time)
+            self.link_free_time = depart + size * 8 / (p["bandwidth_kbps"] * 1000)
+            depart = self.link_free_time
+        due = depart + delay
+        if self.reliable:
+            due = max(due, self.last_due)
+            self.last_due = due
+
+        delay_ms = (due - now) * 1000
+        self.stats["max_delay_ms"] = max(self.stats["max_delay_ms"], delay_ms)
+        self.stats["total_delay_ms"] += delay_ms
+        return due
+
+    async def send(self, deliver, data):
+        """
+        经过链路投递 data，deliver 为实际发送或处理函数 (可以是协程函数)
+        调用方不会被阻塞，相当于数据已写入发送缓冲区
+        """
+        if not self.impairment.enabled:
+            await _call(deliver, data)
+            return
+        due = self.schedule(len(data))
+        if due is None:
+            return
+        if self.reliable:
+            self.queue.put_nowait((due, deliver, data))
+            if self.worker is None:
+                self.worker = asyncio.ensure_future(self.drain())
+        else:
+            loop = asyncio.get_running_loop()
+            loop.call_at(loop.time() + max(0, due - time.monotonic()),
+                         lambda: asyncio.ensure_future(_call(deliver, data)))
+
+    async def drain(self):
+        while True:
+            due, deliver, data = await self.queue.get()
+            delay = due - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+            try:
+                await _call(deliver, data)
+            except Exception as e:
+                self.impairment.log.record(self.name, "error", error=str(e))
+
+    def blackout(self, seconds):
+        self.blackout_until = time.monotonic() + seconds
+
+    def close(self):
+        if self.worker:
+            self.worker.cancel()
+            self.worker = None
+
+
+async def _call(deliver, data):
+    result = deliver(data)
+    if asyncio.iscoroutine(result):
+        await result
+
+
+class Impairment:
+    """
+    场景文件 (JSON) 示例:
+    {
+        "name": "ml307_cellular",
+        "seed": 1,
+        "uplink": {"latency_ms": 60, "jitter_ms": 40, "loss": 0.01},
+        "downlink": {"latency_ms": 50, "jitter_ms": 30, "bandwidth_kbps": 256},
+        "trace": "traces/ml307.csv",
+        "disconnect": {"every_s": 120, "down_s": 5}
+    }
+    trace 为相对于场景文件的 CSV 轨迹路径，按时间覆盖两个方向的参数
+    """
+
+    def __init__(self, log, scenario_path=None, seed=None):
+        self.log = log
+        self.links = []
+        self.scenario = {}
+        self.trace = None
+        if scenario_path:
+            with open(scenario_path, encoding="utf-8") as f:
+                self.scenario = json.load(f)
+            trace = self.scenario.get("trace")
+            if trace:
+                self.trace = load_trace(os.path.join(os.path.dirname(scenario_path), trace))
+        self.enabled = bool(scenario_path)
+        self.name = self.scenario.get("name", "none")
+        self.seed = seed if seed is not None else self.scenario.get("seed", 0)
+
+    def params(self, direction):
+        params = dict(DEFAULT_PARAMS)
+        params.update(self.scenario.get(direction, {}))
+        return params
+
+    def link(self, session, direction, reliable):
+        link = Link(self, f"{session}/{direction}", self.params(direction), reliable)
+        self.links.append(link)
+        return link
+
+    def start_disconnects(self, disconnect):
+        """按场景周期性地调用 disconnect(down_s)，返回任务以便会话结束时取消"""
+        config = self.scenario.get("disconnect")
+        if not self.enabled or not config:
+            return None
+
+        async def run():
+            while True:
+                await asyncio.sleep(config["every_s"])
+                await _call(disconnect, config.get("down_s", 0))
+
+        return asyncio.ensure_future(run())
+
+    def report(self):
+        totals = {"packets": 0, "bytes": 0, "dropped": 0, "retransmitted": 0, "reordered": 0, "max_delay_ms": 0.0}
+        for link in self.links:
+            for key in totals:
+                if key == "max_delay_ms":
+                    totals[key] = max(totals[key], link.stats[key])
+                else:
+                    totals[key] += link.stats[key]
+        totals["max_delay_ms"] = round(totals["max_delay_ms"], 1)
+        return {"scenario": self.name, "seed": self.seed, "links": totals}
@@ -0,0 +1,544 @@
+# 本地替身服务器，用于在没有真实后端的情况下测量设备端性能
+# 支持 WebSocket (协议版本 1/2/3/4) 和 MQTT + UDP (AES-CTR) 两种传输方式
+import argparse
+import asyncio
+import json
+import os
+import secrets
+import socket
+import struct
+import time
+import uuid
+
+import control_codec
+from impairment import Impairment
+
+SAMPLE_RATE = 16000
+FRAME_DURATION_MS = 60
+
+
+def load_p3(path):
+    """读取 p3 文件，返回 Opus 数据包列表。p3 格式: [1字节类型, 1字节保留, 2字节长度, Opus数据]"""
+    packets = []
+    with open(path, "rb") as f:
+        while True:
+            header = f.read(4)
+            if len(header) < 4:
+                break
+            _, _, data_len = struct.unpack(">BBH", header)
+            data = f.read(data_len)
+            if len(data) < data_len:
+                break
+            packets.append(data)
+    return packets
+
+
+class EventLog:
+    """记录每个事件到达服务器的时间 (time.monotonic)，可写入 JSONL 文件并通知监听者"""
+
+    def __init__(self, path=None):
+        self.file = open(path, "w", encoding="utf-8") if path else None
+        self.listeners = []
+
+    def record(self, session, event, **fields):
+        entry = {"t": time.monotonic(), "session": session, "event": event}
+        entry.update(fields)
+        if self.file:
+            self.file.write(json.dumps(entry, ensure_ascii=False) + "\n")
+        for listener in self.listeners:
+            listener(entry)
+        return entry
+
+    def close(self):
+        if self.file:
+            self.file.close()
+            self.file = None
+
+
+class Session:
+    """
+    一个设备会话的对话状态机，与传输方式无关
+    listen start 后收到 utterance_ms 的上行音频即认为用户说完 (manual 模式则等待 listen stop)，
+    随后回复 stt / llm / tts，并按帧时长节奏下发 TTS 音频
+    """
+    # 承载音频的链路是否可靠 (TCP)，决定网络损伤时是丢包还是重传延迟
+    reliable = True
+
+    def __init__(self, server, name):
+        self.server = server
+        self.args = server.args
+        self.log = server.log
+        self.name = name
+        self.session_id = str(uuid.uuid4())
+        self.listening = False
+        self.listen_mode = "auto"
+        self.speech_start = None
+        self.audio_frames = 0
+        self.tts_task = None
+        self.iot_digest = None
+        self.uplink = server.impairment.link(name, "uplink", self.reliable)
+        self.downlink = server.impairment.link(name, "downlink", self.reliable)
+        self.disconnect_task = server.impairment.start_disconnects(self.disconnect)
+
+    # 由具体传输实现
+    async def send_json(self, message):
+        raise NotImplementedError
+
+    async def send_audio(self, payload, timestamp=0):
+        raise NotImplementedError
+
+    async def disconnect(self, down_s):
+        self.log.record(self.name, "impair_disconnect", down_s=down_s)
+
+    def on_audio(self, payload, **fields):
+        self.audio_frames += 1
+        self.log.record(self.name, "audio_in", size=len(payload), seq=self.audio_frames, **fields)
+        if not self.listening:
+            return
+        now = time.monotonic()
+        if self.speech_start is None:
+            self.speech_start = now
+        elif self.listen_mode != "manual" and (now - self.speech_start) * 1000 >= self.args.utterance_ms:
+            self.end_of_speech("utterance")
+
+    async def on_json(self, message):
+        msg_type = message.get("type")
+        self.log.record(self.name, "control_in", message=message)
+        if msg_type == "listen":
+            state = message.get("state")
+            if state == "start":
+                self.listening = True
+                self.listen_mode = message.get("mode", "auto")
+                self.speech_start = None
+            elif state == "stop":
+                if self.listening:
+                    self.end_of_speech("listen_stop")
+            elif state == "detect":
+                self.log.record(self.name, "wake_word", text=message.get("text"))
+                if self.args.reply_on_detect:
+                    self.start_reply("你好，我在呢")
+        elif msg_type == "abort":
+            self.log.record(self.name, "abort_in", reason=message.get("reason"))
+            await self.stop_tts(aborted=True)
+        elif msg_type == "iot":
+            kind = "descriptors" if "descriptors" in message else "states"
+            self.log.record(self.name, "iot_in", kind=kind)
+            if kind == "descriptors" and self.iot_digest:
+                self.server.iot_digests.add(self.iot_digest)
+
+    def iot_digest_fields(self, message):
+        """记录设备 hello 中的描述符摘要，已收到过相同描述符时在回复中确认"""
+        self.iot_digest = message.get("iot_digest")
+        if self.iot_digest and self.iot_digest in self.server.iot_digests:
+            self.log.record(self.name, "iot_digest_known", digest=self.iot_digest)
+            return {"iot_digest": self.iot_digest}
+        return {}
+
+    def end_of_speech(self, cause):
+        self.listening = False
+        self.speech_start = None
+        self.log.record(self.name, "speech_end", cause=cause)
+        self.start_reply(self.args.stt_text)
+
+    def start_reply(self, stt_text):
+        if not self.server.auto_reply or (self.tts_task and not self.tts_task.done()):
+            return
+        self.tts_task = asyncio.ensure_future(self.reply(stt_text))
+
+    async def reply(self, stt_text):
+        try:
+            if self.args.think_ms > 0:
+                await asyncio.sleep(self.args.think_ms / 1000)
+            await self.send_json({"type": "stt", "text": stt_text})
+            await self.send_json({"type": "llm", "emotion": "happy", "text": "😀"})
+            await self.send_json({"type": "tts", "state": "start"})
+            self.log.record(self.name, "tts_start")
+            await self.send_json({"type": "tts", "state": "sentence_start", "text": self.args.tts_text})
+
+            # 与真实服务器一样，先突发若干帧作为预缓冲，之后按帧时长匀速发送
+            frame_interval = FRAME_DURATION_MS / 1000 / self.args.speed
+            packets = self.server.tts_packets * self.args.tts_repeat
+            start = time.monotonic()
+            for i, packet in enumerate(packets):
+                due = start + max(0, i - self.args.burst_frames) * frame_interval
+                delay = due - time.monotonic()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+                await self.send_audio(packet, timestamp=i * FRAME_DURATION_MS)
+                self.log.record(self.name, "tts_audio_out", seq=i + 1, size=len(packet))
+
+            await self.send_json({"type": "tts", "state": "sentence_end", "text": self.args.tts_text})
+            await self.stop_tts(aborted=False)
+        except asyncio.CancelledError:
+            pass
+        except Exception as e:
+            self.log.record(self.name, "error", error=str(e))
+
+    async def stop_tts(self, aborted):
+        if aborted and self.tts_task and not self.tts_task.done():
+            self.tts_task.cancel()
+        await self.send_json({"type": "tts", "state": "stop"})
+        self.log.record(self.name, "tts_stop", aborted=aborted)
+
+    async def inject(self, message):
+        self.log.record(self.name, "inject", message=message)
+        await self.send_json(message)
+
+    def close(self):
+        if self.tts_task and not self.tts_task.done():
+            self.tts_task.cancel()
+        if self.disconnect_task:
+            self.disconnect_task.cancel()
+        self.uplink.close()
+        self.downlink.close()
+        self.server.sessions.discard(self)
+        self.log.record(self.name, "close")
+
+
+class WebsocketSession(Session):
+    def __init__(self, server, websocket, name, version):
+        super().__init__(server, name)
+        self.websocket = websocket
+        self.version = version
+        self.binary_control = False
+
+    async def send_json(self, message):
+        if self.binary_control:
+            record = control_codec.encode(message)
+            if record is not None:
+                header = struct.pack(">BBH", control_codec.BINARY_PROTOCOL_TYPE_CONTROL, 0, len(record))
+                await self.downlink.send(self.websocket.send, header + record)
+                return
+        message = dict(message, session_id=self.session_id)
+        await self.downlink.send(self.websocket.send, json.dumps(message, ensure_ascii=False))
+
+    async def send_audio(self, payload, timestamp=0):
+        if self.version == 2:
+            header = struct.pack(">HHIII", 2, 0, 0, timestamp, len(payload))
+        elif self.version >= 3:
+            header = struct.pack(">BBH", control_codec.BINARY_PROTOCOL_TYPE_AUDIO, 0, len(payload))
+        else:
+            header = b""
+        await self.downlink.send(self.websocket.send, header + payload)
+
+    async def disconnect(self, down_s):
+        # 服务器主动断开，设备需要重新握手；down_s 对 WebSocket 没有意义
+        await super().disconnect(down_s)
+        await self.websocket.close()
+
+    async def on_message(self, data):
+        if isinstance(data, bytes):
+            await self.on_binary(data)
+            return
+        message = json.loads(data)
+        if message.get("type") == "hello":
+            await self.on_hello(message)
+        else:
+            await self.on_json(message)
+
+    async def on_binary(self, data):
+        if self.version == 2:
+            _, _, _, timestamp, size = struct.unpack_from(">HHIII", data)
+            self.on_audio(data[16:16 + size], timestamp=timestamp)
+        elif self.version >= 3:
+            msg_type, _, size = struct.unpack_from(">BBH", data)
+            payload = data[4:4 + size]
+            if msg_type == control_codec.BINARY_PROTOCOL_TYPE_CONTROL:
+                try:
+                    message = control_codec.decode(payload)
+                except ValueError as e:
+                    self.log.record(self.name, "error", error=str(e))
+                    return
+                await self.on_json(message)
+            else:
+                self.on_audio(payload)
+        else:
+            self.on_audio(data)
+
+    async def on_hello(self, message):
+        version = min(int(message.get("version", self.version)), self.args.max_version)
+        self.version = version
+        self.binary_control = version >= 4
+        self.log.record(self.name, "hello", version=version, features=message.get("features"))
+        # hello 始终使用 JSON
+        await self.downlink.send(self.websocket.send, json.dumps({
+            "type": "hello",
+            "transport": "websocket",
+            "session_id": self.session_id,
+            "version": version,
+            **self.iot_digest_fields(message),
+            "audio_params": {
+                "format": "opus",
+                "sample_rate": SAMPLE_RATE,
+                "channels": 1,
+                "frame_duration": FRAME_DURATION_MS,
+            },
+        }))
+        self.server.session_ready(self)
+
+
+class MqttUdpSession(Session):
+    """
+    MQTT 传输下的会话，控制消息经 MQTT broker 转发，音频经 UDP 加密传输
+    UDP 数据包格式: |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|payload|
+    网络损伤只作用于 UDP 音频，经 broker 转发的控制消息不受影响
+    """
+    reliable = False
+
+    def __init__(self, server, name):
+        super().__init__(server, name)
+        from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+        self.Cipher, self.algorithms, self.modes = Cipher, algorithms, modes
+        self.key = secrets.token_bytes(16)
+        self.nonce = bytes([0x01, 0x00, 0x00, 0x00]) + secrets.token_bytes(4) + bytes(8)
+        self.remote_addr = None
+        self.local_sequence = 0
+
+    def crypt(self, nonce, data):
+        cipher = self.Cipher(self.algorithms.AES(self.key), self.modes.CTR(nonce))
+        encryptor = cipher.encryptor()
+        return encryptor.update(data) + encryptor.finalize()
+
+    async def send_json(self, message):
+        message = dict(message, session_id=self.session_id)
+        self.server.mqtt_publish(json.dumps(message, ensure_ascii=False))
+
+    async def send_audio(self, payload, timestamp=0):
+        if self.remote_addr is None:
+            # 设备还没有发送过 UDP 数据，无法得知其地址
+            return
+        self.local_sequence += 1
+        nonce = bytearray(self.nonce)
+        struct.pack_into(">H", nonce, 2, len(payload))
+        struct.pack_into(">II", nonce, 8, timestamp, self.local_sequence)
+        nonce = bytes(nonce)
+        addr = self.remote_addr
+        await self.downlink.send(lambda data: self.server.udp_transport.sendto(data, addr),
+                                 nonce + self.crypt(nonce, payload))
+
+    async def disconnect(self, down_s):
+        # UDP 没有连接，断线表现为一段时间内双向不通
+        await super().disconnect(down_s)
+        self.uplink.blackout(down_s)
+        self.downlink.blackout(down_s)
+
+    def on_datagram(self, data, addr):
+        if len(data) < 16 or data[0] != 0x01:
+            self.log.record(self.name, "error", error="invalid udp packet")
+            return
+        self.remote_addr = addr
+        timestamp, sequence = struct.unpack_from(">II", data, 8)
+        self.on_audio(self.crypt(data[:16], data[16:]), timestamp=timestamp, udp_seq=sequence)
+
+    async def on_hello(self, message):
+        self.log.record(self.name, "hello", version=message.get("version"), features=message.get("features"))
+        self.local_sequence = 0
+        self.server.mqtt_publish(json.dumps({
+            "type": "hello",
+            "transport": "udp",
+            "session_id": self.session_id,
+            **self.iot_digest_fields(message),
+            # 声明支持复用会话，设备才会在下一轮对话前发送只带 session_id 的 hello
+            **({} if self.args.no_resume else {"features": {"resume": True}}),
+            "audio_params": {
+                "format": "opus",
+                "sample_rate": SAMPLE_RATE,
+                "channels": 1,
+                "frame_duration": FRAME_DURATION_MS,
+            },
+            "udp": {
+                "server": self.args.udp_public_host,
+                "port": self.args.udp_port,
+                "key": self.key.hex(),
+                "nonce": self.nonce.hex(),
+            },
+        }))
+        self.server.session_ready(self)
+
+
+class StubServer:
+    def __init__(self, args, log):
+        self.args = args
+        self.log = log
+        self.sessions = set()
+        # 已收到过描述符的摘要，设备再次 hello 时可跳过描述符
+        self.iot_digests = set()
+        self.tts_packets = load_p3(args.tts)
+        self.impairment = Impairment(log, args.scenario, args.seed)
+        # 关闭后服务器不再自动回复，由 on_session_ready 接管会话 (用于回放录制的会话)
+        self.auto_reply = True
+        self.on_session_ready = None
+        self.mqtt_client = None
+        self.mqtt_session = None
+        self.udp_transport = None
+        self.loop = None
+        self.next_id = 0
+
+    def session_ready(self, session):
+        if self.on_session_ready:
+            self.on_session_ready(session)
+
+    def new_name(self, prefix):
+        self.next_id += 1
+        return f"{prefix}-{self.next_id}"
+
+    async def start(self):
+        self.loop = asyncio.get_running_loop()
+        import websockets
+        await websockets.serve(self.handle_websocket, self.args.host, self.args.ws_port, max_size=None)
+        print(f"WebSocket 监听: ws://{self.args.host}:{self.args.ws_port}/xiaozhi/v1/")
+
+        if self.args.mqtt_broker:
+            await self.start_mqtt()
+        if self.args.inject_port:
+            await asyncio.start_server(self.handle_inject, self.args.host, self.args.inject_port)
+            print(f"消息注入端口: {self.args.host}:{self.args.inject_port} (每行一个 JSON 消息)")
+
+    async def handle_websocket(self, websocket, path=None):
+        headers = getattr(websocket, "request_headers", None)
+        if headers is None:
+            headers = websocket.request.headers
+        version = int(headers.get("Protocol-Version", "1"))
+        session = WebsocketSession(self, websocket, self.new_name("ws"), version)
+        self.sessions.add(session)
+        self.log.record(session.name, "connect", device_id=headers.get("Device-Id"), version=version)
+        try:
+            async for data in websocket:
+                await session.uplink.send(session.on_message, data)
+        except Exception as e:
+            self.log.record(session.name, "disconnect", error=str(e))
+        finally:
+            session.close()
+
+    async def start_mqtt(self):
+        import paho.mqtt.client as mqtt
+
+        class UdpProtocol(asyncio.DatagramProtocol):
+            def datagram_received(protocol, data, addr):
+                session = self.mqtt_session
+                if session:
+                    asyncio.ensure_future(session.uplink.send(lambda d: session.on_datagram(d, addr), data))
+
+        self.udp_transport, _ = await self.loop.create_datagram_endpoint(
+            UdpProtocol, local_addr=(self.args.host, self.args.udp_port))
+
+        host, _, port = self.args.mqtt_broker.partition(":")
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2, client_id=f"stub-server-{os.getpid()}")
+        client.on_message = lambda c, u, msg: self.loop.call_soon_threadsafe(
+            asyncio.ensure_future, self.handle_mqtt(msg.payload))
+        client.connect(host, int(port or 1883))
+        client.subscribe(self.args.mqtt_topic)
+        client.loop_start()
+        self.mqtt_client = client
+        print(f"MQTT broker: {self.args.mqtt_broker}, 订阅 {self.args.mqtt_topic}, 回复到 {self.args.mqtt_reply_topic}")
+
+    def mqtt_publish(self, text):
+        self.mqtt_client.publish(self.args.mqtt_reply_topic, text)
+
+    async def handle_mqtt(self, payload):
+        message = json.loads(payload)
+        msg_type = message.get("type")
+        if msg_type == "hello" and "session_id" in message and "audio_params" not in message:
+            # 设备确认复用会话：会话仍有效时回复不含 UDP 参数的 hello，否则回复 goodbye 使设备重新握手
+            if self.mqtt_session and self.mqtt_session.session_id == message["session_id"]:
+                self.mqtt_publish(json.dumps({"type": "hello", "transport": "udp",
+                                              "session_id": self.mqtt_session.session_id}))
+            else:
+                self.mqtt_publish(json.dumps({"type": "goodbye", "session_id": message["session_id"]}))
+        elif msg_type == "hello":
+            # 同一时间只服务一台 MQTT 设备，新的 hello 替换旧会话
+            if self.mqtt_session:
+                self.mqtt_session.close()
+            self.mqtt_session = MqttUdpSession(self, self.new_name("mqtt"))
+            self.sessions.add(self.mqtt_session)
+            await self.mqtt_session.on_hello(message)
+        elif self.mqtt_session is None:
+            return
+        elif msg_type == "goodbye":
+            self.mqtt_session.close()
+            self.mqtt_session = None
+        else:
+            await self.mqtt_session.on_json(message)
+
+    async def handle_inject(self, reader, writer):
+        while True:
+            line = await reader.readline()
+            if not line:
+                break
+            try:
+                message = json.loads(line)
+            except ValueError:
+                writer.write(b"invalid json\n")
+                continue
+            for session in list(self.sessions):
+                await session.inject(message)
+            writer.write(f"sent to {len(self.sessions)} session(s)\n".encode())
+        writer.close()
+
+
+def add_arguments(parser):
+    default_tts = os.path.join(os.path.dirname(__file__), "..", "..", "main", "assets", "zh-CN", "welcome.p3")
+    parser.add_argument("--host", default="0.0.0.0", help="监听地址")
+    parser.add_argument("--ws-port", type=int, default=8000, help="WebSocket 端口")
+    parser.add_argument("--max-version", type=int, default=4, help="服务器支持的最高协议版本")
+    parser.add_argument("--tts", default=default_tts, help="作为 TTS 回放的 p3 文件")
+    parser.add_argument("--tts-repeat", type=int, default=1, help="TTS 重复次数，用于制造较长的播放以测试打断")
+    parser.add_argument("--tts-text", default="这是一段测试回复", help="sentence_start 中的文本")
+    parser.add_argument("--stt-text", default="这是一段测试语音", help="stt 消息中的文本")
+    parser.add_argument("--speed", type=float, default=1.0, help="TTS 发送速度倍率，1.0 为实时")
+    parser.add_argument("--burst-frames", type=int, default=5, help="TTS 开始时不限速发送的帧数")
+    parser.add_argument("--think-ms", type=int, default=0, help="用户说完到开始回复之间的模拟处理时间")
+    parser.add_argument("--utterance-ms", type=int, default=3000, help="自动模式下收到多长的上行音频后认为用户说完")
+    parser.add_argument("--reply-on-detect", action="store_true", help="收到唤醒词后立即回复一段 TTS")
+    parser.add_argument("--inject-port", type=int, default=0, help="消息注入 TCP 端口，0 表示禁用")
+    parser.add_argument("--mqtt-broker", default="", help="MQTT broker 地址 host[:port]，为空则不启用 MQTT")
+    parser.add_argument("--mqtt-topic", default="device-server", help="设备发布消息的 topic")
+    parser.add_argument("--mqtt-reply-topic", default="devices/p2p/stub", help="回复设备的 topic")
+    parser.add_argument("--udp-port", type=int, default=8884, help="UDP 音频端口")
+    parser.add_argument("--no-resume", action="store_true", help="MQTT hello 中不声明支持复用会话，设备每轮对话都完整握手")
+    parser.add_argument("--udp-public-host", default=None, help="告知设备的 UDP 地址，默认为本机地址")
+    parser.add_argument("--events", default=None, help="事件日志 JSONL 文件")
+    parser.add_argument("--scenario", default=None, help="网络损伤场景文件，见 scenarios 目录")
+    parser.add_argument("--seed", type=int, default=None, help="随机种子，覆盖场景文件中的 seed")
+
+
+def local_ip():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        try:
+            s.connect(("8.8.8.8", 80))
+            return s.getsockname()[0]
+        except OSError:
+            return "127.0.0.1"
+
+
+def make_server(args, log):
+    if args.udp_public_host is None:
+        args.udp_public_host = local_ip()
+    return StubServer(args, log)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="小智设备本地替身服务器")
+    add_arguments(parser)
+    parser.add_argument("-v", "--verbose", action="store_true", help="同时打印每一帧音频事件")
+    args = parser.parse_args()
+
+    log = EventLog(args.events)
+    log.listeners.append(lambda e: print(json.dumps(e, ensure_ascii=False))
+                         if args.verbose or e["event"] not in ("audio_in", "tts_audio_out") else None)
+    server = make_server(args, log)
+
+    async def run():
+        await server.start()
+        await asyncio.Future()
+
+    try:
+        asyncio.run(run())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        log.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+# 将设备端导出的时间线 (main/trace_recorder.h) 转为 Chrome trace JSON，可在 https://ui.perfetto.dev 或 chrome://tracing 中打开
+import argparse
+import base64
+import json
+import struct
+import sys
+
+MAGIC = b"XZTRC"
+BEGIN_MARKER = "-----BEGIN XIAOZHI TRACE-----"
+END_MARKER = "-----END XIAOZHI TRACE-----"
+HEADER = struct.Struct(">5sBBBHII")
+EVENT = struct.Struct(">QBBBHI")
+TASK_NAME_LENGTH = 16
+UNKNOWN_TASK = 0xFF
+
+TYPES = ["begin", "end", "instant", "complete"]
+
+
+def read_trace(path):
+    """读取时间线，可以是串口日志 (base64 文本) 或已解码的二进制文件"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data.startswith(MAGIC):
+        return data
+
+    text = data.decode("utf-8", errors="replace")
+    begin = text.rfind(BEGIN_MARKER)
+    end = text.find(END_MARKER, begin)
+    if begin < 0 or end < 0:
+        raise ValueError("trace markers not found")
+    # 每行单独编码，逐行解码
+    lines = text[begin + len(BEGIN_MARKER):end].split()
+    return b"".join(base64.b64decode(line) for line in lines)
+
+
+def parse_trace(data):
+    if not data.startswith(MAGIC):
+        raise ValueError("invalid trace magic")
+    _, version, core_count, task_count, name_count, event_count, dropped = HEADER.unpack_from(data, 0)
+    offset = HEADER.size
+
+    tasks = []
+    for _ in range(task_count):
+        name = data[offset:offset + TASK_NAME_LENGTH].split(b"\0", 1)[0]
+        tasks.append(name.decode("utf-8", errors="replace"))
+        offset += TASK_NAME_LENGTH
+
+    names = []
+    for _ in range(name_count):
+        length = data[offset]
+        names.append(data[offset + 1:offset + 1 + length].decode("utf-8", errors="replace"))
+        offset += 1 + length
+
+    events = []
+    while offset + EVENT.size <= len(data):
+        time_us, kind, core, task, name, arg = EVENT.unpack_from(data, offset)
+        offset += EVENT.size
+        events.append({
+            "time_us": time_us,
+            "type": TYPES[kind] if kind < len(TYPES) else str(kind),
+            "core": core,
+            "task": tasks[task] if task < len(tasks) else "unknown",
+            "tid": task,
+            "name": names[name] if name < len(names) else f"name#{name}",
+            "arg": arg,
+        })
+    if len(events) != event_count:
+        print(f"warning: header says {event_count} events, parsed {len(events)}", file=sys.stderr)
+    # 各核心的缓冲区分别导出，合并后按时间排序
+    events.sort(key=lambda e: e["time_us"])
+    return {"version": version, "cores": core_count, "dropped": dropped, "tasks": tasks, "events": events}
+
+
+def load(path):
+    return parse_trace(read_trace(path))
+
+
+def to_chrome(trace):
+    """转为 Chrome trace event format，每个 FreeRTOS 任务一条轨道"""
+    output = [{"ph": "M", "pid": 0, "name": "process_name", "args": {"name": "xiaozhi"}}]
+    for tid, name in enumerate(trace["tasks"]):
+        output.append({"ph": "M", "pid": 0, "tid": tid, "name": "thread_name", "args": {"name": name}})
+    output.append({"ph": "M", "pid": 0, "tid": UNKNOWN_TASK, "name": "thread_name", "args": {"name": "unknown"}})
+
+    # 缓冲区覆盖了开头的 begin 时，丢弃没有配对的 end
+    depth = {}
+    for event in trace["events"]:
+        base = {"pid": 0, "tid": event["tid"], "ts": event["time_us"], "name": event["name"],
+                "args": {"core": event["core"]}}
+        if event["type"] == "begin":
+            depth[event["tid"]] = depth.get(event["tid"], 0) + 1
+            output.append(dict(base, ph="B"))
+        elif event["type"] == "end":
+            if depth.get(event["tid"], 0) == 0:
+                continue
+            depth[event["tid"]] -= 1
+            output.append(dict(base, ph="E"))
+        elif event["type"] == "complete":
+            output.append(dict(base, ph="X", dur=event["arg"]))
+        elif event["type"] == "instant":
+            base["args"]["value"] = event["arg"]
+            output.append(dict(base, ph="i", s="p"))
+    return {"traceEvents": output, "displayTimeUnit": "ms"}
+
+
+def summarize(trace):
+    """按名称统计区间的次数、总耗时和最长耗时 (ms)"""
+    stats = {}
+    open_spans = {}
+    for event in trace["events"]:
+        duration = None
+        if event["type"] == "begin":
+            open_spans.setdefault((event["tid"], event["name"]), []).append(event["time_us"])
+        elif event["type"] == "end":
+            stack = open_spans.get((event["tid"], event["name"]))
+            if stack:
+                duration = event["time_us"] - stack.pop()
+        elif event["type"] == "complete":
+            duration = event["arg"]
+        if duration is not None:
+            count, total, longest = stats.get(event["name"], (0, 0, 0))
+            stats[event["name"]] = (count + 1, total + duration, max(longest, duration))
+    return stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a xiaozhi trace dump to Chrome trace JSON")
+    parser.add_argument("input", help="串口日志或二进制时间线文件")
+    parser.add_argument("-o", "--output", default="trace.json", help="输出的 Chrome trace JSON 文件")
+    parser.add_argument("--summary", action="store_true", help="打印各区间的耗时统计")
+    args = parser.parse_args()
+
+    trace = load(args.input)
+    with open(args.output, "w", encoding="utf-8") as f:
+        json.dump(to_chrome(trace), f, ensure_ascii=False)
+    print(f"{len(trace['events'])} events from {len(trace['tasks'])} tasks on {trace['cores']} cores, "
+          f"{trace['dropped']} overwritten, written to {args.output}")
+
+    if args.summary:
+        stats = summarize(trace)
+        print(f"{'name':<24} {'count':>6} {'total ms':>10} {'max ms':>10}")
+        for name, (count, total, longest) in sorted(stats.items(), key=lambda item: -item[1][1]):
+            print(f"{name:<24} {count:>6} {total / 1000:>10.1f} {longest / 1000:>10.1f}")
+
+
+if __name__ == "__main__":
+    main()
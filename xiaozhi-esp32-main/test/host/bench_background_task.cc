@@ -0,0 +1,101 @@
+#include "background_task.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// 后台任务的吞吐量和排队延迟，主机线程不代表 ESP32 的核心数和调度，只用于前后对比
+
+static int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void SpinFor(int us) {
+    int64_t end = NowUs() + us;
+    while (NowUs() < end) {
+    }
+}
+
+static void PrintLatency(const char* name, std::vector<int64_t>& samples, int64_t wall_us) {
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double p) { return samples[(size_t)((samples.size() - 1) * p)]; };
+    printf("%-28s jobs %6zu  wall %7.1f ms  %8.0f jobs/s  wait p50 %5lld us  p99 %6lld us  max %6lld us\n",
+        name, samples.size(), wall_us / 1000.0, samples.size() * 1e6 / wall_us,
+        (long long)at(0.5), (long long)at(0.99), (long long)samples.back());
+}
+
+// 两个 stream 交替提交固定耗时的任务，与在一个线程中串行执行的总耗时对比
+static void TwoStreams(BackgroundTask* task, int encode, int decode, int jobs, int work_us) {
+    std::vector<int64_t> waits(jobs * 2);
+    int64_t start = NowUs();
+    for (int i = 0; i < jobs; i++) {
+        int64_t submit = NowUs();
+        task->Schedule(encode, [&waits, i, submit, work_us]() {
+            waits[i * 2] = NowUs() - submit;
+            SpinFor(work_us);
+        });
+        submit = NowUs();
+        task->Schedule(decode, [&waits, i, submit, work_us]() {
+            waits[i * 2 + 1] = NowUs() - submit;
+            SpinFor(work_us);
+        });
+    }
+    task->WaitForCompletion();
+    int64_t wall = NowUs() - start;
+    char name[64];
+    snprintf(name, sizeof(name), "2 streams x %d us", work_us);
+    PrintLatency(name, waits, wall);
+    printf("%-28s serial sum %.1f ms\n", "", jobs * 2 * work_us / 1000.0);
+}
+
+// 提交方按固定间隔提交空任务，测量从提交到开始执行的延迟
+static void Paced(BackgroundTask* task, int stream, int jobs, int interval_us) {
+    std::vector<int64_t> waits(jobs);
+    int64_t start = NowUs();
+    for (int i = 0; i < jobs; i++) {
+        int64_t submit = NowUs();
+        if (stream >= 0) {
+            task->Schedule(stream, [&waits, i, submit]() { waits[i] = NowUs() - submit; });
+        } else {
+            task->Schedule([&waits, i, submit]() { waits[i] = NowUs() - submit; });
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(interval_us));
+    }
+    task->WaitForCompletion();
+    PrintLatency(stream >= 0 ? "stream, paced" : "plain, paced", waits, NowUs() - start);
+}
+
+// 一次提交大量空任务，测量调度本身的开销
+static void Burst(BackgroundTask* task, int stream, int jobs) {
+    std::vector<int64_t> waits(jobs);
+    int64_t start = NowUs();
+    for (int i = 0; i < jobs; i++) {
+        int64_t submit = NowUs();
+        if (stream >= 0) {
+            task->Schedule(stream, [&waits, i, submit]() { waits[i] = NowUs() - submit; });
+        } else {
+            task->Schedule([&waits, i, submit]() { waits[i] = NowUs() - submit; });
+        }
+    }
+    task->WaitForCompletion();
+    PrintLatency(stream >= 0 ? "stream, burst" : "plain, burst", waits, NowUs() - start);
+}
+
+int main() {
+    printf("host threads: %u\n", std::thread::hardware_concurrency());
+    // 工作任务在主机上无法停止，不释放
+    auto task = new BackgroundTask();
+    int encode = task->CreateStream("encode", 0, 8, kOverloadBlock);
+    int decode = task->CreateStream("decode", 1, 8, kOverloadBlock);
+    int burst = task->CreateStream("burst", 0, 1024, kOverloadBlock);
+
+    TwoStreams(task, encode, decode, 2000, 200);
+    Paced(task, decode, 2000, 500);
+    Paced(task, -1, 2000, 500);
+    Burst(task, burst, 100000);
+    Burst(task, -1, 100000);
+    return 0;
+}
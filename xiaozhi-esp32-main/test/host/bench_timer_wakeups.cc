@@ -0,0 +1,99 @@
+#include "host.h"
+#include "timer_service.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+// 空闲一小时内 CPU 因定时器被唤醒的次数：每个周期任务各用一个 esp_timer，与共用 TimerService 对比
+// 周期和 slack 取自 bread-compact-wifi 空闲时运行的定时器，启动时刻在开机后 10 秒内随机
+
+struct PeriodicTask {
+    const char* name;
+    uint32_t period_ms;
+    uint32_t slack_ms;
+};
+
+static const PeriodicTask kIdleTasks[] = {
+    {"clock_timer", 1000, 200},
+    {"display_update_timer", 1000, 1000},
+    {"power_save_timer", 1000, 1000},
+    {"dht11_timer", 1000, 1000},
+    {"connection_check_timer", 5000, 1000},
+    {"heartbeat_timer", 30000, 5000},
+};
+
+#define BOOTS 20
+#define IDLE_SECONDS 3600
+
+static void NoOp(void*) {}
+
+int main() {
+    host::UseVirtualClock(1000000);
+    auto& service = TimerService::GetInstance();
+    std::mt19937 random(2024);
+    uint64_t separate_wakeups = 0;
+    uint64_t service_wakeups = 0;
+
+    for (int boot = 0; boot < BOOTS; boot++) {
+        // 时钟定时器在 Application 构造时最先启动，其余的在之后 10 秒内随机启动
+        std::vector<int64_t> offsets;
+        for (size_t i = 0; i < sizeof(kIdleTasks) / sizeof(kIdleTasks[0]); i++) {
+            offsets.push_back(i == 0 ? 0 : std::uniform_int_distribution<int64_t>(0, 10000000)(random));
+        }
+
+        std::vector<esp_timer_handle_t> handles;
+        for (size_t i = 0; i < offsets.size(); i++) {
+            esp_timer_create_args_t args = {};
+            args.callback = NoOp;
+            args.name = kIdleTasks[i].name;
+            esp_timer_handle_t handle;
+            esp_timer_create(&args, &handle);
+            handles.push_back(handle);
+        }
+        // 按启动时刻的先后依次启动
+        std::vector<size_t> order(offsets.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&offsets](size_t a, size_t b) { return offsets[a] < offsets[b]; });
+        int64_t base = esp_timer_get_time();
+        for (auto i : order) {
+            host::AdvanceClock(base + offsets[i] - esp_timer_get_time());
+            esp_timer_start_periodic(handles[i], kIdleTasks[i].period_ms * 1000ULL);
+        }
+        host::AdvanceClock(base + 10000000 - esp_timer_get_time());
+        host::ResetTimerWakeups();
+        host::AdvanceClock(IDLE_SECONDS * 1000000LL);
+        separate_wakeups += host::TimerWakeups();
+        for (auto handle : handles) {
+            esp_timer_stop(handle);
+            esp_timer_delete(handle);
+        }
+
+        // 同样的启动时刻，改用 TimerService
+        std::vector<int> ids;
+        for (size_t i = 0; i < offsets.size(); i++) {
+            ids.push_back(service.Create(kIdleTasks[i].name, kTimerDispatchTimerTask, []() {}));
+        }
+        base = esp_timer_get_time();
+        for (auto i : order) {
+            host::AdvanceClock(base + offsets[i] - esp_timer_get_time());
+            service.StartPeriodic(ids[i], kIdleTasks[i].period_ms, kIdleTasks[i].slack_ms);
+        }
+        host::AdvanceClock(base + 10000000 - esp_timer_get_time());
+        host::ResetTimerWakeups();
+        host::AdvanceClock(IDLE_SECONDS * 1000000LL);
+        service_wakeups += host::TimerWakeups();
+        for (auto id : ids) {
+            service.Delete(id);
+        }
+    }
+
+    // 每秒至少需要唤醒一次，1 秒周期的定时器不可能再合并
+    printf("%d boots x %d s idle, %zu periodic timers\n", BOOTS, IDLE_SECONDS, sizeof(kIdleTasks) / sizeof(kIdleTasks[0]));
+    printf("separate esp_timers: %.2f wakeups/s\n", (double)separate_wakeups / BOOTS / IDLE_SECONDS);
+    printf("TimerService:        %.2f wakeups/s\n", (double)service_wakeups / BOOTS / IDLE_SECONDS);
+    return 0;
+}
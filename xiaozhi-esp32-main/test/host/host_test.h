@@ -0,0 +1,57 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * 主机测试使用的最小测试框架，每个测试程序由 ctest 单独运行，有失败的检查时返回非零
+ */
+namespace host_test {
+
+struct TestCase {
+    const char* name;
+    std::function<void()> function;
+};
+
+inline std::vector<TestCase>& Registry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+inline int& Failures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct Registrar {
+    Registrar(const char* name, std::function<void()> function) { Registry().push_back({name, std::move(function)}); }
+};
+
+} // namespace host_test
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static host_test::Registrar name##_registrar(#name, name); \
+    static void name()
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            host_test::Failures()++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) do { \
+        auto check_a_ = (a); \
+        auto check_b_ = (b); \
+        if (!(check_a_ == check_b_)) { \
+            fprintf(stderr, "%s:%d: CHECK_EQ failed: %s (%lld) != %s (%lld)\n", __FILE__, __LINE__, \
+                #a, (long long)check_a_, #b, (long long)check_b_); \
+            host_test::Failures()++; \
+        } \
+    } while (0)
+
+#endif // HOST_TEST_H
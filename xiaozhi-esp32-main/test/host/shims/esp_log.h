@@ -0,0 +1,13 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+// 不做格式检查：固件中 uint32_t 按 %lu 输出，在主机上宽度不同，只影响日志内容
+void host_log(char level, const char* tag, const char* format, ...);
+
+#define ESP_LOGE(tag, format, ...) host_log('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) host_log('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) host_log('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+#define ESP_LOGV(tag, format, ...) do {} while (0)
+
+#endif // ESP_LOG_H
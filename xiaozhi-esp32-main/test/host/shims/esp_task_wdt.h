@@ -0,0 +1,12 @@
+#ifndef ESP_TASK_WDT_H
+#define ESP_TASK_WDT_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+inline esp_err_t esp_task_wdt_add(TaskHandle_t task) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_delete(TaskHandle_t task) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+
+#endif // ESP_TASK_WDT_H
@@ -0,0 +1,153 @@
+#include "esp_timer.h"
+#include "host.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    bool active = false;
+    int64_t expire_us = 0;
+    int64_t period_us = 0;  // 0 表示单次
+};
+
+static std::mutex timers_mutex;
+static std::vector<esp_timer*> timers;
+static std::atomic<bool> virtual_clock{false};
+static std::atomic<int64_t> virtual_now_us{0};
+static int64_t last_wakeup_us = -1;
+static uint32_t wakeups = 0;
+
+int64_t esp_timer_get_time() {
+    if (virtual_clock.load()) {
+        return virtual_now_us.load();
+    }
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    auto timer = new esp_timer{create_args->callback, create_args->arg, create_args->name};
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    timers.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->expire_us = esp_timer_get_time() + timeout_us;
+    timer->period_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->expire_us = esp_timer_get_time() + period;
+    timer->period_us = period;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timers.erase(std::remove(timers.begin(), timers.end(), timer), timers.end());
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    return timer->active;
+}
+
+namespace host {
+
+void UseVirtualClock(int64_t start_us) {
+    virtual_now_us.store(start_us);
+    virtual_clock.store(true);
+}
+
+// 调用方需持有 timers_mutex
+static esp_timer* FindEarliest(int64_t until_us) {
+    esp_timer* earliest = nullptr;
+    for (auto timer : timers) {
+        if (timer->active && timer->expire_us <= until_us && (earliest == nullptr || timer->expire_us < earliest->expire_us)) {
+            earliest = timer;
+        }
+    }
+    return earliest;
+}
+
+void AdvanceClock(int64_t duration_us) {
+    int64_t target_us = virtual_now_us.load() + duration_us;
+    while (true) {
+        esp_timer_cb_t callback;
+        void* arg;
+        {
+            std::lock_guard<std::mutex> lock(timers_mutex);
+            auto timer = FindEarliest(target_us);
+            if (timer == nullptr) {
+                break;
+            }
+            int64_t now_us = std::max(timer->expire_us, virtual_now_us.load());
+            virtual_now_us.store(now_us);
+            if (now_us != last_wakeup_us) {
+                last_wakeup_us = now_us;
+                wakeups++;
+            }
+            if (timer->period_us > 0) {
+                timer->expire_us += timer->period_us;
+            } else {
+                timer->active = false;
+            }
+            callback = timer->callback;
+            arg = timer->arg;
+        }
+        // 回调中可以重新启动或停止定时器
+        callback(arg);
+    }
+    virtual_now_us.store(target_us);
+}
+
+int64_t NextTimerExpiry() {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    auto timer = FindEarliest(INT64_MAX);
+    return timer != nullptr ? timer->expire_us : -1;
+}
+
+uint32_t TimerWakeups() {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    return wakeups;
+}
+
+void ResetTimerWakeups() {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    wakeups = 0;
+}
+
+} // namespace host
@@ -0,0 +1,111 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "host.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+#define TAG "HostTask"
+
+struct HostTask {
+    std::string name;
+    int core = 0;
+    bool running = true;
+    void* tls[configNUM_THREAD_LOCAL_STORAGE_POINTERS] = {};
+};
+
+// 分离的任务线程可能在进程退出、静态对象析构之后才结束，这些对象有意不释放
+static std::mutex& tasks_mutex = *new std::mutex;
+static std::condition_variable& tasks_cv = *new std::condition_variable;
+// 任务结束后不释放，与 FreeRTOS 不同，句柄不会被复用
+static std::vector<HostTask*>& tasks = *new std::vector<HostTask*>;
+static std::atomic<int> next_core{0};
+static thread_local HostTask* current_task = nullptr;
+
+static HostTask* CurrentTask() {
+    if (current_task == nullptr) {
+        // 未通过 xTaskCreate 创建的线程（测试的主线程），视为 main 任务
+        current_task = new HostTask{"main", 0};
+    }
+    return current_task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+    void* arg, UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id) {
+    auto task = new HostTask;
+    task->name = name;
+    task->core = core_id == tskNO_AFFINITY ? next_core++ % portNUM_PROCESSORS : core_id % portNUM_PROCESSORS;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        tasks.push_back(task);
+    }
+    if (created_task != nullptr) {
+        *created_task = task;
+    }
+    std::thread([task, function, arg]() {
+        current_task = task;
+        function(arg);
+        // 任务函数没有调用 vTaskDelete 就返回时同样视为结束
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        task->running = false;
+        tasks_cv.notify_all();
+    }).detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != nullptr && task != current_task) {
+        ESP_LOGE(TAG, "Deleting another task (%s) is not supported on host", task->name.c_str());
+        return;
+    }
+    auto self = CurrentTask();
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    self->running = false;
+    tasks_cv.notify_all();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return CurrentTask();
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    return (task != nullptr ? task : CurrentTask())->name.c_str();
+}
+
+void* pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index) {
+    return (task != nullptr ? task : CurrentTask())->tls[index];
+}
+
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index, void* value) {
+    (task != nullptr ? task : CurrentTask())->tls[index] = value;
+}
+
+BaseType_t xPortGetCoreID() {
+    return CurrentTask()->core;
+}
+
+namespace host {
+
+void WaitForTasks(const char* name) {
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    tasks_cv.wait(lock, [name]() {
+        for (auto task : tasks) {
+            if (task->running && task->name == name) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+} // namespace host
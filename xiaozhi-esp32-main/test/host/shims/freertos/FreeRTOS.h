@@ -0,0 +1,23 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <cstdint>
+
+// 与 ESP32-S3 一致：双核，1 ms 一个 tick
+#define portNUM_PROCESSORS 2
+#define configTICK_RATE_HZ 1000
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 2
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#endif // FREERTOS_H
@@ -0,0 +1,26 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstdint>
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+// 任务在独立线程中运行，未固定核心的任务轮流分配一个核心号，供 xPortGetCoreID 使用
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+    void* arg, UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id);
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth,
+    void* arg, UBaseType_t priority, TaskHandle_t* created_task) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, created_task, tskNO_AFFINITY);
+}
+// 只能删除自身 (NULL)，任务函数随后返回即结束线程
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+const char* pcTaskGetName(TaskHandle_t task);
+void* pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index);
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index, void* value);
+BaseType_t xPortGetCoreID();
+
+#endif // TASK_H
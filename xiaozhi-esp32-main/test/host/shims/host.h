@@ -0,0 +1,40 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <cstdint>
+#include <string>
+
+/*
+ * 主机测试用的 ESP-IDF 替身的控制接口
+ * - esp_timer 默认使用真实的单调时钟，其定时器不会触发；UseVirtualClock 后时间只由 AdvanceClock 推进，
+ *   到期的定时器在调用 AdvanceClock 的线程中依次执行，相当于 esp_timer 任务
+ * - FreeRTOS 任务用 std::thread 实现，vTaskDelete 只能删除自身
+ * - NVS 保存在内存中，进程退出后丢失
+ * - lwip 的 getaddrinfo 返回 SetDnsAnswer 设置的结果，不访问网络
+ */
+namespace host {
+
+void UseVirtualClock(int64_t start_us = 0);
+// 推进虚拟时钟，期间到期的 esp_timer 按到期时间顺序执行
+void AdvanceClock(int64_t duration_us);
+// 最早的 esp_timer 到期时间，没有运行中的定时器时返回 -1
+int64_t NextTimerExpiry();
+// 至少有一个 esp_timer 触发的不同时刻数，即 CPU 因定时器被唤醒的次数
+uint32_t TimerWakeups();
+void ResetTimerWakeups();
+
+// 等待指定名称的任务全部结束
+void WaitForTasks(const char* name);
+
+// address 为空表示解析失败
+void SetDnsAnswer(const std::string& host, const std::string& address);
+uint32_t DnsLookupCount(const std::string& host);
+
+// 直接读写内存中的 NVS，用于准备和检查测试数据
+void SetNvsString(const std::string& ns, const std::string& key, const std::string& value);
+std::string GetNvsString(const std::string& ns, const std::string& key);
+uint32_t NvsCommitCount(const std::string& ns);
+
+} // namespace host
+
+#endif // HOST_H
@@ -0,0 +1,14 @@
+#ifndef LWIP_NETDB_H
+#define LWIP_NETDB_H
+
+#include <netdb.h>
+#include <arpa/inet.h>
+
+// 解析结果由 host::SetDnsAnswer 提供
+int host_getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res);
+void host_freeaddrinfo(struct addrinfo* res);
+
+#define getaddrinfo host_getaddrinfo
+#define freeaddrinfo host_freeaddrinfo
+
+#endif // LWIP_NETDB_H
@@ -0,0 +1,94 @@
+#include "esp_log.h"
+#include "lwip/netdb.h"
+#include "mbedtls/base64.h"
+#include "host.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+void host_log(char level, const char* tag, const char* format, ...) {
+    // 设置 HOST_LOG=0 关闭日志，基准测试输出更清楚
+    static const bool enabled = getenv("HOST_LOG") == nullptr || strcmp(getenv("HOST_LOG"), "0") != 0;
+    if (!enabled) {
+        return;
+    }
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    fprintf(stderr, "%c (%s) %s\n", level, tag, message);
+}
+
+static std::mutex dns_mutex;
+static std::map<std::string, std::string> dns_answers;
+static std::map<std::string, uint32_t> dns_lookups;
+
+int host_getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res) {
+    std::string address;
+    {
+        std::lock_guard<std::mutex> lock(dns_mutex);
+        dns_lookups[node]++;
+        auto it = dns_answers.find(node);
+        if (it == dns_answers.end() || it->second.empty()) {
+            return EAI_NONAME;
+        }
+        address = it->second;
+    }
+    auto sin = (struct sockaddr_in*)calloc(1, sizeof(struct sockaddr_in));
+    sin->sin_family = AF_INET;
+    inet_pton(AF_INET, address.c_str(), &sin->sin_addr);
+    auto info = (struct addrinfo*)calloc(1, sizeof(struct addrinfo));
+    info->ai_family = AF_INET;
+    info->ai_socktype = SOCK_STREAM;
+    info->ai_addr = (struct sockaddr*)sin;
+    info->ai_addrlen = sizeof(struct sockaddr_in);
+    *res = info;
+    return 0;
+}
+
+void host_freeaddrinfo(struct addrinfo* res) {
+    free(res->ai_addr);
+    free(res);
+}
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t required = (slen + 2) / 3 * 4;
+    if (dlen < required + 1) {
+        *olen = required + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t v = src[i] << 16;
+        if (i + 1 < slen) v |= src[i + 1] << 8;
+        if (i + 2 < slen) v |= src[i + 2];
+        dst[n++] = table[(v >> 18) & 0x3F];
+        dst[n++] = table[(v >> 12) & 0x3F];
+        dst[n++] = i + 1 < slen ? table[(v >> 6) & 0x3F] : '=';
+        dst[n++] = i + 2 < slen ? table[v & 0x3F] : '=';
+    }
+    dst[n] = '\0';
+    *olen = n;
+    return 0;
+}
+
+namespace host {
+
+void SetDnsAnswer(const std::string& host, const std::string& address) {
+    std::lock_guard<std::mutex> lock(dns_mutex);
+    dns_answers[host] = address;
+}
+
+uint32_t DnsLookupCount(const std::string& host) {
+    std::lock_guard<std::mutex> lock(dns_mutex);
+    return dns_lookups[host];
+}
+
+} // namespace host
@@ -0,0 +1,122 @@
+#include "nvs.h"
+#include "host.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstring>
+
+struct Namespace {
+    std::map<std::string, std::string> strings;
+    std::map<std::string, int32_t> ints;
+    uint32_t commits = 0;
+};
+
+static std::mutex nvs_mutex;
+static std::map<std::string, Namespace> namespaces;
+// 句柄递增分配并记录对应的命名空间，只读打开不存在的命名空间时与 NVS 一样返回 NOT_FOUND
+static std::map<nvs_handle_t, std::string> handles;
+static nvs_handle_t next_handle = 1;
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    if (open_mode == NVS_READONLY && namespaces.find(name) == namespaces.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    namespaces[name];
+    *out_handle = next_handle++;
+    handles[*out_handle] = name;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces[handles[handle]].commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto& ns = namespaces[handles[handle]];
+    auto it = ns.strings.find(key);
+    if (it == ns.strings.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    size_t required = it->second.size() + 1;
+    if (out_value == nullptr) {
+        *length = required;
+        return ESP_OK;
+    }
+    if (*length < required) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(out_value, it->second.c_str(), required);
+    *length = required;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces[handles[handle]].strings[key] = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* out_value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto& ns = namespaces[handles[handle]];
+    auto it = ns.ints.find(key);
+    if (it == ns.ints.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = it->second;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces[handles[handle]].ints[key] = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto& ns = namespaces[handles[handle]];
+    if (ns.strings.erase(key) + ns.ints.erase(key) == 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto& ns = namespaces[handles[handle]];
+    ns.strings.clear();
+    ns.ints.clear();
+    return ESP_OK;
+}
+
+namespace host {
+
+void SetNvsString(const std::string& ns, const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces[ns].strings[key] = value;
+}
+
+std::string GetNvsString(const std::string& ns, const std::string& key) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto& strings = namespaces[ns].strings;
+    auto it = strings.find(key);
+    return it != strings.end() ? it->second : "";
+}
+
+uint32_t NvsCommitCount(const std::string& ns) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    return namespaces[ns].commits;
+}
+
+} // namespace host
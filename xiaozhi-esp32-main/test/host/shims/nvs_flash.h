@@ -0,0 +1,8 @@
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#include "nvs.h"
+
+inline esp_err_t nvs_flash_init() { return ESP_OK; }
+
+#endif // NVS_FLASH_H
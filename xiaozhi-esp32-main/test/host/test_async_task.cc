@@ -0,0 +1,195 @@
+#include "host_test.h"
+#include "host.h"
+#include "async_task.h"
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include <condition_variable>
+
+// 测试线程作为主循环，Delay 使用虚拟时钟，RunInTask 和 WaitCallback 使用真实线程
+
+static std::mutex loop_mutex;
+static std::condition_variable loop_cv;
+static std::deque<std::function<void()>> loop_queue;
+static TaskHandle_t main_task = nullptr;
+
+static void Post(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(loop_mutex);
+    loop_queue.push_back(std::move(callback));
+    loop_cv.notify_all();
+}
+
+static void Setup() {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+    host::UseVirtualClock(1000000);
+    main_task = xTaskGetCurrentTaskHandle();
+    AsyncRuntime::GetInstance().SetMainLoopDispatcher(Post);
+    TimerService::GetInstance().SetMainLoopDispatcher(Post);
+}
+
+// 执行主循环直到 done；队列为空时先等待其它任务投递，仍然没有时把虚拟时钟推进到下一个定时器
+static void RunUntil(const bool& done) {
+    while (!done) {
+        std::function<void()> callback;
+        {
+            std::unique_lock<std::mutex> lock(loop_mutex);
+            loop_cv.wait_for(lock, std::chrono::milliseconds(1), []() { return !loop_queue.empty(); });
+            if (!loop_queue.empty()) {
+                callback = std::move(loop_queue.front());
+                loop_queue.pop_front();
+            }
+        }
+        if (callback) {
+            callback();
+            continue;
+        }
+        int64_t next = host::NextTimerExpiry();
+        if (next >= 0) {
+            host::AdvanceClock(std::max<int64_t>(0, next - esp_timer_get_time()));
+        }
+    }
+}
+
+static Async<int> Add(int a, int b) {
+    co_return a + b;
+}
+
+static Async<int> Sum(int n, int& steps) {
+    int total = 0;
+    for (int i = 1; i <= n; i++) {
+        total = co_await Add(total, i);
+        steps++;
+    }
+    co_return total;
+}
+
+TEST_CASE(AsyncIsLazyAndReturnsValue) {
+    Setup();
+    bool done = false;
+    int steps = 0;
+    int result = 0;
+    auto body = [&]() -> Async<void> {
+        auto sum = Sum(10, steps);
+        // 创建时不执行
+        CHECK_EQ(steps, 0);
+        result = co_await std::move(sum);
+        done = true;
+    };
+    Spawn(body());
+    RunUntil(done);
+    CHECK_EQ(result, 55);
+    CHECK_EQ(steps, 10);
+}
+
+TEST_CASE(DelayResumesOnMainLoopAfterTimeout) {
+    Setup();
+    bool done = false;
+    int64_t elapsed = 0;
+    bool on_main_loop = false;
+    auto body = [&]() -> Async<void> {
+        int64_t start = esp_timer_get_time();
+        co_await Delay(1500);
+        elapsed = esp_timer_get_time() - start;
+        on_main_loop = xTaskGetCurrentTaskHandle() == main_task;
+        done = true;
+    };
+    Spawn(body());
+    RunUntil(done);
+    CHECK(elapsed >= 1500000);
+    CHECK(elapsed < 1500000 + TIMER_WHEEL_TICK_MS * 1000);
+    CHECK(on_main_loop);
+}
+
+TEST_CASE(RunInTaskRunsOffMainLoop) {
+    Setup();
+    bool done = false;
+    std::string worker_name;
+    std::string result;
+    bool resumed_on_main_loop = false;
+    auto body = [&]() -> Async<void> {
+        result = co_await RunInTask("blocking_call", [&worker_name]() {
+            worker_name = pcTaskGetName(nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            return std::string("ok");
+        });
+        resumed_on_main_loop = xTaskGetCurrentTaskHandle() == main_task;
+        done = true;
+    };
+    Spawn(body());
+    RunUntil(done);
+    CHECK(result == "ok");
+    CHECK(worker_name == "blocking_call");
+    CHECK(resumed_on_main_loop);
+}
+
+TEST_CASE(WaitCallbackResumesOnMainLoop) {
+    Setup();
+    bool done = false;
+    bool value = false;
+    bool resumed_on_main_loop = false;
+    auto body = [&]() -> Async<void> {
+        value = co_await WaitCallback<bool>([](std::function<void(bool)> callback) {
+            // 在其它线程中完成，协程不在该线程的栈上继续执行
+            std::thread([callback]() { callback(true); }).detach();
+        });
+        resumed_on_main_loop = xTaskGetCurrentTaskHandle() == main_task;
+        done = true;
+    };
+    Spawn(body());
+    RunUntil(done);
+    CHECK(value);
+    CHECK(resumed_on_main_loop);
+}
+
+static Async<int> Fail() {
+    co_await Delay(10);
+    throw std::runtime_error("inner");
+    co_return 0;
+}
+
+TEST_CASE(ExceptionsPropagateToAwaiter) {
+    Setup();
+    bool done = false;
+    std::string inner;
+    std::string from_task;
+    auto body = [&]() -> Async<void> {
+        try {
+            co_await Fail();
+        } catch (const std::runtime_error& e) {
+            inner = e.what();
+        }
+        try {
+            co_await RunInTask("throwing_call", []() -> int { throw std::runtime_error("task"); });
+        } catch (const std::runtime_error& e) {
+            from_task = e.what();
+        }
+        done = true;
+    };
+    Spawn(body());
+    RunUntil(done);
+    CHECK(inner == "inner");
+    CHECK(from_task == "task");
+}
+
+TEST_CASE(SpawnRunsUntilFirstSuspension) {
+    Setup();
+    bool done = false;
+    int stage = 0;
+    auto body = [&]() -> Async<void> {
+        stage = 1;
+        co_await Delay(100);
+        stage = 2;
+        done = true;
+    };
+    Spawn(body());
+    CHECK_EQ(stage, 1);
+    RunUntil(done);
+    CHECK_EQ(stage, 2);
+}
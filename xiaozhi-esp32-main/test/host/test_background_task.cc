@@ -0,0 +1,266 @@
+#include "host_test.h"
+#include "background_task.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <future>
+#include <memory>
+#include <vector>
+#include <cstdlib>
+#include <new>
+
+// 工作任务在主机上无法停止，BackgroundTask 对象不释放
+
+// 替换全局 operator new 统计分配次数，operator delete 与之配对使用 free
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static std::atomic<bool> count_allocations{false};
+static std::atomic<uint32_t> allocations{0};
+
+void* operator new(size_t size) {
+    if (count_allocations.load(std::memory_order_relaxed)) {
+        allocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static void SpinFor(int us) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// 记录 stream 内的执行顺序，并检查同一 stream 的任务没有并发执行
+struct StreamProbe {
+    std::atomic<int> running{0};
+    std::atomic<int> overlaps{0};
+    std::atomic<int> out_of_order{0};
+    std::atomic<int> last{-1};
+    std::atomic<int> count{0};
+
+    void Run(int seq, int work_us) {
+        if (running.fetch_add(1) != 0) {
+            overlaps++;
+        }
+        if (seq <= last.load()) {
+            out_of_order++;
+        }
+        last = seq;
+        SpinFor(work_us);
+        count++;
+        running--;
+    }
+};
+
+TEST_CASE(StreamsKeepOrderWithoutOverlap) {
+    auto task = new BackgroundTask();
+    int encode = task->CreateStream("encode", 0, 8, kOverloadBlock);
+    int decode = task->CreateStream("decode", 1, 8, kOverloadBlock);
+    StreamProbe encode_probe;
+    StreamProbe decode_probe;
+    std::atomic<int> plain_count{0};
+    for (int i = 0; i < 2000; i++) {
+        task->Schedule(encode, [&encode_probe, i]() { encode_probe.Run(i, 20); });
+        task->Schedule(decode, [&decode_probe, i]() { decode_probe.Run(i, 20); });
+        if (i % 100 == 0) {
+            task->Schedule([&plain_count]() { plain_count++; });
+        }
+    }
+    task->WaitForCompletion();
+    CHECK_EQ(encode_probe.count.load(), 2000);
+    CHECK_EQ(decode_probe.count.load(), 2000);
+    CHECK_EQ(plain_count.load(), 20);
+    CHECK_EQ(encode_probe.overlaps.load() + decode_probe.overlaps.load(), 0);
+    CHECK_EQ(encode_probe.out_of_order.load() + decode_probe.out_of_order.load(), 0);
+}
+
+// 另一个 stream 持续有新任务时，等待 decode stream 仍然能返回
+TEST_CASE(WaitForStreamIgnoresOtherStreams) {
+    auto task = new BackgroundTask();
+    int encode = task->CreateStream("encode", 0, 64, kOverloadBlock);
+    int decode = task->CreateStream("decode", 1, 8, kOverloadBlock);
+    std::atomic<bool> producing{true};
+    std::atomic<int> encode_done{0};
+    std::thread producer([&]() {
+        while (producing) {
+            task->Schedule(encode, [&encode_done]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                encode_done++;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(4));
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::atomic<int> decode_done{0};
+    for (int i = 0; i < 5; i++) {
+        task->Schedule(decode, [&decode_done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            decode_done++;
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    task->WaitForStream(decode);
+    auto decode_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    CHECK_EQ(decode_done.load(), 5);
+
+    // fence 只覆盖之前提交的任务，之后不断加入的任务不延长等待
+    start = std::chrono::steady_clock::now();
+    uint32_t fence = task->Fence(encode);
+    task->WaitForFence(encode, fence);
+    auto encode_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    int done_at_fence = encode_done.load();
+    CHECK(done_at_fence > 0);
+    printf("decode stream wait %lld ms, encode fence wait %lld ms\n", (long long)decode_ms, (long long)encode_ms);
+
+    producing = false;
+    producer.join();
+    task->WaitForCompletion();
+    CHECK(encode_done.load() >= done_at_fence);
+}
+
+// 堵住 stream 的工作任务，让队列填满
+struct Gate {
+    std::promise<void> promise;
+    std::shared_future<void> future = promise.get_future().share();
+    void Wait() { future.wait(); }
+    void Open() { promise.set_value(); }
+};
+
+TEST_CASE(DropOldestKeepsNewestInOrder) {
+    auto task = new BackgroundTask();
+    int stream = task->CreateStream("encode", 0, 4, kOverloadDropOldest);
+    Gate gate;
+    std::atomic<bool> started{false};
+    task->Schedule(stream, [&gate, &started]() {
+        started = true;
+        gate.Wait();
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+    std::vector<int> order;
+    std::mutex order_mutex;
+    for (int i = 0; i < 10; i++) {
+        CHECK(task->Schedule(stream, [&order, &order_mutex, i]() {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        }));
+    }
+    // 被丢弃的任务排在正在执行的任务之后，fence 不能越过正在执行的任务
+    uint32_t fence = task->Fence(stream);
+    auto waiter = std::async(std::launch::async, [&]() { task->WaitForFence(stream, fence); });
+    CHECK(waiter.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+    gate.Open();
+    waiter.wait();
+    std::vector<int> expected = {6, 7, 8, 9};
+    CHECK(order == expected);
+    auto stats = task->GetStreamStats(stream);
+    CHECK_EQ(stats.dropped, 6u);
+    CHECK_EQ(stats.completed, 5u);
+}
+
+TEST_CASE(RejectReturnsFalseWhenFull) {
+    auto task = new BackgroundTask();
+    int stream = task->CreateStream("reject", 0, 2, kOverloadReject);
+    Gate gate;
+    std::atomic<bool> started{false};
+    task->Schedule(stream, [&gate, &started]() {
+        started = true;
+        gate.Wait();
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+    std::atomic<int> ran{0};
+    int accepted = 0;
+    for (int i = 0; i < 5; i++) {
+        accepted += task->Schedule(stream, [&ran]() { ran++; });
+    }
+    CHECK_EQ(accepted, 2);
+    // 被拒绝的任务没有占用序号，fence 在已接受的任务完成后返回
+    uint32_t fence = task->Fence(stream);
+    gate.Open();
+    task->WaitForFence(stream, fence);
+    CHECK_EQ(ran.load(), 2);
+    CHECK_EQ(task->GetStreamStats(stream).rejected, 3u);
+    task->WaitForCompletion();
+}
+
+TEST_CASE(BlockWaitsForFreeSlot) {
+    auto task = new BackgroundTask();
+    int stream = task->CreateStream("decode", 1, 2, kOverloadBlock);
+    StreamProbe probe;
+    for (int i = 0; i < 200; i++) {
+        CHECK(task->Schedule(stream, [&probe, i]() { probe.Run(i, 100); }));
+    }
+    task->WaitForStream(stream);
+    CHECK_EQ(probe.count.load(), 200);
+    CHECK_EQ(probe.out_of_order.load(), 0);
+    CHECK_EQ(task->GetStreamStats(stream).dropped, 0u);
+}
+
+TEST_CASE(CapturesAreReleasedAfterRunOrDrop) {
+    auto task = new BackgroundTask();
+    int stream = task->CreateStream("encode", 0, 2, kOverloadDropOldest);
+    auto data = std::make_shared<int>(0);
+    Gate gate;
+    std::atomic<bool> started{false};
+    task->Schedule(stream, [&gate, &started]() {
+        started = true;
+        gate.Wait();
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+    for (int i = 0; i < 8; i++) {
+        task->Schedule(stream, [data]() { (*data)++; });
+    }
+    gate.Open();
+    task->WaitForStream(stream);
+    CHECK_EQ(*data, 2);
+    CHECK_EQ(data.use_count(), 1);
+}
+
+// stream 任务的回调直接放在槽位中，提交和执行都不分配内存
+TEST_CASE(StreamJobsDoNotAllocate) {
+    auto task = new BackgroundTask();
+    int stream = task->CreateStream("decode", 1, 16, kOverloadBlock);
+    std::vector<uint8_t> frame(240);
+    std::atomic<uint32_t> bytes{0};
+    // 预热，创建工作任务时的分配不计入
+    task->Schedule(stream, []() {});
+    task->WaitForCompletion();
+
+    allocations = 0;
+    count_allocations = true;
+    for (int i = 0; i < 20000; i++) {
+        auto p = frame.data();
+        size_t size = frame.size();
+        task->Schedule(stream, [p, size, &bytes]() { bytes += size + p[0]; });
+    }
+    task->WaitForStream(stream);
+    count_allocations = false;
+    CHECK_EQ(bytes.load(), 20000u * 240);
+    CHECK_EQ(allocations.load(), 0u);
+    printf("stream jobs: 20000, allocations: %u\n", allocations.load());
+
+    // 对照：不属于 stream 的任务仍然经过 std::function 和 std::deque
+    allocations = 0;
+    count_allocations = true;
+    for (int i = 0; i < 20000; i++) {
+        auto buffer = std::vector<uint8_t>(frame);
+        task->Schedule([buffer = std::move(buffer), &bytes]() { bytes += buffer.size(); });
+    }
+    task->WaitForCompletion();
+    count_allocations = false;
+    printf("plain jobs: 20000, allocations: %u\n", allocations.load());
+}
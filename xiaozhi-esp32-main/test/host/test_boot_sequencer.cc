@@ -0,0 +1,104 @@
+#include "host_test.h"
+#include "boot_sequencer.h"
+
+#include <esp_timer.h>
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+// 按发生顺序记录阶段的开始和结束，用序号而不是时间比较先后
+struct StageLog {
+    std::mutex mutex;
+    std::vector<std::string> events;
+
+    void Add(const std::string& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+    }
+    int IndexOf(const std::string& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(events.begin(), events.end(), event);
+        return it == events.end() ? -1 : it - events.begin();
+    }
+};
+
+static std::function<void()> Logged(StageLog& log, const char* name) {
+    return [&log, name]() {
+        log.Add(std::string(name) + ":start");
+        log.Add(std::string(name) + ":end");
+    };
+}
+
+// 与 Application::Start 相同的依赖图
+TEST_CASE(StagesStartAfterTheirDependencies) {
+    StageLog log;
+    BootSequencer sequencer;
+    sequencer.AddStage("codec", {}, Logged(log, "codec"));
+    sequencer.AddStage("network", {"codec"}, Logged(log, "network"));
+    sequencer.AddStage("afe", {"codec"}, Logged(log, "afe"));
+    sequencer.AddStage("wake_word", {"afe"}, Logged(log, "wake_word"));
+    sequencer.AddStage("protocol", {"network", "codec"}, Logged(log, "protocol"));
+    sequencer.Run();
+
+    CHECK_EQ(log.events.size(), 10u);
+    CHECK(log.IndexOf("codec:end") < log.IndexOf("network:start"));
+    CHECK(log.IndexOf("codec:end") < log.IndexOf("afe:start"));
+    CHECK(log.IndexOf("afe:end") < log.IndexOf("wake_word:start"));
+    CHECK(log.IndexOf("network:end") < log.IndexOf("protocol:start"));
+    CHECK(log.IndexOf("codec:end") < log.IndexOf("protocol:start"));
+    // 启动之后记录的事件和时间线输出
+    sequencer.Record("idle", esp_timer_get_time());
+    sequencer.PrintTimeline();
+}
+
+// 两个阶段都等待对方开始，只有并行执行时才能都等到
+TEST_CASE(IndependentStagesRunInParallel) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int started = 0;
+    std::atomic<int> met{0};
+    auto rendezvous = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        started++;
+        cv.notify_all();
+        if (cv.wait_for(lock, std::chrono::seconds(5), [&]() { return started == 2; })) {
+            met++;
+        }
+    };
+
+    BootSequencer sequencer;
+    sequencer.AddStage("codec", {}, []() {});
+    sequencer.AddStage("network", {"codec"}, rendezvous);
+    sequencer.AddStage("afe", {"codec"}, rendezvous);
+    sequencer.Run();
+    CHECK_EQ(met.load(), 2);
+}
+
+TEST_CASE(RunWaitsForTheWholeChain) {
+    std::atomic<int> depth{0};
+    BootSequencer sequencer;
+    sequencer.AddStage("a", {}, [&]() { depth = 1; });
+    sequencer.AddStage("b", {"a"}, [&]() {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        depth = 2;
+    });
+    sequencer.AddStage("c", {"b"}, [&]() {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        depth = 3;
+    });
+    sequencer.Run();
+    CHECK_EQ(depth.load(), 3);
+}
+
+TEST_CASE(UnknownDependencyIsIgnored) {
+    std::atomic<bool> ran{false};
+    BootSequencer sequencer;
+    sequencer.AddStage("orphan", {"missing"}, [&]() { ran = true; });
+    sequencer.Run();
+    CHECK(ran.load());
+}
@@ -0,0 +1,118 @@
+#include "host_test.h"
+#include "host.h"
+#include "dns_cache.h"
+
+#include <string>
+
+// 解析结果由替身 getaddrinfo 提供，时间使用虚拟时钟，TTL 和过期逻辑不需要真实等待
+
+static DnsCache& Cache() {
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+        host::UseVirtualClock(1000000);
+        // 上一次运行保存的结果，不知道已经过去多久
+        host::SetNvsString("dns", "hosts", "dead.example.com 10.0.0.3\nold.example.com 10.0.0.1\n");
+    }
+    return DnsCache::GetInstance();
+}
+
+static bool Persisted(const std::string& host, const std::string& address) {
+    return host::GetNvsString("dns", "hosts").find(host + " " + address + "\n") != std::string::npos;
+}
+
+TEST_CASE(IpLiteralIsReturnedAsIs) {
+    auto& cache = Cache();
+    CHECK(cache.Resolve("192.168.1.10") == "192.168.1.10");
+    CHECK_EQ(host::DnsLookupCount("192.168.1.10"), 0u);
+}
+
+TEST_CASE(PersistedAnswerIsUsedOnceThenRefreshed) {
+    auto& cache = Cache();
+    host::SetDnsAnswer("old.example.com", "10.0.0.2");
+    // 第一次不等待解析，直接使用保存的地址
+    CHECK(cache.Resolve("old.example.com") == "10.0.0.1");
+    host::WaitForTasks("dns_refresh");
+    CHECK_EQ(host::DnsLookupCount("old.example.com"), 1u);
+    CHECK(cache.Resolve("old.example.com") == "10.0.0.2");
+    CHECK(Persisted("old.example.com", "10.0.0.2"));
+}
+
+TEST_CASE(PersistedAnswerIsNotReusedWhenRefreshFails) {
+    auto& cache = Cache();
+    CHECK(cache.Resolve("dead.example.com") == "10.0.0.3");
+    host::WaitForTasks("dns_refresh");
+    // 不再返回年龄未知的地址，但保留在 NVS 中
+    CHECK(cache.Resolve("dead.example.com") == "");
+    CHECK(Persisted("dead.example.com", "10.0.0.3"));
+    CHECK_EQ(host::DnsLookupCount("dead.example.com"), 1u);
+
+    // 失败结果缓存 10 秒，之后同步重新解析
+    host::AdvanceClock(11 * 1000000LL);
+    host::SetDnsAnswer("dead.example.com", "10.0.0.4");
+    CHECK(cache.Resolve("dead.example.com") == "10.0.0.4");
+    CHECK(Persisted("dead.example.com", "10.0.0.4"));
+}
+
+TEST_CASE(FreshAnswerIsCachedForTtl) {
+    auto& cache = Cache();
+    host::SetDnsAnswer("api.example.com", "10.0.1.1");
+    CHECK(cache.Resolve("api.example.com") == "10.0.1.1");
+    CHECK(cache.Resolve("api.example.com") == "10.0.1.1");
+    CHECK_EQ(host::DnsLookupCount("api.example.com"), 1u);
+    CHECK(Persisted("api.example.com", "10.0.1.1"));
+
+    // 过期后先返回旧地址，同时在后台刷新
+    host::AdvanceClock(301 * 1000000LL);
+    host::SetDnsAnswer("api.example.com", "10.0.1.2");
+    CHECK(cache.Resolve("api.example.com") == "10.0.1.1");
+    host::WaitForTasks("dns_refresh");
+    CHECK_EQ(host::DnsLookupCount("api.example.com"), 2u);
+    CHECK(cache.Resolve("api.example.com") == "10.0.1.2");
+}
+
+TEST_CASE(InvalidateKeepsPersistedAddressUntilLookupSucceeds) {
+    auto& cache = Cache();
+    host::SetDnsAnswer("ws.example.com", "10.0.2.1");
+    CHECK(cache.Resolve("ws.example.com") == "10.0.2.1");
+    auto commits = host::NvsCommitCount("dns");
+
+    // 连接失败只标记，不写 NVS
+    cache.Invalidate("ws.example.com");
+    CHECK_EQ(host::NvsCommitCount("dns"), commits);
+    CHECK(Persisted("ws.example.com", "10.0.2.1"));
+
+    // 下次连接前同步重新解析，解析失败时不返回已失效的地址
+    host::SetDnsAnswer("ws.example.com", "");
+    CHECK(cache.Resolve("ws.example.com") == "");
+    CHECK_EQ(host::DnsLookupCount("ws.example.com"), 2u);
+    CHECK(Persisted("ws.example.com", "10.0.2.1"));
+    CHECK_EQ(host::NvsCommitCount("dns"), commits);
+
+    host::AdvanceClock(11 * 1000000LL);
+    host::SetDnsAnswer("ws.example.com", "10.0.2.2");
+    CHECK(cache.Resolve("ws.example.com") == "10.0.2.2");
+    CHECK(Persisted("ws.example.com", "10.0.2.2"));
+}
+
+TEST_CASE(InvalidatedAddressIsReusedWhenLookupReturnsIt) {
+    auto& cache = Cache();
+    host::SetDnsAnswer("same.example.com", "10.0.3.1");
+    CHECK(cache.Resolve("same.example.com") == "10.0.3.1");
+    auto commits = host::NvsCommitCount("dns");
+    cache.Invalidate("same.example.com");
+    CHECK(cache.Resolve("same.example.com") == "10.0.3.1");
+    CHECK_EQ(host::DnsLookupCount("same.example.com"), 2u);
+    // 地址没有变化，不需要重写 NVS
+    CHECK_EQ(host::NvsCommitCount("dns"), commits);
+}
+
+TEST_CASE(FailureIsCachedBriefly) {
+    auto& cache = Cache();
+    CHECK(cache.Resolve("missing.example.com") == "");
+    CHECK(cache.Resolve("missing.example.com") == "");
+    CHECK_EQ(host::DnsLookupCount("missing.example.com"), 1u);
+    host::AdvanceClock(11 * 1000000LL);
+    CHECK(cache.Resolve("missing.example.com") == "");
+    CHECK_EQ(host::DnsLookupCount("missing.example.com"), 2u);
+}
@@ -0,0 +1,137 @@
+#include "host_test.h"
+#include "link_quality.h"
+
+#include <cmath>
+
+// 用合成的 RTT、丢包和收发记录驱动估计器，检查平滑结果和等级划分
+
+static void FeedRtt(LinkQualityEstimator& estimator, int rtt_ms, int count) {
+    for (int i = 0; i < count; i++) {
+        estimator.OnRttSample(rtt_ms * 1000LL);
+    }
+}
+
+TEST_CASE(NoSamplesIsUnknown) {
+    LinkQualityEstimator estimator;
+    auto quality = estimator.GetSnapshot(1000000);
+    CHECK_EQ(quality.level, kLinkQualityUnknown);
+    CHECK_EQ(quality.rtt_ms, -1);
+}
+
+TEST_CASE(StableRttConverges) {
+    LinkQualityEstimator estimator;
+    FeedRtt(estimator, 50, 1);
+    CHECK_EQ(estimator.GetSnapshot(0).rtt_ms, 50);
+    FeedRtt(estimator, 50, 40);
+    auto quality = estimator.GetSnapshot(0);
+    CHECK_EQ(quality.rtt_ms, 50);
+    // 第一个样本的偏差取 RTT 的一半，之后以 1/4 的系数衰减
+    CHECK(quality.rtt_var_ms < 2);
+    CHECK_EQ(quality.level, kLinkQualityGood);
+}
+
+TEST_CASE(RttStepFollowsSrttGain) {
+    LinkQualityEstimator estimator;
+    FeedRtt(estimator, 100, 50);
+    // 单个样本只移动 1/8
+    FeedRtt(estimator, 900, 1);
+    CHECK_EQ(estimator.GetSnapshot(0).rtt_ms, 200);
+    // 持续的阶跃在约 30 个样本后接近新值
+    FeedRtt(estimator, 900, 30);
+    CHECK(std::abs(estimator.GetSnapshot(0).rtt_ms - 900) < 20);
+}
+
+TEST_CASE(LevelsFromRtt) {
+    LinkQualityEstimator estimator;
+    FeedRtt(estimator, 400, 60);
+    CHECK_EQ(estimator.GetSnapshot(0).level, kLinkQualityFair);
+    estimator.Reset();
+    FeedRtt(estimator, 1000, 60);
+    CHECK_EQ(estimator.GetSnapshot(0).level, kLinkQualityPoor);
+}
+
+TEST_CASE(JitterDegradesLevel) {
+    LinkQualityEstimator estimator;
+    // 平均 RTT 220 ms 本身属于 Good，但 ±200 ms 的抖动使其降为 Fair
+    for (int i = 0; i < 100; i++) {
+        estimator.OnRttSample((i % 2 ? 20 : 420) * 1000LL);
+    }
+    auto quality = estimator.GetSnapshot(0);
+    CHECK(quality.rtt_ms < 300);
+    CHECK(quality.rtt_var_ms > 150);
+    CHECK_EQ(quality.level, kLinkQualityFair);
+}
+
+TEST_CASE(LossRateTracksUdpGaps) {
+    LinkQualityEstimator estimator;
+    FeedRtt(estimator, 50, 10);
+    // 每 20 个包丢 1 个，即 5%
+    for (int i = 0; i < 200; i++) {
+        estimator.OnPacketsReceived(19, 1);
+    }
+    auto quality = estimator.GetSnapshot(0);
+    CHECK(std::fabs(quality.loss_rate - 0.05f) < 0.005f);
+    CHECK_EQ(quality.level, kLinkQualityFair);
+
+    // 丢包停止后平滑值按包数衰减，约 100 个包后降到 2% 以下
+    for (int i = 0; i < 100; i++) {
+        estimator.OnPacketsReceived(1, 0);
+    }
+    CHECK(estimator.GetSnapshot(0).loss_rate < 0.02f);
+    CHECK_EQ(estimator.GetSnapshot(0).level, kLinkQualityGood);
+}
+
+TEST_CASE(BurstLossIsWeightedByPacketCount) {
+    LinkQualityEstimator estimator;
+    // 一次报告 30 个连续丢包与逐个报告 30 次丢包的结果相同
+    LinkQualityEstimator single;
+    estimator.OnPacketsReceived(0, 30);
+    for (int i = 0; i < 30; i++) {
+        single.OnPacketsReceived(0, 1);
+    }
+    CHECK(std::fabs(estimator.GetSnapshot(0).loss_rate - single.GetSnapshot(0).loss_rate) < 1e-4f);
+    CHECK(estimator.GetSnapshot(0).loss_rate > 0.75f);
+}
+
+TEST_CASE(SendTimeDegradesLevel) {
+    LinkQualityEstimator estimator;
+    FeedRtt(estimator, 50, 10);
+    int64_t now = 0;
+    for (int i = 0; i < 50; i++) {
+        now += 60000;
+        estimator.OnSendCompleted(now, 250000, 100);
+    }
+    auto quality = estimator.GetSnapshot(now);
+    CHECK(std::abs(quality.send_time_ms - 250) < 5);
+    CHECK_EQ(quality.level, kLinkQualityPoor);
+}
+
+TEST_CASE(ThroughputFromByteCounts) {
+    LinkQualityEstimator estimator;
+    // 模拟 60 ms 一帧、每帧 240 字节的下行音频，即 4000 B/s
+    int64_t now = 1000000;
+    for (int i = 0; i < 500; i++) {
+        estimator.OnBytesReceived(now, 240);
+        now += 60000;
+    }
+    auto quality = estimator.GetSnapshot(now);
+    CHECK(std::abs((int)quality.rx_bytes_per_second - 4000) < 200);
+    CHECK_EQ(quality.tx_bytes_per_second, 0u);
+
+    // 停止接收后，空闲的每一秒按 0 合并，最终归零
+    now += 30 * 1000000LL;
+    CHECK_EQ(estimator.GetSnapshot(now).rx_bytes_per_second, 0u);
+}
+
+TEST_CASE(ResetClearsEverything) {
+    LinkQualityEstimator estimator;
+    FeedRtt(estimator, 500, 10);
+    estimator.OnPacketsReceived(0, 10);
+    estimator.OnSendCompleted(1000, 100000, 100);
+    estimator.Reset();
+    auto quality = estimator.GetSnapshot(2000000);
+    CHECK_EQ(quality.level, kLinkQualityUnknown);
+    CHECK_EQ(quality.rtt_ms, -1);
+    CHECK(quality.loss_rate == 0);
+    CHECK_EQ(quality.send_time_ms, 0);
+}
@@ -0,0 +1,10 @@
+#include "host_test.h"
+
+int main() {
+    for (auto& test : host_test::Registry()) {
+        int failures = host_test::Failures();
+        test.function();
+        printf("[%s] %s\n", host_test::Failures() == failures ? "PASS" : "FAIL", test.name);
+    }
+    return host_test::Failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+#include "host_test.h"
+#include "host.h"
+#include "timer_service.h"
+
+#include <deque>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+// 在虚拟时钟上运行时间轮，时间只由测试推进，结果可重复
+
+#define TICK_US (TIMER_WHEEL_TICK_MS * 1000LL)
+
+static std::deque<std::function<void()>> main_loop;
+
+static void RunMainLoop() {
+    while (!main_loop.empty()) {
+        auto callback = std::move(main_loop.front());
+        main_loop.pop_front();
+        callback();
+    }
+}
+
+static TimerService& Service() {
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+        host::UseVirtualClock(1000000);
+        TimerService::GetInstance().SetMainLoopDispatcher([](std::function<void()> callback) {
+            main_loop.push_back(std::move(callback));
+        });
+    }
+    return TimerService::GetInstance();
+}
+
+TEST_CASE(OnceFiresAtDeadlineRoundedUpToTick) {
+    auto& service = Service();
+    std::vector<int64_t> fired;
+    int id = service.Create("once", kTimerDispatchTimerTask, [&fired]() { fired.push_back(esp_timer_get_time()); });
+    int64_t start = esp_timer_get_time();
+    service.StartOnce(id, 25);
+    host::AdvanceClock(20000);
+    CHECK(fired.empty());
+    host::AdvanceClock(20000);
+    CHECK_EQ(fired.size(), 1u);
+    if (!fired.empty()) {
+        CHECK(fired[0] >= start + 25000);
+        CHECK(fired[0] < start + 25000 + TICK_US);
+    }
+    CHECK(!service.IsActive(id));
+    service.Delete(id);
+}
+
+TEST_CASE(PeriodicDoesNotDrift) {
+    auto& service = Service();
+    int count = 0;
+    int64_t last = 0;
+    int id = service.Create("periodic", kTimerDispatchTimerTask, [&]() {
+        count++;
+        last = esp_timer_get_time();
+    });
+    int64_t start = esp_timer_get_time();
+    service.StartPeriodic(id, 1000);
+    host::AdvanceClock(3600 * 1000000LL);
+    CHECK_EQ(count, 3600);
+    // 周期以 deadline 累加，一小时后仍落在最初的相位上
+    CHECK_EQ((last - start) % 1000000, 0);
+    service.Delete(id);
+}
+
+TEST_CASE(SlackJoinsExistingWakeup) {
+    auto& service = Service();
+    int a_count = 0;
+    int b_count = 0;
+    int a = service.Create("a", kTimerDispatchTimerTask, [&]() { a_count++; });
+    int b = service.Create("b", kTimerDispatchTimerTask, [&]() { b_count++; });
+    service.StartPeriodic(a, 1000);
+    // 相位差 370 ms，slack 足够时合并到 a 的唤醒上
+    host::AdvanceClock(370000);
+    service.StartPeriodic(b, 1000, 1000);
+    host::ResetTimerWakeups();
+    host::AdvanceClock(600 * 1000000LL);
+    CHECK(a_count >= 600);
+    CHECK(b_count >= 599);
+    CHECK_EQ(host::TimerWakeups(), 600u);
+    service.Delete(a);
+    service.Delete(b);
+}
+
+TEST_CASE(LongTimerCascadesFromTopLevel) {
+    auto& service = Service();
+    int64_t fired = 0;
+    int id = service.Create("long", kTimerDispatchTimerTask, [&]() { fired = esp_timer_get_time(); });
+    int64_t start = esp_timer_get_time();
+    // 10 小时需要第 3 层，超出 64^3 个 tick
+    uint32_t delay_ms = 10 * 3600 * 1000;
+    service.StartOnce(id, delay_ms);
+    host::AdvanceClock(delay_ms * 1000LL - TICK_US);
+    CHECK_EQ(fired, 0);
+    host::AdvanceClock(2 * TICK_US);
+    CHECK(fired >= start + delay_ms * 1000LL);
+    CHECK(fired < start + delay_ms * 1000LL + TICK_US);
+    service.Delete(id);
+}
+
+TEST_CASE(StopDropsCallbackPostedToMainLoop) {
+    auto& service = Service();
+    int count = 0;
+    int id = service.Create("posted", kTimerDispatchMainLoop, [&]() { count++; });
+    service.StartOnce(id, 10);
+    host::AdvanceClock(20000);
+    CHECK_EQ(main_loop.size(), 1u);
+    // 回调已投递，主循环执行前停止
+    service.Stop(id);
+    RunMainLoop();
+    CHECK_EQ(count, 0);
+
+    service.StartPeriodic(id, 100);
+    host::AdvanceClock(100000);
+    RunMainLoop();
+    CHECK_EQ(count, 1);
+    service.Delete(id);
+}
+
+TEST_CASE(DeleteDropsCallbackPostedToMainLoop) {
+    auto& service = Service();
+    int count = 0;
+    int id = service.Create("posted", kTimerDispatchMainLoop, [&]() { count++; });
+    service.StartPeriodic(id, 100);
+    host::AdvanceClock(100000);
+    service.Delete(id);
+    RunMainLoop();
+    CHECK_EQ(count, 0);
+}
+
+TEST_CASE(SelfDeleteFromCallback) {
+    auto& service = Service();
+    int count = 0;
+    int id = -1;
+    id = service.Create("self_delete", kTimerDispatchTimerTask, [&]() {
+        count++;
+        TimerService::GetInstance().Delete(id);
+    });
+    service.StartPeriodic(id, 50);
+    host::AdvanceClock(1000000);
+    CHECK_EQ(count, 1);
+}
+
+// 随机启动、重启和停止定时器，检查每次触发都不早于要求的时间，且延后不超过 slack 加一个 tick
+TEST_CASE(RandomizedTimersFireWithinSlack) {
+    auto& service = Service();
+    std::mt19937 random(12345);
+    struct Expect {
+        int id;
+        int64_t period_us;
+        int64_t slack_us;
+        int64_t earliest;   // 下一次触发的最早时间
+        int64_t latest;
+        bool active;
+        int fired;
+    };
+    const int timer_count = 40;
+    std::vector<Expect> timers(timer_count);
+    int violations = 0;
+    for (int i = 0; i < timer_count; i++) {
+        auto& t = timers[i];
+        t.id = service.Create("random", kTimerDispatchTimerTask, [&t, &violations]() {
+            int64_t now = esp_timer_get_time();
+            if (!t.active || now < t.earliest || now > t.latest) {
+                violations++;
+            }
+            t.fired++;
+            if (t.period_us > 0) {
+                // 周期定时器以实际触发时刻之前的 deadline 为相位，下一次不早于一个周期之后
+                t.earliest = now - t.slack_us - TICK_US + t.period_us;
+                t.latest = now + t.period_us + t.slack_us + TICK_US;
+            } else {
+                t.active = false;
+            }
+        });
+    }
+    auto start = [&](Expect& t) {
+        std::uniform_int_distribution<int> kind(0, 3);
+        int64_t now = esp_timer_get_time();
+        uint32_t ms;
+        switch (kind(random)) {
+        case 0: ms = std::uniform_int_distribution<uint32_t>(1, 500)(random); break;
+        case 1: ms = std::uniform_int_distribution<uint32_t>(500, 60000)(random); break;
+        case 2: ms = std::uniform_int_distribution<uint32_t>(60000, 3600000)(random); break;
+        default: ms = std::uniform_int_distribution<uint32_t>(3600000, 20 * 3600000)(random); break;
+        }
+        uint32_t slack_ms = std::uniform_int_distribution<uint32_t>(0, 1)(random) ? ms / 5 : 0;
+        bool periodic = std::uniform_int_distribution<int>(0, 1)(random);
+        t.period_us = periodic ? ms * 1000LL : 0;
+        t.slack_us = slack_ms / TIMER_WHEEL_TICK_MS * TICK_US;
+        t.earliest = now + ms * 1000LL;
+        t.latest = now + ms * 1000LL + t.slack_us + TICK_US;
+        t.active = true;
+        if (periodic) {
+            service.StartPeriodic(t.id, ms, slack_ms);
+        } else {
+            service.StartOnce(t.id, ms, slack_ms);
+        }
+    };
+    for (auto& t : timers) {
+        start(t);
+    }
+    int64_t end = esp_timer_get_time() + 40 * 3600 * 1000000LL;
+    int total_fired = 0;
+    while (esp_timer_get_time() < end) {
+        host::AdvanceClock(std::uniform_int_distribution<int64_t>(1000, 600 * 1000000LL)(random));
+        auto& t = timers[std::uniform_int_distribution<int>(0, timer_count - 1)(random)];
+        if (std::uniform_int_distribution<int>(0, 3)(random) == 0) {
+            service.Stop(t.id);
+            t.active = false;
+        } else {
+            start(t);
+        }
+    }
+    for (auto& t : timers) {
+        total_fired += t.fired;
+        service.Delete(t.id);
+    }
+    CHECK(total_fired > 1000);
+    CHECK_EQ(violations, 0);
+}
@@ -0,0 +1,282 @@
+#include "host_test.h"
+#include "host.h"
+#include "trace_recorder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+// TraceRecorder 是单例，缓冲区不能清空，两个测试按注册顺序执行，第二个在第一个之后继续写入
+// 导出的串口文本保存在 TRACE_DUMP_PATH（默认当前目录的 trace_dump.txt），ctest 随后用 trace_export.py 转换
+
+// 每个核心 256 个事件
+#define RING_EVENTS 256
+// 主机上 Event 为 24 字节（64 位指针）
+#define EVENT_SIZE 24
+
+struct DumpedEvent {
+    int64_t time_us;
+    uint8_t type;
+    uint8_t core;
+    uint8_t task;
+    std::string name;
+    uint32_t arg;
+};
+
+struct Dump {
+    bool valid = false;
+    int version = 0;
+    int cores = 0;
+    uint32_t event_count = 0;
+    uint32_t dropped = 0;
+    std::vector<std::string> tasks;
+    std::vector<DumpedEvent> events;
+};
+
+static const char* DumpPath() {
+    auto path = getenv("TRACE_DUMP_PATH");
+    return path != nullptr ? path : "trace_dump.txt";
+}
+
+// DumpAsync 通过 printf 输出，导出期间把标准输出重定向到文件
+static std::string DumpToText() {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(DumpPath(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    TraceRecorder::GetInstance().DumpAsync();
+    host::WaitForTasks("dump_trace");
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    std::ifstream file(DumpPath());
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+static std::vector<uint8_t> DecodeBase64Lines(const std::string& text) {
+    static const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::vector<uint8_t> data;
+    uint32_t bits = 0;
+    int bit_count = 0;
+    for (char c : text) {
+        auto value = alphabet.find(c);
+        if (value == std::string::npos) {
+            // 换行和末尾的 '=' 填充，每行单独编码，填充之后重新对齐
+            if (c == '\n') {
+                bits = 0;
+                bit_count = 0;
+            }
+            continue;
+        }
+        bits = (bits << 6) | value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            data.push_back((bits >> bit_count) & 0xFF);
+        }
+    }
+    return data;
+}
+
+static uint32_t ReadU32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static Dump ParseDump(const std::string& text) {
+    Dump dump;
+    auto begin = text.find("-----BEGIN XIAOZHI TRACE-----\n");
+    auto end = text.find("-----END XIAOZHI TRACE-----", begin);
+    if (begin == std::string::npos || end == std::string::npos) {
+        return dump;
+    }
+    begin += strlen("-----BEGIN XIAOZHI TRACE-----\n");
+    auto data = DecodeBase64Lines(text.substr(begin, end - begin));
+    if (data.size() < 18 || memcmp(data.data(), TRACE_MAGIC, 5) != 0) {
+        return dump;
+    }
+
+    const uint8_t* p = data.data();
+    dump.version = p[5];
+    dump.cores = p[6];
+    int task_count = p[7];
+    int name_count = p[8] << 8 | p[9];
+    dump.event_count = ReadU32(p + 10);
+    dump.dropped = ReadU32(p + 14);
+    size_t offset = 18;
+
+    for (int i = 0; i < task_count; i++) {
+        dump.tasks.emplace_back((const char*)p + offset, strnlen((const char*)p + offset, TRACE_TASK_NAME_LENGTH));
+        offset += TRACE_TASK_NAME_LENGTH;
+    }
+    std::vector<std::string> names;
+    for (int i = 0; i < name_count; i++) {
+        int length = p[offset];
+        names.emplace_back((const char*)p + offset + 1, length);
+        offset += 1 + length;
+    }
+    while (offset + 17 <= data.size()) {
+        DumpedEvent event;
+        event.time_us = (int64_t)((uint64_t)ReadU32(p + offset) << 32 | ReadU32(p + offset + 4));
+        event.type = p[offset + 8];
+        event.core = p[offset + 9];
+        event.task = p[offset + 10];
+        int name = p[offset + 11] << 8 | p[offset + 12];
+        event.name = name < (int)names.size() ? names[name] : "";
+        event.arg = ReadU32(p + offset + 13);
+        dump.events.push_back(event);
+        offset += 17;
+    }
+    dump.valid = offset == data.size();
+    return dump;
+}
+
+struct Writer {
+    uint32_t id;
+    uint32_t count;
+    bool spans;
+};
+
+static void WriterTask(void* arg) {
+    auto writer = (Writer*)arg;
+    for (uint32_t i = 0; i < writer->count; i++) {
+        if (writer->spans) {
+            TRACE_BEGIN("job");
+            TRACE_INSTANT("progress", writer->id * 100000 + i);
+            TRACE_END("job");
+        } else {
+            TRACE_INSTANT("progress", writer->id * 100000 + i);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static void StartWriter(Writer* writer, const char* name, int core) {
+    xTaskCreatePinnedToCore(WriterTask, name, 4096, writer, 5, nullptr, core);
+}
+
+static void Setup() {
+    static bool started = false;
+    if (!started) {
+        started = true;
+        CHECK(TraceRecorder::GetInstance().Start(portNUM_PROCESSORS * RING_EVENTS * EVENT_SIZE));
+    }
+}
+
+static int TaskIndex(const Dump& dump, const std::string& name) {
+    for (size_t i = 0; i < dump.tasks.size(); i++) {
+        if (dump.tasks[i] == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 每个核心两个任务同时写入，未写满缓冲区，全部事件都在导出结果中
+TEST_CASE(DumpContainsEveryEventWithItsTaskAndCore) {
+    Setup();
+    Writer writers[] = {{1, 20, true}, {2, 20, true}, {3, 20, true}, {4, 20, true}};
+    const char* names[] = {"writer_a", "writer_b", "writer_c", "writer_d"};
+    for (int i = 0; i < 4; i++) {
+        StartWriter(&writers[i], names[i], i % 2);
+    }
+    for (auto name : names) {
+        host::WaitForTasks(name);
+    }
+    TRACE_COMPLETE("boot", 1000, 3500);
+
+    auto dump = ParseDump(DumpToText());
+    CHECK(dump.valid);
+    CHECK_EQ(dump.version, TRACE_VERSION);
+    CHECK_EQ(dump.cores, portNUM_PROCESSORS);
+    CHECK_EQ(dump.event_count, 4u * 20 * 3 + 1);
+    CHECK_EQ(dump.events.size(), dump.event_count);
+    CHECK_EQ(dump.dropped, 0u);
+
+    std::map<int, int> begins;
+    std::map<int, int> ends;
+    for (int i = 0; i < 4; i++) {
+        int task = TaskIndex(dump, names[i]);
+        CHECK(task >= 0);
+        uint32_t next = writers[i].id * 100000;
+        for (auto& event : dump.events) {
+            if (event.task != task) {
+                continue;
+            }
+            CHECK_EQ(event.core, i % 2);
+            if (event.type == kTraceBegin) {
+                CHECK(event.name == "job");
+                begins[i]++;
+            } else if (event.type == kTraceEnd) {
+                ends[i]++;
+            } else if (event.type == kTraceInstant) {
+                CHECK(event.name == "progress");
+                // 同一任务的事件在所在核心的缓冲区中按写入顺序排列
+                CHECK_EQ(event.arg, next);
+                next++;
+            }
+        }
+        CHECK_EQ(begins[i], 20);
+        CHECK_EQ(ends[i], 20);
+        CHECK_EQ(next, writers[i].id * 100000 + 20);
+    }
+
+    int completes = 0;
+    for (auto& event : dump.events) {
+        if (event.type == kTraceComplete) {
+            completes++;
+            CHECK(event.name == "boot");
+            CHECK_EQ(event.time_us, 1000);
+            CHECK_EQ(event.arg, 2500u);
+            CHECK_EQ(event.task, TaskIndex(dump, "main"));
+        }
+    }
+    CHECK_EQ(completes, 1);
+}
+
+// 写满多圈后每个核心只保留最新的 RING_EVENTS 个事件，覆盖的数量计入 dropped
+// 同一核心上多个任务写满一圈时会写同一位置，ThreadSanitizer 会报告这种文档中说明的覆盖，所以每个核心只用一个任务
+TEST_CASE(WrappedRingsKeepTheNewestEvents) {
+    Setup();
+    auto before = ParseDump(DumpToText());
+    uint32_t recorded = before.event_count + before.dropped;
+
+    Writer writers[] = {{5, 7 * RING_EVENTS, false}, {6, 7 * RING_EVENTS, false}};
+    StartWriter(&writers[0], "lapper_0", 0);
+    StartWriter(&writers[1], "lapper_1", 1);
+    host::WaitForTasks("lapper_0");
+    host::WaitForTasks("lapper_1");
+
+    auto dump = ParseDump(DumpToText());
+    CHECK(dump.valid);
+    CHECK_EQ(dump.event_count, (uint32_t)portNUM_PROCESSORS * RING_EVENTS);
+    CHECK_EQ(dump.events.size(), dump.event_count);
+    CHECK_EQ(dump.event_count + dump.dropped, recorded + 2u * 7 * RING_EVENTS);
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        int task = TaskIndex(dump, core == 0 ? "lapper_0" : "lapper_1");
+        CHECK(task >= 0);
+        // 保留的是该任务最后写入的 RING_EVENTS 个事件
+        uint32_t next = writers[core].id * 100000 + writers[core].count - RING_EVENTS;
+        int count = 0;
+        for (auto& event : dump.events) {
+            if (event.core != core) {
+                continue;
+            }
+            CHECK_EQ(event.task, task);
+            CHECK_EQ(event.arg, next);
+            next++;
+            count++;
+        }
+        CHECK_EQ(count, RING_EVENTS);
+    }
+}